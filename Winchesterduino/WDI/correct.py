@@ -0,0 +1,176 @@
+# Winchesterduino (c) 2025 J. Bogin, http://boginjr.com
+# WDI offline CRC/ECC corrector
+
+# Syntax: python correct.py input.wdi output.wdi [-s bits] [-j jobs] [-v]
+#         python correct.py -m [-s bits] [-j jobs]
+#         -s: longest error burst to correct (default 1 bit with CRC, 11 bits with 32-bit ECC, 22 bits with 56-bit ECC),
+#         -j: number of threads (default: all processors),
+#         -v: list the result of each sector,
+#         -m: measure corrected sectors per second on random errors, per core and in total.
+# The correction runs in the C++ library of wdicorrect/ (build it as shown in wdicorrect.h);
+# without it, a single threaded Python corrector is used.
+
+import sys
+import os
+import time
+import random
+
+from wdi.parser import WdiParser
+from wdi.corrector import WdiCorrector, correctRecords, loadLibrary
+
+def main():
+    argc = len(sys.argv)
+    if (argc < 2):
+        showUsage()
+        return
+        
+    benchmark = (sys.argv[1].lower() == "-m")
+    idx = 1 if benchmark else 3
+    if ((not benchmark) and (argc < 3)):
+        showUsage()
+        return
+        
+    maxBurst = None
+    jobs = os.cpu_count() or 1
+    verbose = False
+    while (idx < argc):
+        if ((sys.argv[idx].lower() == "-s") and (argc > idx+1) and sys.argv[idx+1].isdigit() and (int(sys.argv[idx+1]) > 0)):
+            maxBurst = int(sys.argv[idx+1])
+            idx += 1
+        elif ((sys.argv[idx].lower() == "-j") and (argc > idx+1) and sys.argv[idx+1].isdigit() and (int(sys.argv[idx+1]) > 0)):
+            jobs = int(sys.argv[idx+1])
+            idx += 1
+        elif (sys.argv[idx].lower() == "-v"):
+            verbose = True
+        elif ((sys.argv[idx].lower() != "-m") or (idx != 1)):
+            showUsage()
+            return
+        idx += 1
+        
+    if (benchmark):
+        measure(maxBurst, jobs)
+        return
+        
+    if (sys.argv[1] == sys.argv[2]):
+        print("Input and output must not be the same")
+        return
+        
+    records = []
+    wdi = WdiParser(sys.argv[1], checkBytesRecords = records)
+    if (not wdi.isInitialized()):
+        print("Cannot open supplied file.")
+        return
+    
+    params = wdi.getImageParams()
+    if ((params["result"] == False) or (params["dataVerify"] > 2)):
+        print("Invalid WDI file specified.")
+        return
+        
+    if (wdi.parse()["result"] == False):
+        print("Track/sector data fields contain invalid or incomplete values, use inspect.py -e for details.")
+        return
+        
+    if (not records):
+        print("No sectors with stored CRC/ECC bytes in this image.")
+        print("Read the disk with the long read option enabled to store them.")
+        return
+    
+    showBackend(jobs)
+    print("Correcting " + str(len(records)) + " sector(s)...")
+    start = time.perf_counter()
+    results = correctRecords(records, params["dataVerify"], maxBurst, jobs)
+    elapsed = time.perf_counter() - start
+    
+    # rewrite the image, corrected sectors become type 1 (compressed if all bytes equal, as the firmware does)
+    with open(sys.argv[1], "rb") as inputFile:
+        image = inputFile.read()
+        
+    output = bytearray()
+    lastPos = 0
+    counts = {"valid": 0, "corrected": 0, "ambiguous": 0, "uncorrectable": 0}
+    for record, (status, data) in zip(records, results):
+        counts[status] += 1
+        if (verbose):
+            print("Cylinder:", record["cylinder"], "Head:", record["head"], "Sector:", record["sector"], "->", status)
+        if ((status != "valid") and (status != "corrected")):
+            continue
+            
+        output += image[lastPos:record["offset"]]
+        if (data.count(data[0]) == len(data)):
+            output += bytes([0x81, data[0]])
+        else:
+            output += bytes([1]) + data
+        lastPos = record["offset"] + 1 + len(record["data"]) + len(record["checkBytes"])
+    output += image[lastPos:]
+    
+    try:
+        with open(sys.argv[2], "wb") as outputFile:
+            outputFile.write(output)
+    except:
+        print("Error writing output image")
+        return
+    
+    print(str(counts["corrected"]) + " corrected,")
+    print(str(counts["valid"]) + " read with an error, but their check bytes agree with the data,")
+    print(str(counts["ambiguous"]) + " ambiguous (more than one error pattern fits),")
+    print(str(counts["uncorrectable"]) + " uncorrectable, kept as they were.")
+    print("%.1f sectors/s" % (len(records) / elapsed if elapsed else 0))
+    print("\nProcessing done")
+    return
+    
+def measure(maxBurst, jobs):
+    # random 512B sectors with a random burst each, within the correctable length
+    count = 20000 if loadLibrary() else 1000
+    random.seed(0)
+    showBackend(jobs)
+    print("Sectors/s, " + str(count) + " sectors of 512B with a random error burst:\n")
+    
+    for dataVerify, name in ((0, "16-bit CRC"), (1, "32-bit ECC"), (2, "56-bit ECC")):
+        corrector = WdiCorrector(dataVerify, maxBurst)
+        burst = WdiCorrector.DEFAULT_BURST[dataVerify] if (maxBurst is None) else min(maxBurst, corrector.checkBytesCount()*8)
+        records = []
+        for index in range(count):
+            data = bytes(random.getrandbits(8) for byte in range(512))
+            
+            # check bytes of the data field: the register after the address mark and data
+            checkBytes = corrector.syndrome(data, bytes()).to_bytes(corrector.checkBytesCount(), "big")
+            
+            record = bytearray(data + checkBytes)
+            length = random.randint(1, burst)
+            pattern = random.getrandbits(length) | 1 | (1 << (length-1))
+            position = random.randrange(len(record)*8 - length)
+            for bit in range(length):
+                if ((pattern >> bit) & 1):
+                    record[len(record) - 1 - ((position+bit) >> 3)] ^= 1 << ((position+bit) & 7)
+            records.append({"data": bytes(record[:512]), "checkBytes": bytes(record[512:])})
+        
+        start = time.perf_counter()
+        single = correctRecords(records, dataVerify, maxBurst, 1)
+        perCore = count / (time.perf_counter() - start)
+        
+        start = time.perf_counter()
+        correctRecords(records, dataVerify, maxBurst, jobs)
+        total = count / (time.perf_counter() - start)
+        
+        corrected = sum(1 for (status, data) in single if (status == "corrected"))
+        print("%s, bursts up to %u bits: %.1f per core, %.1f with %u thread(s), %u/%u corrected" %
+              (name, burst, perCore, total, jobs if loadLibrary() else 1, corrected, count))
+    return
+    
+def showBackend(jobs):
+    if (loadLibrary()):
+        print("Using the C++ corrector library with " + str(jobs) + " thread(s).")
+    else:
+        print("C++ corrector library not built (see wdicorrect/wdicorrect.h), using Python on one thread.")
+
+def showUsage():
+    print("Corrects sectors stored with their CRC/ECC bytes in a Winchesterduino disk image.\n")
+    print("correct.py input.wdi output.wdi [-s bits] [-j jobs] [-v]\ncorrect.py -m [-s bits] [-j jobs]\n")
+    print("  -s bits\tLongest error burst to correct (default: 1 CRC, 11 32-bit ECC, 22 56-bit ECC).")
+    print("  -j jobs\tNumber of threads of the C++ library (default: all processors).")
+    print("  -v\t\tList the result of each sector.")
+    print("  -m\t\tMeasure sectors per second on random errors.")
+    return
+
+if __name__ == "__main__":
+    main()
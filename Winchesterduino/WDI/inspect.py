@@ -63,6 +63,10 @@ def main():
     print(str(parse["badBlocks"]) + " bad block(s),")
     print(str(parse["unreadableTracks"]) + " unreadable track(s),") 
     print(str(parse["dataErrors"]) + " CRC/ECC error(s).") 
+    if (parse["checkBytesStored"]):
+        print(str(parse["checkBytesStored"]) + " of these stored with their CRC/ECC bytes (long read).")
+    if (parse["timedTracks"]):
+        print(str(parse["timedTracks"]) + " track(s) stored with sector ID timings (shown with -t).")
     if (verboseTrackListing is None):
         print("Specify the -t command line argument to display detailed sector layout of each track.")
     if (binaryOutputFileName is None):
@@ -0,0 +1,178 @@
+# Winchesterduino (c) 2025 J. Bogin, http://boginjr.com
+# Offline CRC/ECC correction of WDI type 3 sector records
+
+import os
+import ctypes
+
+# the C++ library of the same corrector, built in ../wdicorrect (see wdicorrect.h); this one is the fallback
+STATUSES = ("valid", "corrected", "ambiguous", "uncorrectable")
+_library = None
+
+def loadLibrary():
+    global _library
+    if (_library is None):
+        _library = False
+        directory = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "wdicorrect")
+        for name in ("libwdicorrect.so", "libwdicorrect.dylib", "wdicorrect.dll"):
+            try:
+                library = ctypes.CDLL(os.path.join(directory, name))
+                library.wdiCorrectRecords.restype = ctypes.c_int
+                _library = library
+                break
+            except (OSError, AttributeError):
+                continue
+    return _library
+    
+def correctRecords(records, dataVerify, maxBurst = None, jobs = 0):
+    # list of (status, data) for each record, with the C++ library over jobs threads (0: all processors) if built
+    library = loadLibrary()
+    if (not records):
+        return []
+    if (not library):
+        corrector = WdiCorrector(dataVerify, maxBurst)
+        return [corrector.correct(record["data"], record["checkBytes"]) for record in records]
+        
+    count = len(records)
+    buffer = bytearray()
+    offsets = (ctypes.c_uint32 * count)()
+    lengths = (ctypes.c_uint32 * count)()
+    for index, record in enumerate(records):
+        offsets[index] = len(buffer)
+        lengths[index] = len(record["data"])
+        buffer += record["data"] + record["checkBytes"]
+    status = (ctypes.c_uint8 * count)()
+    
+    # corrected in place
+    data = (ctypes.c_uint8 * len(buffer)).from_buffer(buffer)
+    result = library.wdiCorrectRecords(dataVerify, maxBurst or 0, 1, data, offsets, lengths, count, jobs, status)
+    del data
+    if (result != 0):
+        raise ValueError("Invalid data verify type")
+    
+    return [(STATUSES[status[index]], bytes(buffer[offsets[index]:offsets[index] + lengths[index]])) for index in range(count)]
+
+class WdiCorrector:
+    # CRC/ECC width and polynomial by data verify type, as shown by the Hexdump command
+    # registers start with all bits set, and the data field begins with the A1 F8 address mark
+    POLYNOMIALS = {0: (16, 0x1021),
+                   1: (32, 0x140A0445),
+                   2: (56, 0x140A0445000101)}
+    ADDRESS_MARK = bytes([0xA1, 0xF8])
+    
+    # default longest burst to correct; the WD42C22 itself corrects 5 bits with ECC, and nothing with CRC
+    # the longer the burst, the likelier a wrong (but still unique) correction
+    DEFAULT_BURST = {0: 1, 1: 11, 2: 22}
+    
+    def __init__(self, dataVerify, maxBurst = None, doubleBits = True):
+        self._width, self._polynomial = self.POLYNOMIALS[dataVerify]
+        self._mask = (1 << self._width) - 1
+        self._checkBytes = self._width // 8
+        
+        self._maxBurst = self.DEFAULT_BURST[dataVerify] if (maxBurst is None) else min(maxBurst, self._width)
+        self._doubleBits = doubleBits
+        
+        # byte at a time CRC
+        self._table = []
+        top = 1 << (self._width - 1)
+        for index in range(256):
+            crc = index << (self._width - 8)
+            for bit in range(8):
+                crc = ((crc << 1) ^ self._polynomial) if (crc & top) else (crc << 1)
+            self._table.append(crc & self._mask)
+            
+        # x^i mod G of each bit position from the end of the record, per record length
+        self._powers = {}
+            
+    def checkBytesCount(self):
+        return self._checkBytes
+        
+    def syndrome(self, data, checkBytes):
+        # zero if the data and its check bytes agree
+        crc = self._mask
+        shift = self._width - 8
+        table = self._table
+        mask = self._mask
+        for byte in self.ADDRESS_MARK + data + checkBytes:
+            crc = ((crc << 8) & mask) ^ table[((crc >> shift) ^ byte) & 0xFF]
+        return crc
+        
+    def correct(self, data, checkBytes):
+        # returns (status, data): "valid", "corrected", "ambiguous" (more than one error pattern fits) or "uncorrectable"
+        # error bit positions count from the last bit of the check bytes
+        syndrome = self.syndrome(data, checkBytes)
+        if (syndrome == 0):
+            return ("valid", data)
+            
+        # the register holds the record times x^width, take that out
+        generator = self._polynomial | (1 << self._width)
+        for bit in range(self._width):
+            syndrome = ((syndrome ^ generator) >> 1) if (syndrome & 1) else (syndrome >> 1)
+            
+        totalBits = (len(data) + len(checkBytes)) * 8
+        candidates = self._findBursts(syndrome, totalBits)
+        if ((not candidates) and self._doubleBits):
+            candidates = self._findDoubleBits(syndrome, totalBits)
+            
+        if (not candidates):
+            return ("uncorrectable", data)
+        if (len(candidates) > 1):
+            return ("ambiguous", data)
+            
+        record = bytearray(data + checkBytes)
+        for position in candidates[0]:
+            record[len(record) - 1 - (position >> 3)] ^= 1 << (position & 7)
+        
+        # sanity check
+        data = bytes(record[:len(data)])
+        if (self.syndrome(data, bytes(record[len(data):])) != 0):
+            return ("uncorrectable", data)
+        return ("corrected", data)
+        
+    def _findBursts(self, syndrome, totalBits):
+        # error trapping: the syndrome of a burst B at position k is B * x^k mod G,
+        # so divide by x until what remains fits into the burst length; one pass over the record
+        candidates = []
+        limit = 1 << self._maxBurst
+        generator = self._polynomial | (1 << self._width)
+        remainder = syndrome
+        
+        for position in range(totalBits):
+            # bursts are counted once, by their lowest bit
+            if ((remainder & 1) and (remainder < limit)):
+                if (position + remainder.bit_length() <= totalBits):
+                    candidates.append([position + bit for bit in range(remainder.bit_length()) if (remainder >> bit) & 1])
+                    if (len(candidates) > 1):
+                        break
+                    
+            # times x^-1 mod G; the constant term of all polynomials is 1
+            remainder = ((remainder ^ generator) >> 1) if (remainder & 1) else (remainder >> 1)
+            
+        return candidates
+        
+    def _findDoubleBits(self, syndrome, totalBits):
+        # two single bit errors anywhere in the record: x^i + x^j mod G
+        if (totalBits not in self._powers):
+            powers = {}
+            power = 1
+            top = 1 << self._width
+            generator = self._polynomial | top
+            for position in range(totalBits):
+                powers[power] = position
+                power <<= 1
+                if (power & top):
+                    power ^= generator
+            self._powers[totalBits] = powers
+        powers = self._powers[totalBits]
+        
+        candidates = []
+        for power, first in powers.items():
+            second = powers.get(syndrome ^ power)
+            if ((second is not None) and (second > first)):
+                candidates.append([first, second])
+                if (len(candidates) > 1):
+                    break
+                    
+        return candidates
+        
+if __name__ == "__main__":
+    print("Not to be executed manually, use the scripts from one level up")
@@ -9,7 +9,8 @@ class WdiParser:
                        verboseTrackListing = None,
                        binaryOutputFileName = None,
                        binaryOutputReinterleave = False,
-                       badBlockFillByte = 0):
+                       badBlockFillByte = 0,
+                       checkBytesRecords = None):
                 
         # all files opened OK
         self._initialized = False
@@ -21,6 +22,9 @@ class WdiParser:
         # binary output: write logical sectors in original interleave, or reorder to 1:1 interleave
         self._binaryOutputReinterleave = binaryOutputReinterleave
         
+        # list to collect the type 3 sector records into, with their file offsets (see correct.py)
+        self._checkBytesRecords = checkBytesRecords
+        
         if (verboseErrors is None):
             self._verboseErrors = False
         else:
@@ -180,6 +184,39 @@ class WdiParser:
         else:
             return 256;
     
+    def checkBytesCount(self, dataVerify):
+        # CRC/ECC bytes stored after the data of a type 3 sector record
+        if (dataVerify == 1):
+            return 4
+        elif (dataVerify == 2):
+            return 7
+        else:
+            return 2
+    
+    def printTimings(self, timings, logsectors, logsdhs, params):
+        # timings[0]: index to the first ID in microseconds, 0xFFFF if unknown
+        # timings[1:]: microseconds from the preceding ID to each one in the map, 0 if unknown
+        intervals = timings[1:]
+        print("ID intervals (us): ", end="")
+        print(intervals)
+        if (timings[0] != 0xFFFF):
+            print("Index to the first ID:", timings[0], "us")
+        if ((len(intervals) == 0) or (0 in intervals)):
+            return
+        
+        # the longest interval normally also spans the index
+        rotation = sum(intervals)
+        longest = intervals.index(max(intervals))
+        print("Rotation: %u us (%.1f RPM), longest gap before sector %u" % (rotation, 60000000.0 / rotation, logsectors[longest]))
+        
+        # approximate GAP3 from the shortest interval: 1.6us per byte with MFM at 5Mbit/s, 16/15us with RLL at 7.5Mbit/s,
+        # less the rest of the sector: PLO syncs, ID field, address mark, pads and write splices (39 bytes), data, CRC/ECC
+        usPerByte = (16.0 / 15.0) if params["dataMode"] else 1.6
+        sectorBytes = 39 + self.sdhToSectorSize(logsdhs[0]) + self.checkBytesCount(params["dataVerify"])
+        gap = int(min(intervals) / usPerByte) - sectorBytes
+        if (gap >= 4):
+            print("Estimated GAP3: %u bytes" % gap)
+    
     def getInterleave(self, sectorMap):
         if (len(sectorMap) == 0):
             return None
@@ -207,6 +244,9 @@ class WdiParser:
         unreadableTracks = 0
         badBlocks = 0
         dataErrors = 0
+        checkBytesStored = 0
+        timedTracks = 0
+        checkBytesCount = self.checkBytesCount(params["dataVerify"])
 
         while True:
         #  
@@ -219,7 +259,9 @@ class WdiParser:
                     return {"result": True, 
                             "unreadableTracks": unreadableTracks,
                             "badBlocks": badBlocks,
-                            "dataErrors": dataErrors}
+                            "dataErrors": dataErrors,
+                            "checkBytesStored": checkBytesStored,
+                            "timedTracks": timedTracks}
                 #
                 else:
                 #
@@ -239,7 +281,9 @@ class WdiParser:
                     return {"result": True, 
                             "unreadableTracks": unreadableTracks,
                             "badBlocks": badBlocks,
-                            "dataErrors": dataErrors}
+                            "dataErrors": dataErrors,
+                            "checkBytesStored": checkBytesStored,
+                            "timedTracks": timedTracks}
                 #
                 if (self._verboseErrors):
                     print("Expected physical cylinder MSB, got end-of-file at offset", 
@@ -253,7 +297,9 @@ class WdiParser:
                 return {"result": True, 
                               "unreadableTracks": unreadableTracks,
                               "badBlocks": badBlocks,
-                              "dataErrors": dataErrors}
+                              "dataErrors": dataErrors,
+                              "checkBytesStored": checkBytesStored,
+                            "timedTracks": timedTracks}
             #
             
             phcyl = (phcyl_msb[0] << 8) | phcyl_lsb[0]
@@ -274,10 +320,14 @@ class WdiParser:
                           hex(self._file.tell()))
                 return {"result": False}
             #
-            if (phhead[0] > 15):
+            
+            # bit 7: a timing record follows the sector numbering map
+            timed = (phhead[0] & 0x80) != 0
+            phheadNo = phhead[0] & 0x7F
+            if (phheadNo > 15):
             #
                 if (self._verboseErrors):
-                    print("Invalid physical head value " + str(phhead[0]) + ", must be 0-15 at offset",
+                    print("Invalid physical head value " + str(phheadNo) + ", must be 0-15 at offset",
                           hex(self._file.tell()-1))
                 return {"result": False}
             #
@@ -301,7 +351,7 @@ class WdiParser:
             
             # print out track structure
             if (self._verboseTrackListing):
-                print("Cylinder:", phcyl, "Head:", phhead[0], "-> ", end="")      
+                print("Cylinder:", phcyl, "Head:", phheadNo, "-> ", end="")      
             if (spt[0] == 0):
             #
                 if (self._verboseTrackListing):
@@ -385,6 +435,25 @@ class WdiParser:
                 print("")                
             #
             
+            # timing record: index to the first ID, then an interval from the preceding ID for each sector of the map
+            if (timed):
+            #
+                timingSize = 2 + 2*spt[0]
+                timing = self._file.read(timingSize)
+                if ((not timing) or (len(timing) < timingSize)):
+                #
+                    if (self._verboseErrors):
+                        print("Expected sector ID timing record, got end-of-file at offset",
+                              hex(self._file.tell()))
+                    return {"result": False}
+                #
+                
+                timedTracks += 1
+                if (self._verboseTrackListing):
+                    timings = [timing[idx] | (timing[idx+1] << 8) for idx in range(0, timingSize, 2)]
+                    self.printTimings(timings, logsectors, logsdhs, params)
+            #
+            
             # binary output data: [ (logicalSectorNo,data), (logicalSectorNo,data) ...]
             #                           1st physical sector          2nd
             outputData = []
@@ -406,10 +475,10 @@ class WdiParser:
                     return {"result": False}
                 #
                 
-                if ((datatype[0] & 0x7F) > 2):
+                if (((datatype[0] & 0x7F) > 2) and (datatype[0] != 3)):
                 #
                     if (self._verboseErrors):
-                        print("Invalid sector data type " + str(hex(datatype[0])) + ", must be 0-2 or 0x81-0x82 at offset",
+                        print("Invalid sector data type " + str(hex(datatype[0])) + ", must be 0-3 or 0x81-0x82 at offset",
                               hex(self._file.tell()-1))      
                     return {"result": False}
                 #
@@ -432,6 +501,13 @@ class WdiParser:
                     if (self._verboseTrackListing):
                         print("Sector", logsectors[currSector-1], ": CRC/ECC data error")
                 #
+                elif (datatype[0] == 3):
+                #
+                    dataErrors += 1
+                    checkBytesStored += 1
+                    if (self._verboseTrackListing):
+                        print("Sector", logsectors[currSector-1], ": CRC/ECC data error, check bytes stored")
+                #
             
                 # sector contents                
                 if (datatype[0] & 0x80):
@@ -461,6 +537,27 @@ class WdiParser:
                     
                     if (self._binaryOutput is not None):
                         outputData.append( (logsectors[currSector-1], sectorData) )
+                    
+                    # type 3: the check bytes follow
+                    if (datatype[0] == 3):
+                    #
+                        checkBytes = self._file.read(checkBytesCount)
+                        if ((not checkBytes) or (len(checkBytes) < checkBytesCount)):
+                        #
+                            if (self._verboseErrors):
+                                print("Expected " + str(checkBytesCount) + " CRC/ECC bytes, got end-of-file at offset",
+                                      hex(self._file.tell()))
+                            return {"result": False}
+                        #
+                        
+                        if (self._checkBytesRecords is not None):
+                            self._checkBytesRecords.append({"offset": self._file.tell() - sectorSizeBytes - checkBytesCount - 1,
+                                                            "cylinder": phcyl,
+                                                            "head": phheadNo,
+                                                            "sector": logsectors[currSector-1],
+                                                            "data": sectorData,
+                                                            "checkBytes": checkBytes})
+                    #
                 #
             #
             
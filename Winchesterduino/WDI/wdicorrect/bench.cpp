@@ -0,0 +1,93 @@
+// Winchesterduino (c) 2025 J. Bogin, http://boginjr.com
+// Corrected sectors per second on random errors, on one core and over all of them
+
+// Syntax: wdicorrect_bench [sectors] [jobs]
+//         sectors: count of random 512B sectors of each data verify type (default 20000),
+//         jobs: number of threads (default: all processors).
+
+#include "wdicorrect.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+static double Measure(int dataVerify, std::vector<uint8_t> records, const std::vector<uint32_t>& offsets,
+                      const std::vector<uint32_t>& lengths, int jobs, std::vector<uint8_t>& status)
+{
+  // on a copy, as the records are corrected in place
+  const auto start = std::chrono::steady_clock::now();
+  wdiCorrectRecords(dataVerify, 0, 1, records.data(), offsets.data(), lengths.data(), (uint32_t)offsets.size(), jobs, status.data());
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  return elapsed.count() ? (offsets.size() / elapsed.count()) : 0;
+}
+
+int main(int argc, char* argv[])
+{
+  const uint32_t count = (argc > 1) && (atoi(argv[1]) > 0) ? (uint32_t)atoi(argv[1]) : 20000;
+  int jobs = (argc > 2) && (atoi(argv[2]) > 0) ? atoi(argv[2]) : (int)std::thread::hardware_concurrency();
+  if (jobs <= 0)
+  {
+    jobs = 1;
+  }
+
+  printf("Sectors/s, %u sectors of 512B with a random error burst:\n\n", count);
+
+  static const char* names[3] = {"16-bit CRC", "32-bit ECC", "56-bit ECC"};
+  std::mt19937 random(0);
+  for (int dataVerify = 0; dataVerify < 3; dataVerify++)
+  {
+    WdiCorrector corrector(dataVerify);
+    const uint32_t checkBytes = (uint32_t)corrector.getCheckBytesCount();
+    const uint32_t stride = 512 + checkBytes;
+    const int burst = corrector.getMaxBurst();
+
+    std::vector<uint8_t> records(count * stride);
+    std::vector<uint32_t> offsets(count);
+    std::vector<uint32_t> lengths(count, 512);
+    for (uint32_t index = 0; index < count; index++)
+    {
+      uint8_t* record = &records[index * stride];
+      offsets[index] = index * stride;
+      for (uint32_t byte = 0; byte < 512; byte++)
+      {
+        record[byte] = (uint8_t)random();
+      }
+
+      // check bytes of the data field: the register after the address mark and data
+      const uint64_t check = corrector.syndrome(record, 512);
+      for (uint32_t byte = 0; byte < checkBytes; byte++)
+      {
+        record[512 + byte] = (uint8_t)(check >> ((checkBytes - 1 - byte) * 8));
+      }
+
+      // a burst within the correctable length, with both of its end bits set
+      const int length = 1 + (int)(random() % burst);
+      const uint64_t pattern = (random() | ((uint64_t)random() << 32) | 1 | (1ULL << (length - 1))) & ((length < 64) ? ((1ULL << length) - 1) : ~0ULL);
+      const uint32_t position = random() % (stride * 8 - length);
+      for (int bit = 0; bit < length; bit++)
+      {
+        if ((pattern >> bit) & 1)
+        {
+          record[stride - 1 - ((position + bit) >> 3)] ^= 1 << ((position + bit) & 7);
+        }
+      }
+    }
+
+    std::vector<uint8_t> status(count);
+    const double perCore = Measure(dataVerify, records, offsets, lengths, 1, status);
+    const double total = Measure(dataVerify, records, offsets, lengths, jobs, status);
+
+    uint32_t corrected = 0;
+    for (uint8_t result : status)
+    {
+      corrected += (result == WDI_CORRECTED) ? 1 : 0;
+    }
+
+    printf("%s, bursts up to %d bits: %.0f per core, %.0f with %d thread(s), %u/%u corrected\n",
+           names[dataVerify], burst, perCore, total, jobs, corrected, count);
+  }
+
+  return 0;
+}
@@ -0,0 +1,321 @@
+// Winchesterduino (c) 2025 J. Bogin, http://boginjr.com
+// Offline CRC/ECC correction of WDI type 3 sector records, host library
+
+#include "wdicorrect.h"
+#include <atomic>
+#include <thread>
+
+// CRC/ECC width and polynomial by data verify type, as shown by the Hexdump command
+// registers start with all bits set, and the data field begins with the A1 F8 address mark
+static const int Widths[3] = {16, 32, 56};
+static const uint64_t Polynomials[3] = {0x1021ULL, 0x140A0445ULL, 0x140A0445000101ULL};
+static const uint8_t AddressMark[2] = {0xA1, 0xF8};
+
+// records taken by a worker thread at once
+#define RECORDS_CHUNK 16
+
+static int BitLength(uint64_t value)
+{
+  int length = 0;
+  while (value)
+  {
+    length++;
+    value >>= 1;
+  }
+  return length;
+}
+
+// times x^-1 mod G; the constant term of all polynomials is 1
+static inline uint64_t DivideByX(uint64_t value, uint64_t generator)
+{
+  return (value & 1) ? ((value ^ generator) >> 1) : (value >> 1);
+}
+
+int WdiCorrector::getDefaultBurst(int dataVerify)
+{
+  // the WD42C22 itself corrects 5 bits with ECC, and nothing with CRC
+  // the longer the burst, the likelier a wrong (but still unique) correction
+  static const int defaults[3] = {1, 11, 22};
+  return ((dataVerify >= 0) && (dataVerify <= 2)) ? defaults[dataVerify] : 0;
+}
+
+WdiCorrector::WdiCorrector(int dataVerify, int maxBurst, bool doubleBits)
+{
+  m_width = 0;
+  m_maxBurst = 0;
+  m_doubleBits = doubleBits;
+  m_generator = 0;
+  if ((dataVerify < 0) || (dataVerify > 2))
+  {
+    return;
+  }
+
+  m_width = Widths[dataVerify];
+  m_maxBurst = (maxBurst > 0) ? ((maxBurst < m_width) ? maxBurst : m_width) : getDefaultBurst(dataVerify);
+  m_generator = Polynomials[dataVerify] | (1ULL << m_width);
+
+  // byte at a time, MSB first
+  const uint64_t polynomial = Polynomials[dataVerify] << (64 - m_width);
+  for (int index = 0; index < 256; index++)
+  {
+    uint64_t crc = (uint64_t)index << 56;
+    for (int bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 63) ? ((crc << 1) ^ polynomial) : (crc << 1);
+    }
+    m_table[0][index] = crc;
+  }
+
+  // the same byte followed by 1 to 7 zero bytes
+  for (int slice = 1; slice < 8; slice++)
+  {
+    for (int index = 0; index < 256; index++)
+    {
+      const uint64_t previous = m_table[slice-1][index];
+      m_table[slice][index] = (previous << 8) ^ m_table[0][previous >> 56];
+    }
+  }
+}
+
+uint64_t WdiCorrector::syndrome(const uint8_t* record, uint32_t length) const
+{
+  uint64_t crc = ~0ULL << (64 - m_width);
+  for (int index = 0; index < 2; index++)
+  {
+    crc = (crc << 8) ^ m_table[0][(crc >> 56) ^ AddressMark[index]];
+  }
+
+  // 8 bytes at once, independent table lookups
+  while (length >= 8)
+  {
+    crc ^= ((uint64_t)record[0] << 56) | ((uint64_t)record[1] << 48) | ((uint64_t)record[2] << 40) | ((uint64_t)record[3] << 32) |
+           ((uint64_t)record[4] << 24) | ((uint64_t)record[5] << 16) | ((uint64_t)record[6] << 8)  | (uint64_t)record[7];
+    crc = m_table[7][crc >> 56]         ^ m_table[6][(crc >> 48) & 0xFF] ^
+          m_table[5][(crc >> 40) & 0xFF] ^ m_table[4][(crc >> 32) & 0xFF] ^
+          m_table[3][(crc >> 24) & 0xFF] ^ m_table[2][(crc >> 16) & 0xFF] ^
+          m_table[1][(crc >> 8) & 0xFF]  ^ m_table[0][crc & 0xFF];
+    record += 8;
+    length -= 8;
+  }
+
+  while (length--)
+  {
+    crc = (crc << 8) ^ m_table[0][(crc >> 56) ^ *record++];
+  }
+
+  return crc >> (64 - m_width);
+}
+
+void WdiCorrector::prepare(uint32_t dataLength)
+{
+  const uint32_t totalBits = (dataLength + getCheckBytesCount()) * 8;
+  if (!m_doubleBits || !m_width || m_powers.count(totalBits))
+  {
+    return;
+  }
+
+  Powers& powers = m_powers[totalBits];
+  powers.ByPosition.resize(totalBits);
+  powers.Position.reserve(totalBits);
+
+  uint64_t power = 1;
+  const uint64_t top = 1ULL << m_width;
+  for (uint32_t position = 0; position < totalBits; position++)
+  {
+    powers.ByPosition[position] = power;
+    powers.Position.emplace(power, position);
+    power <<= 1;
+    if (power & top)
+    {
+      power ^= m_generator;
+    }
+  }
+}
+
+int WdiCorrector::correct(uint8_t* record, uint32_t dataLength) const
+{
+  const uint32_t length = dataLength + getCheckBytesCount();
+  uint64_t syndromeValue = syndrome(record, length);
+  if (!syndromeValue)
+  {
+    return WDI_VALID;
+  }
+
+  // the register holds the record times x^width, take that out
+  for (int bit = 0; bit < m_width; bit++)
+  {
+    syndromeValue = DivideByX(syndromeValue, m_generator);
+  }
+
+  // error bit positions count from the last bit of the check bytes
+  const uint32_t totalBits = length * 8;
+  uint32_t positions[64];
+  int count = 0;
+  int candidates = findBursts(syndromeValue, totalBits, positions, count);
+  if (!candidates && m_doubleBits)
+  {
+    candidates = findDoubleBits(syndromeValue, totalBits, positions);
+    count = 2;
+  }
+
+  if (!candidates)
+  {
+    return WDI_UNCORRECTABLE;
+  }
+  if (candidates > 1)
+  {
+    return WDI_AMBIGUOUS;
+  }
+
+  for (int index = 0; index < count; index++)
+  {
+    record[length - 1 - (positions[index] >> 3)] ^= 1 << (positions[index] & 7);
+  }
+
+  // sanity check, put it back if it does not hold
+  if (syndrome(record, length))
+  {
+    for (int index = 0; index < count; index++)
+    {
+      record[length - 1 - (positions[index] >> 3)] ^= 1 << (positions[index] & 7);
+    }
+    return WDI_UNCORRECTABLE;
+  }
+
+  return WDI_CORRECTED;
+}
+
+int WdiCorrector::findBursts(uint64_t syndromeValue, uint32_t totalBits, uint32_t* positions, int& count) const
+{
+  // error trapping: the syndrome of a burst B at position k is B * x^k mod G,
+  // so divide by x until what remains fits into the burst length; one pass over the record
+  const uint64_t limit = 1ULL << m_maxBurst;
+  uint64_t remainder = syndromeValue;
+  int candidates = 0;
+
+  for (uint32_t position = 0; position < totalBits; position++)
+  {
+    // bursts are counted once, by their lowest bit
+    if ((remainder & 1) && (remainder < limit))
+    {
+      const int length = BitLength(remainder);
+      if ((position + length) <= totalBits)
+      {
+        if (!candidates)
+        {
+          count = 0;
+          for (int bit = 0; bit < length; bit++)
+          {
+            if ((remainder >> bit) & 1)
+            {
+              positions[count++] = position + bit;
+            }
+          }
+        }
+
+        if (++candidates > 1)
+        {
+          break;
+        }
+      }
+    }
+
+    remainder = DivideByX(remainder, m_generator);
+  }
+
+  return candidates;
+}
+
+int WdiCorrector::findDoubleBits(uint64_t syndromeValue, uint32_t totalBits, uint32_t* positions) const
+{
+  // two single bit errors anywhere in the record: x^i + x^j mod G
+  const auto found = m_powers.find(totalBits);
+  if (found == m_powers.end())
+  {
+    return 0;
+  }
+
+  const Powers& powers = found->second;
+  int candidates = 0;
+  for (uint32_t first = 0; first < totalBits; first++)
+  {
+    const auto second = powers.Position.find(syndromeValue ^ powers.ByPosition[first]);
+    if ((second == powers.Position.end()) || (second->second <= first))
+    {
+      continue;
+    }
+
+    if (!candidates)
+    {
+      positions[0] = first;
+      positions[1] = second->second;
+    }
+
+    if (++candidates > 1)
+    {
+      break;
+    }
+  }
+
+  return candidates;
+}
+
+int wdiCorrectRecords(int dataVerify, int maxBurst, int doubleBits,
+                      uint8_t* records, const uint32_t* offsets, const uint32_t* dataLengths,
+                      uint32_t count, int jobs, uint8_t* status)
+{
+  WdiCorrector corrector(dataVerify, maxBurst, doubleBits != 0);
+  if (!corrector.isValid() || (count && (!records || !offsets || !dataLengths || !status)))
+  {
+    return -1;
+  }
+
+  // lookups shared read-only by the workers
+  for (uint32_t index = 0; index < count; index++)
+  {
+    corrector.prepare(dataLengths[index]);
+  }
+
+  if (jobs <= 0)
+  {
+    jobs = (int)std::thread::hardware_concurrency();
+  }
+  if (jobs <= 0)
+  {
+    jobs = 1;
+  }
+
+  // each worker takes the next chunk of records until there are none left
+  std::atomic<uint32_t> next(0);
+  auto worker = [&]()
+  {
+    while (true)
+    {
+      const uint32_t first = next.fetch_add(RECORDS_CHUNK);
+      if (first >= count)
+      {
+        break;
+      }
+
+      const uint32_t last = ((count - first) < RECORDS_CHUNK) ? count : (first + RECORDS_CHUNK);
+      for (uint32_t index = first; index < last; index++)
+      {
+        status[index] = (uint8_t)corrector.correct(records + offsets[index], dataLengths[index]);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int job = 1; job < jobs; job++)
+  {
+    threads.emplace_back(worker);
+  }
+  worker();
+
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+
+  return 0;
+}
@@ -0,0 +1,71 @@
+// Winchesterduino (c) 2025 J. Bogin, http://boginjr.com
+// Offline CRC/ECC correction of WDI type 3 sector records, host library
+
+// Build (GCC or Clang, the library is loaded by correct.py if present):
+//   g++ -O2 -std=c++17 -pthread -shared -fPIC -o libwdicorrect.so wdicorrect.cpp
+//   g++ -O2 -std=c++17 -pthread -shared -o wdicorrect.dll wdicorrect.cpp
+//   g++ -O2 -std=c++17 -pthread -o wdicorrect_bench bench.cpp wdicorrect.cpp
+
+#pragma once
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#define WDI_EXPORT extern "C" __declspec(dllexport)
+#else
+#define WDI_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+// result of each record
+#define WDI_VALID         0 // read with an error, but the check bytes agree with the data
+#define WDI_CORRECTED     1
+#define WDI_AMBIGUOUS     2 // more than one error pattern fits
+#define WDI_UNCORRECTABLE 3
+
+class WdiCorrector
+{
+public:
+  // dataVerify: 0 16-bit CRC, 1 32-bit ECC, 2 56-bit ECC; maxBurst: longest burst to correct, 0 for the default
+  WdiCorrector(int dataVerify, int maxBurst = 0, bool doubleBits = true);
+
+  bool isValid() const { return m_width != 0; }
+  int getCheckBytesCount() const { return m_width / 8; }
+  int getMaxBurst() const { return m_maxBurst; }
+  static int getDefaultBurst(int dataVerify);
+
+  // zero if the data and its check bytes agree; record: data followed by the check bytes
+  uint64_t syndrome(const uint8_t* record, uint32_t length) const;
+
+  // build the double bit error lookup for a data length ahead of correct(), which is then safe to call from many threads
+  void prepare(uint32_t dataLength);
+
+  // record corrected in place, returns WDI_VALID to WDI_UNCORRECTABLE
+  int correct(uint8_t* record, uint32_t dataLength) const;
+
+private:
+  int findBursts(uint64_t syndrome, uint32_t totalBits, uint32_t* positions, int& count) const;
+  int findDoubleBits(uint64_t syndrome, uint32_t totalBits, uint32_t* positions) const;
+
+  int m_width;
+  int m_maxBurst;
+  bool m_doubleBits;
+  uint64_t m_generator; // with the x^width term
+
+  // register kept left aligned in 64 bits, 8 tables to process 8 bytes at once (slicing-by-8)
+  uint64_t m_table[8][256];
+
+  // x^i mod G of each bit position from the end of the record, per record length in bits
+  struct Powers
+  {
+    std::vector<uint64_t> ByPosition;
+    std::unordered_map<uint64_t, uint32_t> Position;
+  };
+  std::unordered_map<uint32_t, Powers> m_powers;
+};
+
+// correct count records in place, over jobs threads (0: all processors); record index at records + offsets[index],
+// dataLengths[index] data bytes followed by the check bytes; status: one result per record; 0 on success
+WDI_EXPORT int wdiCorrectRecords(int dataVerify, int maxBurst, int doubleBits,
+                                 uint8_t* records, const uint32_t* offsets, const uint32_t* dataLengths,
+                                 uint32_t count, int jobs, uint8_t* status);
@@ -7,6 +7,7 @@
 #define WD10C20B               0         // set to 1 to disable RLL option and to keep RLL/MFM output floating, if WD10C20B separator is used
                                          // (line RLLMFM treated as OUT to separator chip pin 17, this is GND in a WD10C20B!)
 #define WDC_TIMEOUT_HALT       1         // stop execution if the controller is present (RAM check ok), but WCLOCK is missing
+#define DUAL_DRIVE             0         // set to 1 if a second, daisy-chained drive has its DS1 line wired to D40 (PORTG1), enables the Copy command
 // seeking 
 #define SEEK_PULSE_US          3         // seek pulse length, microseconds
 #define SLOWSEEK_SRT_MS        4         // head step rate time in ms to wait before next step (slow seek mode)
@@ -31,6 +32,7 @@
 // internal includes and used libraries
 #include <Arduino.h>
 #include <avr/sfr_defs.h>
+#include <util/atomic.h>
 #include <string.h>
 #include <EEPROM.h>
 #include "src/XModem/XModem.h"
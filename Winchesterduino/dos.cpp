@@ -7,7 +7,41 @@
 #define FAT_EXECUTE(fn)       if (DOSResult((fn)) != FR_OK) return;
 #define FAT_EXECUTE_0(fn)     if (DOSResult((fn)) != FR_OK) return 0;
 #define FAT_EXECUTE_DIR(fn)   if (DOSResult((fn)) != FR_OK) { f_closedir(&dir); return; }
-#define FAT_EXECUTE_FILE(fn)  if (DOSResult((fn)) != FR_OK) { f_close(&file); return; }
+#define FAT_EXECUTE_FILE(fn)  if (DOSResult((fn)) != FR_OK) { DOSCloseFile(); return; }
+#define FAT_EXECUTE_DIR_0(fn) if (DOSResult((fn)) != FR_OK) { f_closedir(&dir); return 0; }
+
+// temporary file of the defragmenter, in the directory of the file being relocated
+#define DEFRAG_TEMP           "~DEFRAG.TMP"
+#define DEFRAG_OLD            "~DEFRAG.OLD"
+
+// fast seek cluster link map, in DWORD items (2 per file fragment, plus 2)
+#define LINKMAP_INITIAL       32
+#define LINKMAP_MAX           256
+
+// directory tree walk results
+#define WALK_END              0
+#define WALK_FILE             1
+#define WALK_DIR              2
+#define WALK_ERROR            3
+
+// tar export states, and the header staging area in WDC SRAM (beyond any sector data)
+#define TAR_NEXT              0
+#define TAR_HEADER            1
+#define TAR_DATA              2
+#define TAR_ZEROS             3
+#define TAR_DONE              4
+#define TAR_STAGING           1280
+
+// WDC SRAM used for raw sector copies, clear of the ECC correction area
+#define COPY_BUFFER           1536
+
+// consistency checker: FAT sectors window (shared with disk_read) and cluster bitmap tile in WDC SRAM
+#define CHKDSK_FAT            0
+#define CHKDSK_BITMAP         1024
+#define CHKDSK_TILE           ((2032UL - CHKDSK_BITMAP) * 8)
+
+// logical drive 0: partition in the MBR, 0 to find the first one
+PARTITION VolToPart[FF_VOLUMES] = {{0, 0}};
 
 FATFS fat                = {0};
 FIL file                 = {0};
@@ -19,8 +53,99 @@ BYTE addPath[MAX_PATH+1] = {0};
 
 BYTE startingSector      = 0;   // 0: XT, 1: AT - but not always, this is computed
 BYTE sectorsPerTrack     = 0;   // uniform for all
-WORD sectorSizeBytes     = 0;   // ditto + shall be max. 512 bytes
-BYTE fsErrorMessage      = 0;   // Progmem index
+WORD sectorSizeBytes     = 0;   // ditto + 512 or 1024 bytes
+WORD fsErrorMessage      = 0;   // Progmem index
+
+// last position of the sequential sector iterator
+DWORD chsLogical         = (DWORD)-1;
+WORD chsCylinder         = 0;
+BYTE chsHead             = 0;
+BYTE chsSector           = 0;
+DWORD* linkMap           = NULL;
+
+// XMODEM file transfers
+FRESULT xferResult       = FR_OK;
+bool xferDiskFull        = false;
+DWORD xferLastPacket     = 0;
+DWORD xferPendingEOF     = 0;   // trailing EOF padding held back while receiving
+
+// directory tree walk, entry to resume at kept per level instead of an open DIR
+BYTE walkPath[MAX_PATH+1]      = {0};
+WORD walkPosition[MAX_PATH/2]  = {0};
+BYTE walkDepth                 = 0;
+WORD walkSkipped               = 0;   // directories nested too deep
+FRESULT walkResult             = FR_OK;
+
+// consistency checker
+DWORD chkWindow          = (DWORD)-1; // first FAT sector in the window
+DWORD chkTile            = 0;         // first cluster of the bitmap tile
+bool chkFirstPass        = false;
+bool chkDiskError        = false;
+DWORD chkFiles           = 0;
+DWORD chkDirs            = 0;
+DWORD chkCrossLinks      = 0;
+DWORD chkBadChains       = 0;
+DWORD chkMismatches      = 0;
+DWORD chkLostClusters    = 0;
+DWORD chkLostChains      = 0;
+
+// tar export
+BYTE tarState            = TAR_NEXT;
+BYTE tarNextState        = TAR_NEXT;  // after the zeros
+BYTE tarRootLength       = 0;
+WORD tarPosition         = 0;
+DWORD tarRemaining       = 0;
+
+void DOSFreeLinkMap()
+{
+  file.cltbl = NULL;
+  if (linkMap)
+  {
+    delete[] linkMap;
+    linkMap = NULL;
+  }
+}
+
+// build the cluster link map of a file opened for reading,
+// so that reading or seeking far into it does not walk the FAT chain over and over
+void DOSCreateLinkMap()
+{
+  DOSFreeLinkMap();
+  
+  DWORD size = LINKMAP_INITIAL;
+  while (size <= LINKMAP_MAX)
+  {
+    linkMap = new DWORD[size];
+    if (!linkMap)
+    {
+      break;
+    }
+    
+    linkMap[0] = size;
+    file.cltbl = linkMap;
+    const FRESULT result = f_lseek(&file, CREATE_LINKMAP);
+    if (result == FR_OK)
+    {
+      return;
+    }
+    
+    // too fragmented, retry with the required size returned in the first item
+    size = linkMap[0];
+    DOSFreeLinkMap();
+    if (result != FR_NOT_ENOUGH_CORE)
+    {
+      break;
+    }
+  }
+  
+  // not enough memory, keep walking the FAT chain
+}
+
+FRESULT DOSCloseFile()
+{
+  DOSFreeLinkMap();
+  return f_close(&file);
+}
 
 WORD DOSGetSectorSize()
 {
@@ -39,6 +164,73 @@ void DOSConvertLogicalSectorToCHS(const DWORD& logical, WORD& cylinder, BYTE& he
   sector = (logical % sectorsPerTrack) + startingSector;
 }
 
+// sequential access, e.g. multi-sector requests: step to the next sector without the divisions.
+// Returns true if the head has to move to another track since the previous call
+bool DOSNextLogicalSectorToCHS(const DWORD& logical, WORD& cylinder, BYTE& head, BYTE& sector)
+{
+  const bool valid = chsLogical != (DWORD)-1;
+  const WORD previousCylinder = chsCylinder;
+  const BYTE previousHead = chsHead;
+  
+  if (valid && (logical == chsLogical + 1))
+  {
+    if (++chsSector == (startingSector + sectorsPerTrack))
+    {
+      chsSector = startingSector;
+      if (++chsHead == wdc->getParams()->Heads)
+      {
+        chsHead = 0;
+        chsCylinder++;
+      }
+    }
+  }
+  else if (!valid || (logical != chsLogical))
+  {
+    DOSConvertLogicalSectorToCHS(logical, chsCylinder, chsHead, chsSector);
+  }
+  
+  chsLogical = logical;
+  cylinder = chsCylinder;
+  head = chsHead;
+  sector = chsSector;
+  
+  return !valid || (chsCylinder != previousCylinder) || (chsHead != previousHead);
+}
+
+// position the heads onto a logical sector, seeking only when on another track; returns its sector number
+BYTE DOSSeekLogicalSector(const DWORD& logical)
+{
+  WORD cylinder;
+  BYTE head;
+  BYTE sector;
+  
+  if (DOSNextLogicalSectorToCHS(logical, cylinder, head, sector))
+  {
+    wdc->seekDrive(cylinder, head);
+  }
+  else
+  {
+    wdc->selectDrive();
+  }
+  
+  return sector;
+}
+
+// known defective sector, to be failed without retrying on the media
+bool DOSIsKnownDefect(const DWORD& logical)
+{
+  if (!eepromDefectCount())
+  {
+    return false;
+  }
+  
+  WORD cylinder;
+  BYTE head;
+  BYTE sector;
+  DOSConvertLogicalSectorToCHS(logical, cylinder, head, sector);
+  return eepromIsDefect(cylinder, head, sector);
+}
+
 FRESULT DOSResult(FRESULT result)
 { 
   switch (result)
@@ -95,211 +287,1497 @@ FRESULT DOSResult(FRESULT result)
     ui->print(Progmem::getString(Progmem::uiNewLine));
   }
   
-  return result;
+  return result;
+}
+
+// list the partitions in the MBR and let choose if more of them; 0 if none (FatFs then looks itself)
+BYTE DOSSelectPartition()
+{
+  wdc->readSector(DOSSeekLogicalSector(0), sectorSizeBytes);
+  if (wdc->getLastError() && (wdc->getLastError() != WDC_CORRECTED))
+  {
+    return 0;
+  }
+  
+  // not a MBR but a FAT boot sector of an unpartitioned disk
+  BYTE data[66];
+  wdc->sramReadBuffer(data, 0, 14);
+  if (((data[0] == 0xEB) && (data[2] == 0x90)) || (data[0] == 0xE9))
+  {
+    // jump to the boot code over a BPB (DOS 2.0+, also without the extended BPB)
+    const WORD bytesPerSector = *((WORD*)&data[11]);
+    const BYTE sectorsPerCluster = data[13];
+    if ((bytesPerSector == sectorSizeBytes) && sectorsPerCluster && !(sectorsPerCluster & (sectorsPerCluster - 1)))
+    {
+      return 0;
+    }
+  }
+  wdc->sramReadBuffer(data, 54, 5);
+  if (memcmp_P(data, PSTR("FAT"), 3) == 0)
+  {
+    return 0;
+  }
+  wdc->sramReadBuffer(data, 82, 5);
+  if (memcmp_P(data, PSTR("FAT32"), 5) == 0)
+  {
+    return 0;
+  }
+  
+  // 4 entries of 16 bytes, and the signature
+  wdc->sramReadBuffer(data, 446, 66);
+  if ((data[64] != 0x55) || (data[65] != 0xAA))
+  {
+    return 0;
+  }
+  
+  BYTE allowedKeys[4 + 1] = {0};
+  BYTE count = 0;
+  for (BYTE index = 0; index < 4; index++)
+  {
+    const BYTE* entry = &data[index * 16];
+    const DWORD start = *((DWORD*)&entry[8]);
+    const DWORD size = *((DWORD*)&entry[12]);
+    if (!size || ((start + size) > DOSGetTotalSectorCount()))
+    {
+      continue;
+    }
+    
+    // FAT12, FAT16 <32M, FAT16, FAT32 CHS, FAT32 LBA, FAT16 LBA; extended partitions not followed
+    switch (entry[4])
+    {
+    case 0x01:
+    case 0x04:
+    case 0x06:
+    case 0x0B:
+    case 0x0C:
+    case 0x0E:
+      break;
+    default:
+      continue;
+    }
+    
+    ui->print(Progmem::getString(Progmem::dosPartition), index + 1, entry[4], (WORD)((size * sectorSizeBytes) / 1048576UL));
+    allowedKeys[count++] = '1' + index;
+  }
+  
+  if (count < 2)
+  {
+    return count ? (allowedKeys[0] - '0') : 0;
+  }
+  
+  ui->print(Progmem::getString(Progmem::dosSelectPartition));
+  const BYTE key = ui->readKey(allowedKeys);
+  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  return key - '0';
+}
+
+bool DOSInitialize()
+{
+  // look at track 0
+  WORD dummy;
+  BYTE dummy2;
+  BYTE sdh;
+  
+  wdc->seekDrive(0, 0);
+  wdc->scanID(dummy, dummy2, sdh);
+  if (wdc->getLastError())
+  {
+    ui->print(Progmem::getString(Progmem::analyzeNoSectors));
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return false;
+  }
+  
+  sectorSizeBytes = wdc->getSectorSizeFromSDH(sdh);  
+  if ((sectorSizeBytes != 512) && (sectorSizeBytes != 1024))
+  {
+    ui->print(Progmem::getString(Progmem::dosInvalidSsize), sectorSizeBytes);
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return false;
+  }
+  
+  bool weirdGeometry = false; // :-)
+  DWORD* result = CalculateSectorsPerTrack(sdh, sectorsPerTrack, dummy,
+                                           weirdGeometry, weirdGeometry, weirdGeometry);
+  if (!result || !sectorsPerTrack || weirdGeometry)
+  {
+    if (result)
+    {
+      // sectors table
+      delete[] result;
+    }
+    
+    ui->print(Progmem::getString(Progmem::analyzeNoSectors));
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return false;
+  }  
+  
+  // determine starting sector, find the lowest (some XT disks start from 0)
+  startingSector = (BYTE)-1;
+  for (WORD idx = 0; idx < dummy /* tableCount */; idx++)
+  {
+    const DWORD& sectorData = result[idx];
+    if (sectorData == 0xFFFFFFFFUL) // undefined
+    {
+      continue;
+    }
+    
+    const BYTE sector = (BYTE)(sectorData >> 16);
+    if (sector < startingSector)
+    {
+      startingSector = sector;
+    }
+  }
+  delete[] result;
+  
+  // geometry known, head position not
+  chsLogical = (DWORD)-1;
+  
+  // set root directory and mount the selected partition
+  memset(path, 0, sizeof(path));
+  VolToPart[0].pt = DOSSelectPartition();
+  if (VolToPart[0].pt && (f_mount(&fat, "0:", 1) == FR_OK))
+  {
+    return true;
+  }
+  
+  // no usable partition entry, let FatFs find the volume itself
+  VolToPart[0].pt = 0;
+  FAT_EXECUTE_0(f_mount(&fat, "0:", 1));
+
+  return true;
+}
+
+void DOSFinish()
+{
+  // unmount
+  f_closedir(&dir);
+  f_unmount("0:");
+}
+
+void DOSMkdir(const BYTE* dirName)
+{ 
+  // overflow checks in CD command, as absolute paths in names are not allowed  
+  memset(addPath, 0, sizeof(addPath));
+  strcat(addPath, path);
+  strcat(addPath, dirName);
+  
+  FAT_EXECUTE(f_mkdir(addPath));
+}
+
+// remove empty directory
+void DOSRmdir(const BYTE* dirName)
+{  
+  memset(addPath, 0, sizeof(addPath));
+  strcat(addPath, path);
+  strcat(addPath, dirName);
+  
+  FAT_EXECUTE(f_rmdir(addPath));
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+}
+
+void DOSDel(const BYTE* fileName)
+{ 
+  memset(addPath, 0, sizeof(addPath));
+  strcat(addPath, path);
+  strcat(addPath, fileName);
+  
+  FAT_EXECUTE(f_unlink(addPath));
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+}
+
+void DOSHexdump(const BYTE* fileName)
+{
+  memset(addPath, 0, sizeof(addPath));
+  strcat(addPath, path);
+  strcat(addPath, fileName);
+  
+  WORD count = 1;
+  FAT_EXECUTE(f_open(&file, addPath, FA_READ));
+  DOSCreateLinkMap();
+  
+  BYTE* chunk = new BYTE[512];
+  if (!chunk)
+  {
+    ui->fatalError(Progmem::uiFeMemory);
+  }
+  
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  ui->print(Progmem::getString(Progmem::hexdumpDump));
+  
+  while (count)
+  {
+    if (DOSResult(f_read(&file, chunk, 512, &count)) != FR_OK)
+    {
+      delete[] chunk;
+      DOSCloseFile();
+      return;
+    }
+    
+    for (WORD idx = 0; idx < count; idx++)
+    {
+      ui->print("%02X ", chunk[idx]);
+    }
+  }
+  
+  delete[] chunk;  
+  FAT_EXECUTE(DOSCloseFile());
+  ui->print(Progmem::getString(Progmem::uiNewLine2x));
+}
+
+void DOSType(const BYTE* fileName)
+{  
+  memset(addPath, 0, sizeof(addPath));
+  strcat(addPath, path);
+  strcat(addPath, fileName);
+  
+  WORD count = 1;
+  FAT_EXECUTE(f_open(&file, addPath, FA_READ));
+  DOSCreateLinkMap();
+  
+  while (count)
+  {
+    // to ui buffer, 0s skipped
+    FAT_EXECUTE_FILE(f_read(&file, ui->getPrintBuffer(), MAX_CHARS, &count));
+    if (count)
+    {
+      ui->setPrintLength(count);
+      ui->print(ui->getPrintBuffer());  
+    }    
+  }
+  
+  FAT_EXECUTE(DOSCloseFile());
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+}
+
+void DOSTypeInto(const BYTE* fileName)
+{ 
+  memset(addPath, 0, sizeof(addPath));
+  strcat(addPath, path);
+  strcat(addPath, fileName);
+  
+  FAT_EXECUTE(f_open(&file, addPath, FA_WRITE | FA_OPEN_APPEND));
+  
+  // wait for ENTER keypress
+  ui->print(Progmem::getString(Progmem::dosTypeInto));
+  ui->print(Progmem::getString(Progmem::uiContinue));
+  ui->readKey("\r");
+  ui->print("");
+  
+  bool emptyLine = false;  
+  for (;;)
+  {
+    // all valid keys allowed
+    const BYTE* promptBuffer = ui->prompt();
+    WORD length = strlen(promptBuffer);
+    
+    // quit?
+    if (!length && emptyLine)
+    {
+      break;
+    }    
+    emptyLine = length == 0;
+    
+    // write line   
+    WORD dummy;
+    FAT_EXECUTE_FILE(f_write(&file, promptBuffer, length, &dummy));
+    FAT_EXECUTE_FILE(f_write(&file, Progmem::getString(Progmem::uiNewLine), 2, &dummy));
+
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }
+  
+  FAT_EXECUTE(DOSCloseFile());
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+}
+
+// ask to use 1K packets, false if cancelled
+bool DOSAskXmodem1K(bool& useXMODEM1K)
+{
+  useXMODEM1K = false;
+  BYTE* testAlloc = new BYTE[1030];
+  if (testAlloc)
+  {
+    delete[] testAlloc;
+    ui->print(Progmem::getString(Progmem::imgXmodem1k));
+    const BYTE key = toupper(ui->readKey("YN\e"));
+    if (key == '\e')
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine2x));
+      return false;
+    }
+    ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+    useXMODEM1K = (key == 'Y');
+  }
+  
+  ui->print(Progmem::getString(useXMODEM1K ? Progmem::imgXmodem1kPrefix : Progmem::imgXmodemPrefix));
+  return true;
+}
+
+// file to host: f_read straight into the XMODEM packet
+bool DOSGetCallback(DWORD packetNo, BYTE* data, WORD size)
+{
+  // packet resent after a NACK, still in the buffer
+  if (packetNo == xferLastPacket)
+  {
+    return true;
+  }
+  xferLastPacket = packetNo;
+  
+  WORD count = 0;
+  xferResult = f_read(&file, data, size, &count);
+  if ((xferResult != FR_OK) || !count)
+  {
+    return false;
+  }
+  
+  // pad the last packet with ASCII EOF
+  if (count < size)
+  {
+    memset(&data[count], 0x1A, size - count);
+  }
+  
+  return true;
+}
+
+// write out ASCII EOF bytes held back from the previous packets, as there's more data
+bool DOSPutPendingEOF()
+{
+  BYTE padding[16];
+  memset(padding, 0x1A, sizeof(padding));
+  
+  while (xferPendingEOF)
+  {
+    const WORD length = (xferPendingEOF > sizeof(padding)) ? sizeof(padding) : (WORD)xferPendingEOF;
+    
+    WORD written = 0;
+    xferResult = f_write(&file, padding, length, &written);
+    if (xferResult != FR_OK)
+    {
+      return false;
+    }    
+    if (written != length)
+    {
+      xferDiskFull = true;
+      return false;
+    }
+    
+    xferPendingEOF -= length;
+  }
+  
+  return true;
+}
+
+// host to file: XMODEM packet straight into f_write
+bool DOSPutCallback(DWORD packetNo, BYTE* data, WORD size)
+{
+  // XMODEM pads the last packet with ASCII EOF: hold these back until it's known more data follows
+  WORD length = size;
+  while (length && (data[length-1] == 0x1A))
+  {
+    length--;
+  }
+  
+  if (!length)
+  {
+    xferPendingEOF += size;
+    return true;
+  }
+  
+  if (!DOSPutPendingEOF())
+  {
+    return false;
+  }
+  
+  WORD written = 0;
+  xferResult = f_write(&file, data, length, &written);
+  if (xferResult != FR_OK)
+  {
+    return false;
+  }  
+  if (written != length)
+  {
+    xferDiskFull = true;
+    return false;
+  }
+  
+  xferPendingEOF = size - length;
+  return true;
+}
+
+// send file to host
+void DOSGet(const BYTE* fileName)
+{
+  memset(addPath, 0, sizeof(addPath));
+  strcat(addPath, path);
+  strcat(addPath, fileName);
+  
+  FAT_EXECUTE(f_open(&file, addPath, FA_READ));
+  DOSCreateLinkMap();
+  
+  bool useXMODEM1K;
+  if (!DOSAskXmodem1K(useXMODEM1K))
+  {
+    DOSCloseFile();
+    return;
+  }
+  
+  ui->print(Progmem::getString(Progmem::imgXmodemWaitRecv));
+  ui->setPrintDisabled(true);
+  
+  xferResult = FR_OK;
+  xferLastPacket = 0;
+  SetSerialTransfer(true);
+  
+  XModem modem(RX, TX, &DOSGetCallback, useXMODEM1K);
+  const bool success = modem.transmit() && (xferResult == FR_OK);
+  
+  SetSerialTransfer(false);
+  DumpSerialTransfer();
+  wdc->selectDrive(false);
+  
+  ui->setPrintDisabled(false);
+  ui->print("");
+  ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  ui->print(Progmem::getString(success ? Progmem::imgXmodemXferEnd : Progmem::imgXmodemXferFail));
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  
+  DOSResult(xferResult);
+  FAT_EXECUTE(DOSCloseFile());
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+}
+
+// receive file from host, does not overwrite
+void DOSPut(const BYTE* fileName)
+{
+  memset(addPath, 0, sizeof(addPath));
+  strcat(addPath, path);
+  strcat(addPath, fileName);
+  
+  FAT_EXECUTE(f_open(&file, addPath, FA_WRITE | FA_CREATE_NEW));
+  
+  bool useXMODEM1K;
+  if (!DOSAskXmodem1K(useXMODEM1K))
+  {
+    DOSCloseFile();
+    f_unlink(addPath);
+    return;
+  }
+  
+  ui->print(Progmem::getString(Progmem::imgXmodemWaitSend));
+  ui->setPrintDisabled(true);
+  
+  xferResult = FR_OK;
+  xferDiskFull = false;
+  xferPendingEOF = 0;
+  SetSerialTransfer(true);
+  
+  XModem modem(RX, TX, &DOSPutCallback, useXMODEM1K);
+  const bool success = modem.receive() && (xferResult == FR_OK) && !xferDiskFull;
+  
+  SetSerialTransfer(false);
+  DumpSerialTransfer();
+  wdc->selectDrive(false);
+  
+  ui->setPrintDisabled(false);
+  ui->print("");
+  ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  ui->print(Progmem::getString(success ? Progmem::imgXmodemXferEnd : Progmem::imgXmodemXferFail));
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  
+  if (xferDiskFull)
+  {
+    ui->print(Progmem::getString(Progmem::dosDiskFull));
+  }
+  DOSResult(xferResult);
+  
+  // do not leave incomplete files behind
+  const FRESULT closeResult = DOSCloseFile();
+  if (!success)
+  {
+    f_unlink(addPath);
+  }
+  
+  DOSResult(closeResult);
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+}
+
+// start walking the directory tree at the given path
+bool DOSWalkBegin(const BYTE* startPath)
+{
+  strcpy(walkPath, startPath);
+  walkDepth = 0;
+  walkSkipped = 0;
+  walkResult = f_opendir(&dir, walkPath);
+  
+  return walkResult == FR_OK;
+}
+
+// next file or directory in the tree; directories are entered right after being returned
+BYTE DOSWalkNext(FILINFO& info)
+{
+  for (;;)
+  {
+    walkResult = f_readdir(&dir, &info);
+    if (walkResult != FR_OK)
+    {
+      return WALK_ERROR;
+    }
+    
+    // end of directory, go back one level up
+    while (!info.fname[0])
+    {
+      f_closedir(&dir);
+      if (!walkDepth)
+      {
+        return WALK_END;
+      }
+      
+      walkPath[strlen(walkPath)-1] = 0;         
+      BYTE* prevBackslash = strrchr(walkPath, '\\');
+      if (!prevBackslash)
+      {
+        walkPath[0] = 0;
+      }
+      else
+      {
+        *(prevBackslash+1) = 0;
+      }
+      walkDepth--;
+      
+      walkResult = f_opendir(&dir, walkPath);
+      if (walkResult != FR_OK)
+      {
+        return WALK_ERROR;
+      }
+      
+      // the subdirectory was the last entry
+      if (walkPosition[walkDepth] == 0xFFFF)
+      {
+        continue;
+      }
+      
+      // skip to where we were, by the directory offset (32 bytes per entry)
+      // so that files deleted or created in the meantime do not shift it
+      do
+      {
+        walkResult = f_readdir(&dir, &info);
+        if (walkResult != FR_OK)
+        {
+          return WALK_ERROR;
+        }
+      }
+      while (info.fname[0] && ((dir.dptr / 32) < walkPosition[walkDepth]));
+      
+      // with the entry to resume at now read
+      if (info.fname[0])
+      {
+        walkResult = f_readdir(&dir, &info);
+        if (walkResult != FR_OK)
+        {
+          return WALK_ERROR;
+        }
+      }
+    }
+    
+    if (!(info.fattrib & AM_DIR))
+    {
+      return WALK_FILE;
+    }
+    
+    // too deep for our path buffers (subdirectory, backslash, 8.3 filename with dot)
+    if (((strlen(walkPath) + strlen(info.fname) + 1 + 12) > MAX_PATH) ||
+        (walkDepth >= (sizeof(walkPosition) / sizeof(WORD))))
+    {
+      walkSkipped++;
+      continue;
+    }
+    
+    // enter the subdirectory
+    walkPosition[walkDepth++] = dir.sect ? (WORD)(dir.dptr / 32) : 0xFFFF;
+    f_closedir(&dir);
+    strcat(walkPath, info.fname);
+    strcat(walkPath, "\\");
+    
+    walkResult = f_opendir(&dir, walkPath);
+    return (walkResult == FR_OK) ? WALK_DIR : WALK_ERROR;
+  }
+}
+
+// full path of a file returned by the walk, into addPath
+void DOSWalkFilePath(const FILINFO& info)
+{
+  memset(addPath, 0, sizeof(addPath));
+  strcat(addPath, walkPath);
+  strcat(addPath, info.fname);
+}
+
+// FAT timestamp to UNIX time, 1980 to 2099
+DWORD DOSUnixTime(WORD fdate, WORD ftime)
+{
+  static const WORD daysBeforeMonth[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+  
+  const WORD year = 1980 + (fdate >> 9);
+  BYTE month = (fdate >> 5) & 0x0F;
+  BYTE day = fdate & 0x1F;
+  if (!month || (month > 12))
+  {
+    month = 1;
+  }
+  if (!day)
+  {
+    day = 1;
+  }
+  
+  // days since 1970, with the leap days before this year and in this year
+  DWORD days = (year - 1970) * 365UL + (year - 1969) / 4 + daysBeforeMonth[month-1] + (day - 1);
+  if ((month > 2) && !(year % 4))
+  {
+    days++;
+  }
+  
+  return (days * 86400UL) + ((ftime >> 11) * 3600UL) + (((ftime >> 5) & 0x3F) * 60UL) + ((ftime & 0x1F) * 2UL);
+}
+
+// write a string field of the tar header, NUL padded
+void DOSTarString(const BYTE* value, BYTE length, WORD& checksum)
+{
+  for (BYTE index = 0; index < length; index++)
+  {
+    BYTE character = 0;
+    if (*value)
+    {
+      character = *value++;
+      if (character == '\\')
+      {
+        character = '/';
+      }
+    }
+    
+    wdc->sramWriteByteSequential(character);
+    checksum += character;
+  }
+}
+
+// ditto, octal number with a terminating NUL
+void DOSTarOctal(DWORD value, BYTE length, WORD& checksum)
+{
+  BYTE number[12 + 1];
+  snprintf_P(number, sizeof(number), PSTR("%0*lo"), length-1, value);
+  DOSTarString(number, length, checksum);
+}
+
+// ustar header of the current walk entry, into the WDC SRAM staging area
+void DOSTarHeader(const FILINFO& info, bool isDirectory)
+{ 
+  // name relative to the starting path, directories end with a slash
+  const BYTE* relativePath = &walkPath[tarRootLength];
+  const BYTE relativeLength = strlen(relativePath);
+  
+  WORD checksum = 0;  
+  wdc->sramBeginBufferAccess(true, TAR_STAGING);
+  DOSTarString(relativePath, relativeLength, checksum);
+  DOSTarString(isDirectory ? (const BYTE*)"" : info.fname, 100 - relativeLength, checksum);
+  
+  DOSTarOctal(isDirectory ? 0755 : ((info.fattrib & AM_RDO) ? 0444 : 0644), 8, checksum); // mode
+  DOSTarOctal(0, 8, checksum);                                                             // uid
+  DOSTarOctal(0, 8, checksum);                                                             // gid
+  DOSTarOctal(isDirectory ? 0 : info.fsize, 12, checksum);                                 // size
+  DOSTarOctal(DOSUnixTime(info.fdate, info.ftime), 12, checksum);                          // mtime
+  DOSTarString((const BYTE*)"        ", 8, checksum);                                      // checksum, spaces for now
+  DOSTarString(isDirectory ? (const BYTE*)"5" : (const BYTE*)"0", 1, checksum);            // type
+  DOSTarString((const BYTE*)"", 100, checksum);                                            // link name
+  DOSTarString((const BYTE*)"ustar", 6, checksum);                                         // magic
+  DOSTarString((const BYTE*)"00", 2, checksum);                                            // version
+  DOSTarString((const BYTE*)"", 32 + 32 + 8 + 8 + 155 + 12, checksum);                     // user, group, devices, prefix, padding
+  
+  // the checksum in place
+  BYTE number[8 + 1];
+  snprintf_P(number, sizeof(number), PSTR("%06o"), checksum);
+  wdc->sramBeginBufferAccess(true, TAR_STAGING + 148);
+  for (BYTE index = 0; index < 7; index++)
+  {
+    wdc->sramWriteByteSequential(number[index]);
+  }
+  wdc->sramWriteByteSequential(' ');
+  wdc->sramFinishBufferAccess();
+}
+
+// tar stream to host, headers staged in WDC SRAM and file data read straight into the packet
+bool DOSTarCallback(DWORD packetNo, BYTE* data, WORD size)
+{
+  // packet resent after a NACK, still in the buffer
+  if (packetNo == xferLastPacket)
+  {
+    return true;
+  }
+  xferLastPacket = packetNo;
+  
+  WORD packetIdx = 0;
+  while (packetIdx < size)
+  {
+    switch (tarState)
+    {
+    case TAR_NEXT:
+    {
+      FILINFO info = {0};
+      const BYTE entry = DOSWalkNext(info);
+      
+      if (entry == WALK_ERROR)
+      {
+        xferResult = walkResult;
+        return false;
+      }
+      
+      // end of archive, 2 empty blocks
+      if (entry == WALK_END)
+      {
+        tarPosition = 1024;
+        tarState = TAR_ZEROS;
+        tarNextState = TAR_DONE;
+        break;
+      }
+      
+      tarRemaining = 0;
+      if (entry == WALK_FILE)
+      {
+        DOSWalkFilePath(info);
+        xferResult = f_open(&file, addPath, FA_READ);
+        if (xferResult != FR_OK)
+        {
+          return false;
+        }
+        
+        DOSCreateLinkMap();
+        tarRemaining = info.fsize;
+      }
+      
+      DOSTarHeader(info, entry == WALK_DIR);
+      tarPosition = 0;
+      tarState = TAR_HEADER;
+      break;
+    }
+    
+    case TAR_HEADER:
+    {
+      WORD count = 512 - tarPosition;
+      if (count > (size - packetIdx))
+      {
+        count = size - packetIdx;
+      }
+      
+      wdc->sramReadBuffer(&data[packetIdx], TAR_STAGING + tarPosition, count);
+      packetIdx += count;
+      tarPosition += count;
+      
+      if (tarPosition == 512)
+      {
+        tarState = tarRemaining ? TAR_DATA : TAR_NEXT;
+        if (!tarRemaining)
+        {
+          DOSCloseFile();
+        }
+      }
+      break;
+    }
+    
+    case TAR_DATA:
+    {
+      WORD count = size - packetIdx;
+      if (count > tarRemaining)
+      {
+        count = (WORD)tarRemaining;
+      }
+      
+      WORD read = 0;
+      xferResult = f_read(&file, &data[packetIdx], count, &read);
+      if ((xferResult == FR_OK) && (read != count))
+      {
+        xferResult = FR_INT_ERR; // file shorter than its directory entry says
+      }
+      if (xferResult != FR_OK)
+      {
+        return false;
+      }
+      
+      packetIdx += count;
+      tarRemaining -= count;
+      
+      // file data padded to 512-byte blocks
+      if (!tarRemaining)
+      {
+        tarPosition = (512 - (WORD)(file.fptr % 512)) % 512;
+        tarState = TAR_ZEROS;
+        tarNextState = TAR_NEXT;
+        DOSCloseFile();
+      }
+      break;
+    }
+    
+    case TAR_ZEROS:
+    {
+      WORD count = size - packetIdx;
+      if (count > tarPosition)
+      {
+        count = tarPosition;
+      }
+      
+      memset(&data[packetIdx], 0, count);
+      packetIdx += count;
+      tarPosition -= count;
+      
+      if (!tarPosition)
+      {
+        tarState = tarNextState;
+      }
+      break;
+    }
+    
+    default:
+      // finished, rest of the last packet zeroed
+      if (!packetIdx)
+      {
+        return false;
+      }
+      
+      memset(&data[packetIdx], 0, size - packetIdx);
+      packetIdx = size;
+      break;
+    }
+  }
+  
+  return true;
+}
+
+// send the current directory tree to host as a tar archive
+void DOSTar()
+{
+  if (DOSResult(DOSWalkBegin(path) ? FR_OK : walkResult) != FR_OK)
+  {
+    return;
+  }
+  
+  bool useXMODEM1K;
+  if (!DOSAskXmodem1K(useXMODEM1K))
+  {
+    f_closedir(&dir);
+    return;
+  }
+  
+  ui->print(Progmem::getString(Progmem::imgXmodemWaitRecv));
+  ui->setPrintDisabled(true);
+  
+  xferResult = FR_OK;
+  xferLastPacket = 0;
+  tarState = TAR_NEXT;
+  tarRootLength = strlen(path);
+  SetSerialTransfer(true);
+  
+  XModem modem(RX, TX, &DOSTarCallback, useXMODEM1K);
+  const bool success = modem.transmit() && (xferResult == FR_OK) && (tarState == TAR_DONE);
+  
+  SetSerialTransfer(false);
+  DumpSerialTransfer();
+  wdc->selectDrive(false);
+  f_closedir(&dir);
+  DOSCloseFile();
+  
+  ui->setPrintDisabled(false);
+  ui->print("");
+  ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  ui->print(Progmem::getString(success ? Progmem::imgXmodemXferEnd : Progmem::imgXmodemXferFail));
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  
+  if (walkSkipped)
+  {
+    ui->print(Progmem::getString(Progmem::dosSkippedDirs), walkSkipped);
+  }
+  
+  DOSResult(xferResult);
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+}
+
+// number of fragments of the file open for reading
+DWORD DOSCountFragments()
+{
+  // link map with no room, FatFs still returns the required number of items
+  DWORD table[2] = {2, 0};
+  file.cltbl = table;
+  const FRESULT result = f_lseek(&file, CREATE_LINKMAP);
+  file.cltbl = NULL;
+  
+  if ((result != FR_OK) && (result != FR_NOT_ENOUGH_CORE))
+  {
+    return 0;
+  }
+  return (table[0] - 2) / 2;
+}
+
+// raw sector copy through the WDC buffer SRAM, no data passes the MCU;
+// in batches, so that the heads do not move back and forth for every sector
+bool DOSCopySectors(DWORD from, DWORD to, DWORD count)
+{
+  const BYTE batch = COPY_BUFFER / sectorSizeBytes;
+  while (count)
+  {
+    const BYTE sectors = (count > batch) ? batch : (BYTE)count;
+    
+    for (BYTE index = 0; index < sectors; index++)
+    {
+      wdc->readSector(DOSSeekLogicalSector(from + index), sectorSizeBytes, false, NULL, NULL, index * sectorSizeBytes);
+      if (wdc->getLastError() && (wdc->getLastError() != WDC_CORRECTED))
+      {
+        return false;
+      }
+    }
+    
+    for (BYTE index = 0; index < sectors; index++)
+    {
+      wdc->writeSector(DOSSeekLogicalSector(to + index), sectorSizeBytes, NULL, NULL, index * sectorSizeBytes);
+      if (wdc->getLastError())
+      {
+        return false;
+      }
+    }
+    
+    from += sectors;
+    to += sectors;
+    count -= sectors;
+  }
+  
+  return true;
+}
+
+// count fragmented files on the whole volume
+bool DOSFragmentationReport()
+{
+  DWORD files = 0;
+  DWORD fragmented = 0;
+  DWORD fragments = 0;
+  
+  if (DOSResult(DOSWalkBegin((const BYTE*)"") ? FR_OK : walkResult) != FR_OK)
+  {
+    return false;
+  }
+  
+  for (;;)
+  {
+    FILINFO info = {0};
+    const BYTE entry = DOSWalkNext(info);
+    if (entry == WALK_ERROR)
+    {
+      DOSResult(walkResult);
+      return false;
+    }
+    if (entry == WALK_END)
+    {
+      break;
+    }
+    if (entry != WALK_FILE)
+    {
+      continue;
+    }
+    
+    DOSWalkFilePath(info);
+    FAT_EXECUTE_DIR_0(f_open(&file, addPath, FA_READ));
+    const DWORD count = DOSCountFragments();
+    DOSCloseFile();
+    
+    files++;
+    fragments += count;
+    if (count > 1)
+    {
+      fragmented++;
+    }
+  }
+  
+  ui->print(Progmem::getString(Progmem::dosFragReport), fragmented, files, fragments);
+  return true;
+}
+
+// move a fragmented file into one contiguous block: false on errors
+bool DOSDefragFile(const FILINFO& info, DWORD& relocated, DWORD& skipped)
+{
+  DOSWalkFilePath(info);
+  FRESULT result = f_open(&file, addPath, FA_READ);
+  if (result != FR_OK)
+  {
+    DOSResult(result);
+    return false;
+  }
+  
+  // contiguous already
+  if (DOSCountFragments() < 2)
+  {
+    DOSCloseFile();
+    return true;
+  }
+  
+  // need the whole cluster chain
+  DOSCreateLinkMap();
+  if (!linkMap)
+  {
+    DOSCloseFile();
+    skipped++;
+    return true;
+  }
+  
+  // the chain has to hold exactly the clusters of the file size (CHKDSK reports otherwise), 
+  // as the copy below only has room for these
+  const DWORD clusterBytes = (DWORD)fat.csize * sectorSizeBytes;
+  const DWORD clusters = (info.fsize + clusterBytes - 1) / clusterBytes;
+  DWORD chainClusters = 0;
+  for (const DWORD* fragment = &linkMap[1]; fragment[0]; fragment += 2)
+  {
+    chainClusters += fragment[0];
+  }
+  if (chainClusters != clusters)
+  {
+    DOSCloseFile();
+    skipped++;
+    return true;
+  }
+  
+  // allocate a contiguous copy alongside, and have its directory entry and FAT chain on disk before copying
+  // leftovers of an interrupted run may hold the only copy of a file: never overwritten, stop instead
+  BYTE tempPath[MAX_PATH+1];
+  BYTE oldPath[MAX_PATH+1];
+  strcpy(tempPath, walkPath);
+  strcat_P(tempPath, PSTR(DEFRAG_TEMP));
+  strcpy(oldPath, walkPath);
+  strcat_P(oldPath, PSTR(DEFRAG_OLD));
+  
+  FILINFO leftover;
+  const BYTE* leftoverPath = (f_stat(tempPath, &leftover) == FR_OK) ? tempPath : (f_stat(oldPath, &leftover) == FR_OK) ? oldPath : NULL;
+  if (leftoverPath)
+  {
+    DOSCloseFile();
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+    ui->print(Progmem::getString(Progmem::dosDefragLeftover), leftoverPath);
+    return false;
+  }
+  
+  FIL temp = {0};
+  result = f_open(&temp, tempPath, FA_WRITE | FA_CREATE_NEW);
+  if (result == FR_OK)
+  {
+    result = f_expand(&temp, info.fsize, 1);
+    
+    // no contiguous free space large enough
+    if (result == FR_DENIED)
+    {
+      f_close(&temp);
+      f_unlink(tempPath);
+      DOSCloseFile();
+      skipped++;
+      return true;
+    }
+  }
+  if (result == FR_OK)
+  {
+    result = f_sync(&temp);
+  }
+  
+  // copy the data, fragment by fragment, no further than the clusters reserved
+  if (result == FR_OK)
+  {
+    DWORD to = fat.database + (temp.obj.sclust - 2) * fat.csize;
+    DWORD remaining = clusters;
+    for (const DWORD* fragment = &linkMap[1]; fragment[0] && remaining; fragment += 2)
+    {
+      const DWORD runClusters = (fragment[0] > remaining) ? remaining : fragment[0];
+      remaining -= runClusters;
+      
+      const DWORD count = runClusters * fat.csize;
+      if (!DOSCopySectors(fat.database + (fragment[1] - 2) * fat.csize, to, count))
+      {
+        result = FR_DISK_ERR;
+        break;
+      }
+      to += count;
+    }
+    
+    // the FatFs window (synced above) may hold an old copy of a sector written around it
+    fat.winsect = (LBA_t)-1;
+  }
+  
+  const FRESULT closeResult = f_close(&temp);
+  if (result == FR_OK)
+  {
+    result = closeResult;
+  }
+  DOSCloseFile();
+  
+  if (result != FR_OK)
+  {
+    f_unlink(tempPath);
+    DOSResult(result);
+    return false;
+  }
+  
+  // only now replace the original: set it aside, put the copy in its place, then free the old chain
+  // an interruption anywhere leaves the data under one of the three names
+  result = f_chmod(addPath, 0, AM_RDO);
+  if (result == FR_OK)
+  {
+    result = f_rename(addPath, oldPath);
+  }
+  if (result == FR_OK)
+  {
+    result = f_rename(tempPath, addPath);
+  }
+  if (result == FR_OK)
+  {
+    result = f_unlink(oldPath);
+  }
+  
+  // and restore its attributes and timestamp
+  if (result == FR_OK)
+  {
+    result = f_chmod(addPath, info.fattrib, AM_RDO | AM_ARC | AM_HID | AM_SYS);
+  }
+  if (result == FR_OK)
+  {
+    result = f_utime(addPath, &info);
+  }
+  if (result != FR_OK)
+  {
+    DOSResult(result);
+    return false;
+  }
+  
+  relocated++;
+  return true;
 }
 
-bool DOSInitialize()
+// make fragmented files contiguous, on the whole volume
+void DOSDefrag()
 {
-  // look at track 0
-  WORD dummy;
-  BYTE dummy2;
-  BYTE sdh;
-  
-  wdc->seekDrive(0, 0);
-  wdc->scanID(dummy, dummy2, sdh);
-  if (wdc->getLastError())
+  ui->print(Progmem::getString(Progmem::dosDefragConfirm));
+  const BYTE key = toupper(ui->readKey("YN"));
+  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  if (key != 'Y')
   {
-    ui->print(Progmem::getString(Progmem::analyzeNoSectors));
     ui->print(Progmem::getString(Progmem::uiNewLine));
-    return false;
+    return;
   }
   
-  sectorSizeBytes = wdc->getSectorSizeFromSDH(sdh);  
-  if (!sectorSizeBytes || (sectorSizeBytes > 512))
+  ui->print(Progmem::getString(Progmem::dosDefragBefore));
+  if (!DOSFragmentationReport())
   {
-    ui->print(Progmem::getString(Progmem::dosInvalidSsize), sectorSizeBytes);
-    ui->print(Progmem::getString(Progmem::uiNewLine));
-    return false;
+    return;
   }
   
-  bool weirdGeometry = false; // :-)
-  DWORD* result = CalculateSectorsPerTrack(sdh, sectorsPerTrack, dummy,
-                                           weirdGeometry, weirdGeometry, weirdGeometry);
-  if (!result || !sectorsPerTrack || weirdGeometry)
+  DWORD relocated = 0;
+  DWORD skipped = 0;
+  FAT_EXECUTE(DOSWalkBegin((const BYTE*)"") ? FR_OK : walkResult);
+  
+  for (;;)
   {
-    if (result)
+    FILINFO info = {0};
+    const BYTE entry = DOSWalkNext(info);
+    if (entry == WALK_ERROR)
     {
-      // sectors table
-      delete[] result;
+      DOSResult(walkResult);
+      return;
+    }
+    if (entry == WALK_END)
+    {
+      break;
     }
     
-    ui->print(Progmem::getString(Progmem::analyzeNoSectors));
-    ui->print(Progmem::getString(Progmem::uiNewLine));
-    return false;
-  }  
-  
-  // determine starting sector, find the lowest (some XT disks start from 0)
-  startingSector = (BYTE)-1;
-  for (WORD idx = 0; idx < dummy /* tableCount */; idx++)
-  {
-    const DWORD& sectorData = result[idx];
-    if (sectorData == 0xFFFFFFFFUL) // undefined
+    // leftovers of an interrupted run are not touched
+    if ((entry != WALK_FILE) || (strcmp_P(info.fname, PSTR(DEFRAG_TEMP)) == 0) || (strcmp_P(info.fname, PSTR(DEFRAG_OLD)) == 0))
     {
       continue;
     }
     
-    const BYTE sector = (BYTE)(sectorData >> 16);
-    if (sector < startingSector)
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+    ui->print(info.fname);
+    if (!DOSDefragFile(info, relocated, skipped))
     {
-      startingSector = sector;
+      f_closedir(&dir);
+      return;
     }
   }
-  delete[] result;
   
-  // set root directory and try to mount first partition
-  memset(path, 0, sizeof(path));
-  FAT_EXECUTE_0(f_mount(&fat, "0:", 1));
-
-  return true;
+  ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  ui->print(Progmem::getString(Progmem::dosDefragResult), relocated, skipped);
+  ui->print(Progmem::getString(Progmem::dosDefragAfter));
+  DOSFragmentationReport();
+  ui->print(Progmem::getString(Progmem::uiNewLine));
 }
 
-void DOSFinish()
+// byte of the first FAT, read into WDC SRAM a few sectors at a time
+BYTE DOSCheckFatByte(DWORD offset)
 {
-  // unmount
-  f_closedir(&dir);
-  f_unmount("0:");
-}
-
-void DOSMkdir(const BYTE* dirName)
-{ 
-  // overflow checks in CD command, as absolute paths in names are not allowed  
-  memset(addPath, 0, sizeof(addPath));
-  strcat(addPath, path);
-  strcat(addPath, dirName);
+  const DWORD sector = offset / sectorSizeBytes;
+  const BYTE windowSectors = (CHKDSK_BITMAP - CHKDSK_FAT) / sectorSizeBytes;
   
-  FAT_EXECUTE(f_mkdir(addPath));
+  if ((chkWindow == (DWORD)-1) || (sector < chkWindow) || (sector >= (chkWindow + windowSectors)))
+  {
+    chkWindow = sector;
+    for (BYTE index = 0; (index < windowSectors) && ((sector + index) < fat.fsize); index++)
+    {
+      wdc->readSector(DOSSeekLogicalSector(fat.fatbase + sector + index), sectorSizeBytes, false, NULL, NULL, CHKDSK_FAT + (index * sectorSizeBytes));
+      if (wdc->getLastError() && (wdc->getLastError() != WDC_CORRECTED))
+      {
+        chkWindow = (DWORD)-1;
+        chkDiskError = true;
+        return 0;
+      }
+    }
+  }
+  
+  BYTE data;
+  wdc->sramReadBuffer(&data, CHKDSK_FAT + (WORD)(offset - (chkWindow * sectorSizeBytes)), 1);
+  return data;
 }
 
-// remove empty directory
-void DOSRmdir(const BYTE* dirName)
-{  
-  memset(addPath, 0, sizeof(addPath));
-  strcat(addPath, path);
-  strcat(addPath, dirName);
-  
-  FAT_EXECUTE(f_rmdir(addPath));
-  ui->print(Progmem::getString(Progmem::uiNewLine));
+// FAT entry of a cluster
+DWORD DOSCheckFatEntry(DWORD cluster)
+{
+  switch (fat.fs_type)
+  {
+  case FS_FAT12:
+    {
+      const DWORD offset = cluster + (cluster / 2);
+      const WORD entry = DOSCheckFatByte(offset) | ((WORD)DOSCheckFatByte(offset + 1) << 8);
+      return (cluster & 1) ? (entry >> 4) : (entry & 0xFFF);
+    }
+  case FS_FAT16:
+    return DOSCheckFatByte(cluster * 2) | ((WORD)DOSCheckFatByte((cluster * 2) + 1) << 8);
+  default:
+    {
+      DWORD entry = 0;
+      for (BYTE index = 4; index; index--)
+      {
+        entry = (entry << 8) | DOSCheckFatByte((cluster * 4) + index - 1);
+      }
+      return entry & 0x0FFFFFFF;
+    }
+  }
 }
 
-void DOSDel(const BYTE* fileName)
-{ 
-  memset(addPath, 0, sizeof(addPath));
-  strcat(addPath, path);
-  strcat(addPath, fileName);
-  
-  FAT_EXECUTE(f_unlink(addPath));
-  ui->print(Progmem::getString(Progmem::uiNewLine));
+// lowest end of chain FAT entry value, the bad cluster mark is one below
+DWORD DOSCheckEndOfChain()
+{
+  return (fat.fs_type == FS_FAT12) ? 0xFF8 : (fat.fs_type == FS_FAT16) ? 0xFFF8 : 0x0FFFFFF8;
 }
 
-void DOSHexdump(const BYTE* fileName)
+// mark a cluster in the bitmap tile, returns true if it was marked already
+bool DOSCheckMark(DWORD cluster)
 {
-  memset(addPath, 0, sizeof(addPath));
-  strcat(addPath, path);
-  strcat(addPath, fileName);
-  
-  WORD count = 1;
-  FAT_EXECUTE(f_open(&file, addPath, FA_READ));
+  const WORD offset = CHKDSK_BITMAP + (WORD)((cluster - chkTile) / 8);
+  const BYTE mask = 1 << ((cluster - chkTile) % 8);
   
-  BYTE* chunk = new BYTE[512];
-  if (!chunk)
+  BYTE data;
+  wdc->sramReadBuffer(&data, offset, 1);
+  if (data & mask)
   {
-    ui->fatalError(Progmem::uiFeMemory);
+    return true;
   }
   
-  ui->print(Progmem::getString(Progmem::uiNewLine));
-  ui->print(Progmem::getString(Progmem::hexdumpDump));
+  data |= mask;
+  wdc->sramWriteBuffer(&data, offset, 1);
+  return false;
+}
+
+// follow a cluster chain, marking the clusters within the current tile;
+// the path and size are reported on the first pass only, as the whole chain is walked each pass
+void DOSCheckChain(const BYTE* chainPath, DWORD cluster, bool isDirectory, DWORD size)
+{
+  // FatFs reads the directories through the same SRAM area as the FAT window
+  chkWindow = (DWORD)-1;
   
-  while (count)
+  const DWORD endOfChain = DOSCheckEndOfChain();
+  DWORD clusters = 0;
+  bool crossLinked = false;
+  bool invalid = false;
+  
+  while (cluster)
   {
-    if (DOSResult(f_read(&file, chunk, 512, &count)) != FR_OK)
+    if ((cluster < 2) || (cluster >= fat.n_fatent) || (clusters >= (fat.n_fatent - 2)))
+    {
+      // out of the volume, or looped
+      invalid = true;
+      break;
+    }
+    
+    clusters++;
+    if ((cluster >= chkTile) && (cluster < (chkTile + CHKDSK_TILE)) && DOSCheckMark(cluster))
+    {
+      chkCrossLinks++;
+      crossLinked = true;
+    }
+    
+    const DWORD next = DOSCheckFatEntry(cluster);
+    if (chkDiskError)
     {
-      delete[] chunk;
-      f_close(&file);
       return;
     }
+    if (next >= endOfChain)
+    {
+      break;
+    }
     
-    for (WORD idx = 0; idx < count; idx++)
+    // free or bad cluster within the chain
+    if ((next == 0) || (next == (endOfChain - 1)))
     {
-      ui->print("%02X ", chunk[idx]);
+      invalid = true;
+      break;
     }
+    cluster = next;
   }
   
-  delete[] chunk;  
-  FAT_EXECUTE(f_close(&file));
-  ui->print(Progmem::getString(Progmem::uiNewLine2x));
+  if (crossLinked)
+  {
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+    ui->print(Progmem::getString(Progmem::chkdskCrossLinked), chainPath);
+  }
+  if (!chkFirstPass)
+  {
+    return;
+  }
+  
+  if (invalid)
+  {
+    chkBadChains++;
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+    ui->print(Progmem::getString(Progmem::chkdskBadChain), chainPath);
+  }
+  else if (!isDirectory)
+  {
+    const DWORD clusterBytes = (DWORD)fat.csize * sectorSizeBytes;
+    if (clusters != ((size + clusterBytes - 1) / clusterBytes))
+    {
+      chkMismatches++;
+      ui->print(Progmem::getString(Progmem::uiDeleteLine));
+      ui->print(Progmem::getString(Progmem::chkdskMismatch), chainPath, clusters);
+    }
+  }
 }
 
-void DOSType(const BYTE* fileName)
-{  
-  memset(addPath, 0, sizeof(addPath));
-  strcat(addPath, path);
-  strcat(addPath, fileName);
+// one pass of the check: walk the whole tree, then sweep the FAT of the tile for allocated clusters not reached
+bool DOSCheckPass()
+{
+  wdc->sramBeginBufferAccess(true, CHKDSK_BITMAP);
+  for (WORD index = CHKDSK_BITMAP; index < (CHKDSK_BITMAP + (CHKDSK_TILE / 8)); index++)
+  {
+    wdc->sramWriteByteSequential(0);
+  }
+  wdc->sramFinishBufferAccess();
   
-  WORD count = 1;
-  FAT_EXECUTE(f_open(&file, addPath, FA_READ));
+  // FAT32 root directory is a cluster chain, FAT12/16 have a fixed area
+  if (fat.fs_type == FS_FAT32)
+  {
+    DOSCheckChain((const BYTE*)"\\", fat.dirbase, true, 0);
+  }
   
-  while (count)
+  FAT_EXECUTE_0(DOSWalkBegin((const BYTE*)"") ? FR_OK : walkResult);
+  while (!chkDiskError)
   {
-    // to ui buffer, 0s skipped
-    FAT_EXECUTE_FILE(f_read(&file, ui->getPrintBuffer(), MAX_CHARS, &count));
-    if (count)
+    FILINFO info = {0};
+    const BYTE entry = DOSWalkNext(info);
+    if (entry == WALK_ERROR)
     {
-      ui->setPrintLength(count);
-      ui->print(ui->getPrintBuffer());  
-    }    
+      DOSResult(walkResult);
+      return false;
+    }
+    if (entry == WALK_END)
+    {
+      break;
+    }
+    
+    // entered, the directory object has the start cluster
+    if (entry == WALK_DIR)
+    {
+      chkDirs += chkFirstPass ? 1 : 0;
+      DOSCheckChain(walkPath, dir.obj.sclust, true, 0);
+      continue;
+    }
+    
+    chkFiles += chkFirstPass ? 1 : 0;
+    DOSWalkFilePath(info);
+    FAT_EXECUTE_DIR_0(f_open(&file, addPath, FA_READ));
+    const DWORD cluster = file.obj.sclust;
+    DOSCloseFile();
+    
+    DOSCheckChain(addPath, cluster, false, info.fsize);
   }
   
-  FAT_EXECUTE(f_close(&file));
-  ui->print(Progmem::getString(Progmem::uiNewLine));
+  if (chkDiskError)
+  {
+    f_closedir(&dir);
+    DOSResult(FR_DISK_ERR);
+    return false;
+  }
+  
+  // sequential sweep over the FAT part of this tile
+  chkWindow = (DWORD)-1;
+  const DWORD endOfChain = DOSCheckEndOfChain();
+  
+  for (DWORD cluster = chkTile; (cluster < fat.n_fatent) && (cluster < (chkTile + CHKDSK_TILE)); cluster++)
+  {
+    const DWORD entry = DOSCheckFatEntry(cluster);
+    if (chkDiskError)
+    {
+      DOSResult(FR_DISK_ERR);
+      return false;
+    }
+    if ((entry == 0) || (entry == (endOfChain - 1)))
+    {
+      continue;
+    }
+    
+    BYTE data;
+    wdc->sramReadBuffer(&data, CHKDSK_BITMAP + (WORD)((cluster - chkTile) / 8), 1);
+    if (!(data & (1 << ((cluster - chkTile) % 8))))
+    {
+      chkLostClusters++;
+      if (entry >= endOfChain)
+      {
+        chkLostChains++;
+      }
+    }
+  }
+  
+  return true;
 }
 
-void DOSTypeInto(const BYTE* fileName)
-{ 
-  memset(addPath, 0, sizeof(addPath));
-  strcat(addPath, path);
-  strcat(addPath, fileName);
-  
-  FAT_EXECUTE(f_open(&file, addPath, FA_WRITE | FA_OPEN_APPEND));
+// check the volume for cross-linked files, invalid and lost cluster chains, and file sizes not matching their chains;
+// the cluster bitmap does not fit the WDC SRAM at once, so the volume is checked in as many passes as needed
+void DOSCheckDisk()
+{
+  chkFiles = 0;
+  chkDirs = 0;
+  chkCrossLinks = 0;
+  chkBadChains = 0;
+  chkMismatches = 0;
+  chkLostClusters = 0;
+  chkLostChains = 0;
+  chkDiskError = false;
   
-  // wait for ENTER keypress
-  ui->print(Progmem::getString(Progmem::dosTypeInto));
-  ui->print(Progmem::getString(Progmem::uiContinue));
-  ui->readKey("\r");
-  ui->print("");
+  const DWORD clusters = fat.n_fatent - 2;
+  const WORD passes = (clusters + CHKDSK_TILE - 1) / CHKDSK_TILE;
   
-  bool emptyLine = false;  
-  for (;;)
+  for (WORD pass = 0; pass < passes; pass++)
   {
-    // all valid keys allowed
-    const BYTE* promptBuffer = ui->prompt();
-    WORD length = strlen(promptBuffer);
+    chkTile = 2 + (pass * CHKDSK_TILE);
+    chkFirstPass = (pass == 0);
     
-    // quit?
-    if (!length && emptyLine)
+    ui->print(Progmem::getString(Progmem::chkdskPass), pass + 1, passes);
+    if (!DOSCheckPass())
     {
-      break;
-    }    
-    emptyLine = length == 0;
-    
-    // write line   
-    WORD dummy;
-    FAT_EXECUTE_FILE(f_write(&file, promptBuffer, length, &dummy));
-    FAT_EXECUTE_FILE(f_write(&file, Progmem::getString(Progmem::uiNewLine), 2, &dummy));
-
-    ui->print(Progmem::getString(Progmem::uiNewLine));
+      chkWindow = (DWORD)-1;
+      return;
+    }
   }
   
-  FAT_EXECUTE(f_close(&file));
+  chkWindow = (DWORD)-1;
+  ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  ui->print(Progmem::getString(Progmem::chkdskFiles), chkFiles, chkDirs);
+  ui->print(Progmem::getString(Progmem::chkdskErrors), chkCrossLinks, chkBadChains, chkMismatches);
+  ui->print(Progmem::getString(Progmem::chkdskLost), chkLostClusters, chkLostChains);
   ui->print(Progmem::getString(Progmem::uiNewLine));
 }
 
@@ -413,7 +1891,10 @@ void CommandDos()
   // print partition size
   const WORD partitionSize = (((fat.n_fatent-2) * fat.csize) * (DWORD)sectorSizeBytes) / 1048576UL;
   ui->print(Progmem::getString(Progmem::uiVT100ClearScreen));
-  ui->print(Progmem::getString(Progmem::dosMounted), partitionSize);
+  ui->print(Progmem::getString(Progmem::dosMounted), partitionSize, GetFreeMemory());
+  
+  // in tiny mode the file object works through the volume window and carries no sector buffer
+  ui->print(Progmem::getString(Progmem::dosRamSaved), FF_FS_TINY ? FF_MAX_SS : 0);
   ui->print(Progmem::getString(Progmem::dosCommands));
   ui->print(Progmem::getString(Progmem::dosCommandsList));
   
@@ -665,10 +2146,12 @@ void CommandDos()
       continue;
     }
     
-    // DEL, TYPE, HEXDUMP
+    // DEL, TYPE, HEXDUMP, GET, PUT
     else if ((strcmp_P(command, PSTR("DEL")) == 0) ||
              (strcmp_P(command, PSTR("TYPE")) == 0) ||
-             (strcmp_P(command, PSTR("HEXDUMP")) == 0))
+             (strcmp_P(command, PSTR("HEXDUMP")) == 0) ||
+             (strcmp_P(command, PSTR("GET")) == 0) ||
+             (strcmp_P(command, PSTR("PUT")) == 0))
     {
       
       // 1 file name
@@ -693,6 +2176,18 @@ void CommandDos()
           DOSType(arguments);            
         }
         
+        // GET
+        else if (strcmp_P(command, PSTR("GET")) == 0)
+        {
+          DOSGet(arguments);
+        }
+        
+        // PUT
+        else if (strcmp_P(command, PSTR("PUT")) == 0)
+        {
+          DOSPut(arguments);
+        }
+        
         // HEXDUMP
         else
         {
@@ -707,6 +2202,27 @@ void CommandDos()
       continue;
     }
     
+    // TAR
+    else if (strcmp_P(command, PSTR("TAR")) == 0)
+    {
+      DOSTar();
+      continue;
+    }
+    
+    // CHKDSK
+    else if (strcmp_P(command, PSTR("CHKDSK")) == 0)
+    {
+      DOSCheckDisk();
+      continue;
+    }
+    
+    // DEFRAG
+    else if (strcmp_P(command, PSTR("DEFRAG")) == 0)
+    {
+      DOSDefrag();
+      continue;
+    }
+    
     // TYPEINTO
     else if (strcmp_P(command, PSTR("TYPEINTO")) == 0)
     {
@@ -4,5 +4,8 @@
 WORD  DOSGetSectorSize();
 DWORD DOSGetTotalSectorCount();
 void  DOSConvertLogicalSectorToCHS(const DWORD& logical, WORD& cylinder, BYTE& head, BYTE& sector);
+bool  DOSNextLogicalSectorToCHS(const DWORD& logical, WORD& cylinder, BYTE& head, BYTE& sector);
+BYTE  DOSSeekLogicalSector(const DWORD& logical);
+bool  DOSIsKnownDefect(const DWORD& logical);
 
 void  CommandDos();
\ No newline at end of file
@@ -6,78 +6,251 @@
 // initialized EEPROM data structure
 // offset (dec.), length in bytes, description:
 
-// +00, 01, checksum byte
-// +01, 01, number of drives configured (one)
-// +02, 14, 1st drive configuration
-// +16 to 4K: 0s
+// +00, 01, header checksum byte (header sums up to 0)
+// +01, 01, layout: 2 profile table (1 was a single drive configuration, migrated on load)
+// +02, 01, default profile loaded at boot, 0xFF none
+// +03, 13, 0s
+// +16, 48 each, up to 63 drive profiles:
+//      +00, 01, record checksum byte (record sums up to 0)
+//      +01, 01, 1 used
+//      +02, 14, profile name, zero terminated
+//      +16, 32, drive configuration, rest 0s
 
-// simple 8-bit checksum
-BYTE eepromComputeChecksum()
+// defect list, not covered by the checksums:
+// +3072, 01, number of defects
+// +3073, 01, heads of the drive the list belongs to
+// +3074, 02, cylinders of the drive the list belongs to
+// +3076, 04 each, up to 255 defects: cylinder (2), head, sector, as in the sector ID
+#define EEPROM_LAYOUT_SINGLE   1
+#define EEPROM_LAYOUT_PROFILES 2
+#define EEPROM_TABLE_OFFSET    16
+#define EEPROM_PROFILE_SIZE    48
+#define EEPROM_PROFILE_PARAMS  16
+#define EEPROM_DEFECTS         3072
+#define EEPROM_DEFECTS_MAX     255
+
+// simple 8-bit checksum of a range
+BYTE eepromComputeChecksum(WORD offset, WORD length)
 {
   BYTE checksum = 0;
-  for (WORD index = 0; index < EEPROM.length(); index++)
+  while (length--)
   {
-    checksum += (BYTE)EEPROM.read(index);
+    checksum += (BYTE)EEPROM.read(offset++);
   }
   
   return checksum;
 }
 
-// overwrite checksum byte and set drive not configured
-void eepromClearConfiguration()
+// fill in the first byte of a range so that its checksum equals 0
+void eepromStoreChecksum(WORD offset, WORD length)
+{
+  EEPROM.update(offset, (BYTE)(0x100 - eepromComputeChecksum(offset + 1, length - 1)));
+}
+
+WORD eepromProfileOffset(BYTE index)
 {
-  EEPROM.update(0, 0xFF);
-  EEPROM.update(1, 0);
+  return EEPROM_TABLE_OFFSET + (index * EEPROM_PROFILE_SIZE);
 }
 
-void eepromStoreConfiguration()
+bool eepromIsProfileUsed(BYTE index)
 {
-  // update number of drives
-  EEPROM.update(0, 0);
-  EEPROM.update(1, 1);
+  const WORD eepromOffset = eepromProfileOffset(index);
+  return (EEPROM.read(eepromOffset + 1) == 1) && (eepromComputeChecksum(eepromOffset, EEPROM_PROFILE_SIZE) == 0);
+}
 
-  // data
-  WORD eepromOffset = 2;
+void eepromSetDefaultProfile(BYTE index)
+{
+  EEPROM.update(2, index);
+  eepromStoreChecksum(0, EEPROM_TABLE_OFFSET);
+}
+
+BYTE eepromGetDefaultProfile()
+{
+  const BYTE index = EEPROM.read(2);
+  return ((index < EEPROM_PROFILES_MAX) && eepromIsProfileUsed(index)) ? index : EEPROM_NO_PROFILE;
+}
+
+// write the configuration in use into a profile record
+void eepromWriteProfile(BYTE index, const BYTE* name)
+{
+  const WORD eepromOffset = eepromProfileOffset(index);
+  EEPROM.update(eepromOffset + 1, 1);
+  
+  // zero padded
+  bool nameEnd = false;
+  for (BYTE nameIndex = 0; nameIndex < EEPROM_PROFILE_NAME; nameIndex++)
+  {
+    nameEnd = nameEnd || !name[nameIndex] || (nameIndex == (EEPROM_PROFILE_NAME - 1));
+    EEPROM.update(eepromOffset + 2 + nameIndex, nameEnd ? 0 : name[nameIndex]);
+  }
+  
+  // the configuration, zero padded for it to grow
   const BYTE* params = (const BYTE*)wdc->getParams();
+  for (BYTE bufIndex = 0; bufIndex < (EEPROM_PROFILE_SIZE - EEPROM_PROFILE_PARAMS); bufIndex++)
+  {
+    EEPROM.update(eepromOffset + EEPROM_PROFILE_PARAMS + bufIndex, (bufIndex < sizeof(WD42C22::DiskDriveParams)) ? params[bufIndex] : 0);
+  }
   
-  for (BYTE bufIndex = 0; bufIndex < sizeof(WD42C22::DiskDriveParams); bufIndex++)
+  eepromStoreChecksum(eepromOffset, EEPROM_PROFILE_SIZE);
+}
+
+// bring the EEPROM to the profile table layout, keeping a configuration stored by older firmware
+void eepromPrepareLayout()
+{
+  if (EEPROM.read(1) == EEPROM_LAYOUT_PROFILES)
   {
-    EEPROM.update(eepromOffset++, params[bufIndex]);
+    if (eepromComputeChecksum(0, EEPROM_TABLE_OFFSET) != 0)
+    {
+      // header torn by a power loss (default profile written, checksum not), records verify on their own
+      const BYTE index = EEPROM.read(2);
+      EEPROM.update(2, ((index < EEPROM_PROFILES_MAX) && eepromIsProfileUsed(index)) ? index : EEPROM_NO_PROFILE);
+      for (WORD eepromOffset = 3; eepromOffset < EEPROM_TABLE_OFFSET; eepromOffset++)
+      {
+        EEPROM.update(eepromOffset, 0);
+      }
+      eepromStoreChecksum(0, EEPROM_TABLE_OFFSET);
+    }
+    return;
   }
-    
-  // the rest is zeros
-  while (eepromOffset < EEPROM.length())
+  
+  const bool migrate = (EEPROM.read(1) == EEPROM_LAYOUT_SINGLE) && (eepromComputeChecksum(0, EEPROM_DEFECTS) == 0);
+  if (migrate)
+  {
+    // the old configuration at +02, overlaps the first record
+    BYTE* params = (BYTE*)wdc->getParams();
+    for (BYTE bufIndex = 0; bufIndex < sizeof(WD42C22::DiskDriveParams); bufIndex++)
+    {
+      params[bufIndex] = EEPROM.read(2 + bufIndex);
+    }
+  }
+  
+  // empty table; records with garbage in them are free anyway, as their checksums do not match
+  for (WORD eepromOffset = 1; eepromOffset < EEPROM_TABLE_OFFSET; eepromOffset++)
+  {
+    EEPROM.update(eepromOffset, 0);
+  }
+  EEPROM.update(1, EEPROM_LAYOUT_PROFILES);
+  EEPROM.update(2, EEPROM_NO_PROFILE);
+  for (BYTE index = 0; index < EEPROM_PROFILES_MAX; index++)
   {
-    EEPROM.update(eepromOffset++, 0);
+    EEPROM.update(eepromProfileOffset(index) + 1, 0);
   }
+  eepromStoreChecksum(0, EEPROM_TABLE_OFFSET);
+  
+  if (migrate)
+  {
+    eepromWriteProfile(0, (const BYTE*)"Drive 1");
+    eepromSetDefaultProfile(0);
+    memset(wdc->getParams(), 0, sizeof(WD42C22::DiskDriveParams));
+  }
+}
+
+// remove the default profile
+void eepromClearConfiguration()
+{
+  const BYTE index = eepromGetDefaultProfile();
+  if (index != EEPROM_NO_PROFILE)
+  {
+    EEPROM.update(eepromProfileOffset(index) + 1, 0);
+    eepromSetDefaultProfile(EEPROM_NO_PROFILE);
+  }
+}
+
+// store the configuration in use as a profile (replacing one of the same name) and make it default;
+// false if the table is full
+bool eepromStoreConfiguration(const BYTE* name)
+{
+  eepromPrepareLayout();
+  
+  BYTE freeIndex = EEPROM_NO_PROFILE;
+  BYTE index = 0;
+  for (; index < EEPROM_PROFILES_MAX; index++)
+  {
+    BYTE storedName[EEPROM_PROFILE_NAME];
+    if (!eepromGetProfileName(index, storedName))
+    {
+      if (freeIndex == EEPROM_NO_PROFILE)
+      {
+        freeIndex = index;
+      }
+      continue;
+    }
     
-  // fill in the first byte so that the EEPROM checksum equals 0
-  BYTE checksum = eepromComputeChecksum();
-  if (checksum != 0)
+    if (strncmp(storedName, name, sizeof(storedName) - 1) == 0)
+    {
+      break;
+    }
+  }
+  
+  if (index == EEPROM_PROFILES_MAX)
   {
-    checksum = 0x100 - checksum;
+    if (freeIndex == EEPROM_NO_PROFILE)
+    {
+      return false;
+    }
+    index = freeIndex;
   }
-  EEPROM.update(0, checksum);
+  
+  eepromWriteProfile(index, name);
+  eepromSetDefaultProfile(index);
+  return true;
 }
 
-// load configuration
-bool eepromLoadConfiguration()
+// write the configuration in use back into the default profile, false if there is none
+bool eepromUpdateDefaultProfile()
 {
-  // check drive count validity
-  const BYTE driveCount = EEPROM.read(1);  
-  if (driveCount != 1)
+  BYTE name[EEPROM_PROFILE_NAME];
+  const BYTE index = eepromGetDefaultProfile();
+  if ((index == EEPROM_NO_PROFILE) || !eepromGetProfileName(index, name))
   {
     return false;
   }
-   
-  // checksum must be zero
-  if (eepromComputeChecksum() != 0)
+  
+  eepromWriteProfile(index, name);
+  return true;
+}
+
+// name of a stored profile, false if the record is free
+bool eepromGetProfileName(BYTE index, BYTE* name)
+{
+  if ((index >= EEPROM_PROFILES_MAX) || !eepromIsProfileUsed(index))
   {
     return false;
   }
-   
-  // proceed
-  BYTE eepromOffset = 2; // skip checksum byte and 1 drive cfg'd
+  
+  const WORD eepromOffset = eepromProfileOffset(index) + 2;
+  for (BYTE nameIndex = 0; nameIndex < EEPROM_PROFILE_NAME; nameIndex++)
+  {
+    name[nameIndex] = EEPROM.read(eepromOffset + nameIndex);
+  }
+  name[EEPROM_PROFILE_NAME - 1] = 0;
+  
+  return true;
+}
+
+BYTE eepromProfileCount()
+{
+  BYTE count = 0;
+  for (BYTE index = 0; index < EEPROM_PROFILES_MAX; index++)
+  {
+    if (eepromIsProfileUsed(index))
+    {
+      count++;
+    }
+  }
+  
+  return count;
+}
+
+// load a profile into the configuration in use; reads only its record
+bool eepromLoadProfile(BYTE index)
+{
+  if ((index >= EEPROM_PROFILES_MAX) || !eepromIsProfileUsed(index))
+  {
+    return false;
+  }
+  
+  WORD eepromOffset = eepromProfileOffset(index) + EEPROM_PROFILE_PARAMS;
   BYTE* params = (BYTE*)wdc->getParams();
     
   for (BYTE bufIndex = 0; bufIndex < sizeof(WD42C22::DiskDriveParams); bufIndex++)
@@ -91,9 +264,9 @@ bool eepromLoadConfiguration()
       (check->Heads == 0) || (check->Heads > 16) || (check->DataVerifyMode > 2) ||
       (check->WritePrecompStartCyl > 2047) || (check->RWCStartCyl > 2047) ||
       (check->LandingZone > 2047) || 
-      (check->PartialImageStartCyl > 2047) || (check->PartialImageEndCyl > 2047))
+      (check->PartialImageStartCyl > 2047) || (check->PartialImageEndCyl > 2047) ||
+      (check->StepRateUs > 16383))
   {
-    eepromClearConfiguration();
     memset(check, 0, sizeof(WD42C22::DiskDriveParams));
     return false;
   }
@@ -104,4 +277,114 @@ bool eepromLoadConfiguration()
 #endif
 
   return true;
+}
+
+// load the default profile
+bool eepromLoadConfiguration()
+{
+  eepromPrepareLayout();
+  
+  const BYTE index = eepromGetDefaultProfile();
+  return (index != EEPROM_NO_PROFILE) && eepromLoadProfile(index);
+}
+
+// number of known defects of the drive configured; a list of a different drive is ignored
+BYTE eepromDefectCount()
+{
+  const WD42C22::DiskDriveParams* params = wdc->getParams();
+  WORD cylinders;
+  EEPROM.get(EEPROM_DEFECTS + 2, cylinders);
+  
+  if ((EEPROM.read(EEPROM_DEFECTS + 1) != params->Heads) || (cylinders != params->Cylinders))
+  {
+    return 0;
+  }
+  
+  // 255 entries fill the EEPROM up to its end, so any count byte is in range
+  return EEPROM.read(EEPROM_DEFECTS);
+}
+
+// index of a defect in the list, or -1 if not there
+int eepromFindDefect(WORD cylinder, BYTE head, BYTE sector)
+{
+  // unsorted, as every insert into a sorted list would take seconds of EEPROM writes;
+  // a linear search over 255 entries at most is still well below a single sector read
+  const BYTE count = eepromDefectCount();
+  WORD eepromOffset = EEPROM_DEFECTS + 4;
+  
+  for (BYTE index = 0; index < count; index++, eepromOffset += 4)
+  {
+    WORD defectCylinder;
+    EEPROM.get(eepromOffset, defectCylinder);
+    
+    if ((defectCylinder == cylinder) && (EEPROM.read(eepromOffset + 2) == head) && (EEPROM.read(eepromOffset + 3) == sector))
+    {
+      return index;
+    }
+  }
+  
+  return -1;
+}
+
+bool eepromIsDefect(WORD cylinder, BYTE head, BYTE sector)
+{
+  return eepromFindDefect(cylinder, head, sector) != -1;
+}
+
+// add a defect, false if the list is full
+bool eepromAddDefect(WORD cylinder, BYTE head, BYTE sector)
+{
+  if (eepromIsDefect(cylinder, head, sector))
+  {
+    return true;
+  }
+  
+  // start a new list if this one belongs to a different drive
+  BYTE count = eepromDefectCount();
+  if (!count)
+  {
+    EEPROM.update(EEPROM_DEFECTS + 1, wdc->getParams()->Heads);
+    EEPROM.put(EEPROM_DEFECTS + 2, wdc->getParams()->Cylinders);
+  }
+  
+  if (count == EEPROM_DEFECTS_MAX)
+  {
+    return false;
+  }
+  
+  const WORD eepromOffset = EEPROM_DEFECTS + 4 + (count * 4);
+  EEPROM.put(eepromOffset, cylinder);
+  EEPROM.update(eepromOffset + 2, head);
+  EEPROM.update(eepromOffset + 3, sector);
+  EEPROM.update(EEPROM_DEFECTS, count + 1);  
+  return true;
+}
+
+// remove all defects on a track, after it has been formatted again
+void eepromRemoveDefects(WORD cylinder, BYTE head)
+{
+  BYTE count = eepromDefectCount();
+  BYTE index = 0;
+  
+  while (index < count)
+  {
+    const WORD eepromOffset = EEPROM_DEFECTS + 4 + (index * 4);
+    WORD defectCylinder;
+    EEPROM.get(eepromOffset, defectCylinder);
+    
+    if ((defectCylinder != cylinder) || (EEPROM.read(eepromOffset + 2) != head))
+    {
+      index++;
+      continue;
+    }
+    
+    // move the last one here
+    count--;
+    const WORD lastOffset = EEPROM_DEFECTS + 4 + (count * 4);
+    for (BYTE byte = 0; byte < 4; byte++)
+    {
+      EEPROM.update(eepromOffset + byte, EEPROM.read(lastOffset + byte));
+    }
+    EEPROM.update(EEPROM_DEFECTS, count);
+  }
 }
\ No newline at end of file
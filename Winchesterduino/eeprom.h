@@ -5,8 +5,24 @@
 #ifndef _WINCHESTERDUINO_EEPROM_H_
 #define _WINCHESTERDUINO_EEPROM_H_
 
+// drive profiles, the default one loaded at boot
+#define EEPROM_PROFILE_NAME    14
+#define EEPROM_NO_PROFILE      0xFF
+#define EEPROM_PROFILES_MAX    63
+
 bool eepromLoadConfiguration();
-void eepromStoreConfiguration();
+bool eepromStoreConfiguration(const BYTE* name);
+bool eepromUpdateDefaultProfile();
 void eepromClearConfiguration();
+BYTE eepromProfileCount();
+bool eepromGetProfileName(BYTE index, BYTE* name);
+bool eepromLoadProfile(BYTE index);
+void eepromSetDefaultProfile(BYTE index);
+
+// known defective sectors of the drive configured
+BYTE eepromDefectCount();
+bool eepromIsDefect(WORD cylinder, BYTE head, BYTE sector);
+bool eepromAddDefect(WORD cylinder, BYTE head, BYTE sector);
+void eepromRemoveDefects(WORD cylinder, BYTE head);
 
 #endif
\ No newline at end of file
@@ -3,10 +3,6 @@
 
 #include "config.h"
 
-// forward decl's
-int  RX(int msDelay);
-void TX(const char *data, int size);
-
 // XMODEM callback related
 void CbCleanup();
 bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size);
@@ -14,12 +10,17 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size);
 bool CbVerifyParamsFromImage();
 
 // values not modified by CbCleanup()
-BYTE cbProgmemResponseStr      = 0;
+WORD cbProgmemResponseStr      = 0;
 bool cbSuccess                 = false;
 DWORD cbTotalDataErrors        = 0;
 DWORD cbTotalCorrectedErrors   = 0;
+DWORD cbTotalVotedSectors      = 0;
 DWORD cbTotalBadBlocks         = 0;
 DWORD cbUnreadableTracks       = 0;
+// read disk to image options:
+bool cbReadImgCheckBytes       = false; // data errors stored as type 3 records, with the CRC/ECC bytes of a long read
+BYTE cbReadImgVotes            = 0;     // long reads of a data error sector to vote on by majority, 0: off
+bool cbReadImgTimings          = false; // each track field with a timing record of its sector IDs
 // write image to disk options:
 bool cbWriteImgOverrideParams  = false;
 BYTE cbWriteImgBadSectorMode   = 0; // 0: bad sectors formatted empty, 1: bad sectors formatted as bad
@@ -46,6 +47,21 @@ WORD cbSectorIdx               = 0;
 WORD cbStartingSectorIdx       = (WORD)-1;
 BYTE cbSectorDataType          = 0;
 WORD cbSecSizeBytes            = 0;
+WORD* cbSectorsIntervals       = NULL;  // reading: microseconds from the preceding ID, for each entry of cbSectorsTable
+WORD* cbTrackTimings           = NULL;  // timing record of the current track: index offset, then one interval per map entry
+bool cbTrackTimed              = false; // ditto, present
+bool cbTimingsSpecified        = false;
+BYTE cbTrackGap                = 0;     // writing: GAP3 formatted from the timing record, 0 for the default
+
+// voting on data errors
+#define VOTE_MAX_READS 7
+#define VOTE_CHUNK     16 // bytes of each read compared at once
+
+// CbVoteSector() results
+#define VOTE_NONE      0  // not enough buffer or a read lost the ID: buffer offset 0 holds the data of a single read
+#define VOTE_FAILED    1  // voted data and CRC/ECC bytes at offset 0, but they do not agree
+#define VOTE_PASSED    2  // ditto, and they agree
+#define VOTE_FATAL     3  // WDC timeout, drive not ready or write fault
 
 void CommandReadImage()
 { 
@@ -143,6 +159,69 @@ void CommandReadImage()
     ui->print(Progmem::getString(Progmem::uiEchoKey), key);
     useXMODEM1K = (key == 'Y');
   }
+  
+  // keep the check bytes of sectors with data errors, to attempt correcting them offline
+  ui->print(Progmem::getString(Progmem::imgReadCheckBytes));
+  key = toupper(ui->readKey("YN\e"));
+  if (key == '\e')
+  {
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return;
+  }
+  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  cbReadImgCheckBytes = (key == 'Y');
+  
+  // read them again and vote each bit, to get clean data without retrying over and over;
+  // as many reads of a sector as fit in the buffer, by the sector size on the first track
+  WORD dummy;
+  BYTE dummy2;
+  BYTE sdh = 0;
+  wdc->seekDrive(wdc->getParams()->PartialImage ? wdc->getParams()->PartialImageStartCyl : 0, 0);
+  wdc->scanID(dummy, dummy2, sdh);
+  const WORD voteSectorSize = wdc->getLastError() ? 512 : wdc->getSectorSizeFromSDH(sdh);
+  const BYTE verifyMode = wdc->getParams()->DataVerifyMode;
+  const WORD voteStride = voteSectorSize + ((verifyMode == MODE_ECC_56BIT) ? 7 : (verifyMode == MODE_ECC_32BIT) ? 4 : 2);
+  BYTE maxVotes = VOTE_MAX_READS;
+  while ((maxVotes >= 3) && ((WORD)maxVotes * voteStride > 2032))
+  {
+    maxVotes -= 2;
+  }
+  
+  cbReadImgVotes = 0;
+  if (maxVotes < 3)
+  {
+    ui->print(Progmem::getString(Progmem::imgReadNoVotes), voteSectorSize);
+  }
+  while(maxVotes >= 3)
+  {
+    ui->print(Progmem::getString(Progmem::imgReadVotes), maxVotes);
+    const BYTE* prompt = ui->prompt(1, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+    if (!prompt)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    cbReadImgVotes = (BYTE)atoi(prompt);
+    if (!cbReadImgVotes || ((cbReadImgVotes >= 3) && (cbReadImgVotes <= maxVotes) && (cbReadImgVotes & 1))) // odd, no ties
+    {
+      if (!cbReadImgVotes && !strlen(ui->getPromptBuffer())) ui->print("0");
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      break;
+    }
+    
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  }
+  
+  // note how far apart the sector IDs are, so that a write of the image can reproduce gaps and skew
+  ui->print(Progmem::getString(Progmem::imgReadTimings));
+  key = toupper(ui->readKey("YN\e"));
+  if (key == '\e')
+  {
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return;
+  }
+  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  cbReadImgTimings = (key == 'Y');
    
   ui->print(Progmem::getString(Progmem::uiNewLine));
   
@@ -217,6 +296,7 @@ void CommandReadImage()
   cbInProgress = true;
   cbTotalDataErrors = 0;
   cbTotalCorrectedErrors = 0;
+  cbTotalVotedSectors = 0;
   cbTotalBadBlocks = 0;
   cbUnreadableTracks = 0;
   
@@ -250,7 +330,11 @@ void CommandReadImage()
     if (wdc->getParams()->DataVerifyMode != MODE_CRC_16BIT)
     {
       ui->print(Progmem::getString(Progmem::imgDataCorrected), cbTotalCorrectedErrors);  
-    }    
+    }
+    if (cbReadImgVotes)
+    {
+      ui->print(Progmem::getString(Progmem::imgDataVoted), cbTotalVotedSectors);
+    }
     ui->print(Progmem::getString(Progmem::imgDataErrors), cbTotalDataErrors);
   }
   
@@ -503,6 +587,12 @@ bool IsSerialTransfer()
   return cbInProgress;
 }
 
+// transfers outside of imaging, so that fatal errors do not halt the system with XMODEM running
+void SetSerialTransfer(bool inProgress)
+{
+  cbInProgress = inProgress;
+}
+
 // dump serial transfer if not successful
 void DumpSerialTransfer()
 {
@@ -534,6 +624,16 @@ void CbCleanup()
     delete[] cbSectorsTable;
     cbSectorsTable = NULL;
   }
+  if (cbSectorsIntervals)
+  {
+    delete[] cbSectorsIntervals;
+    cbSectorsIntervals = NULL;
+  }
+  if (cbTrackTimings)
+  {
+    delete[] cbTrackTimings;
+    cbTrackTimings = NULL;
+  }
   
   cbInProgress              = false;
   cbProcessingHeader        = true;
@@ -554,12 +654,188 @@ void CbCleanup()
   cbStartingSectorIdx       = (WORD)-1;
   cbSectorDataType          = 0;
   cbSecSizeBytes            = 0;
+  cbTrackTimed              = false;
+  cbTimingsSpecified        = false;
+  cbTrackGap                = 0;
   
   memset(&cbParams, 0, sizeof(cbParams));
   
   wdc->sramFinishBufferAccess();
 }
 
+// CRC/ECC bytes following the data of a type 3 sector record, by the data verify type of the image
+WORD CbCheckBytesCount()
+{
+  switch (((const WD42C22::DiskDriveParams*)&cbParams[0])->DataVerifyMode)
+  {
+  case MODE_ECC_32BIT:
+    return 4;
+  case MODE_ECC_56BIT:
+    return 7;
+  }
+  
+  return 2;
+}
+
+// GAP3 to format the current track with, from its timing record, or 0 for the default
+BYTE CbTrackGap()
+{
+  if (!cbTrackTimed || !cbTrackTimings)
+  {
+    return 0;
+  }
+  
+  // shortest interval: sector to sector, the longest one would also span the index
+  WORD shortest = 0xFFFF;
+  for (WORD idx = 1; idx <= cbSpt; idx++)
+  {
+    if (cbTrackTimings[idx] && (cbTrackTimings[idx] < shortest))
+    {
+      shortest = cbTrackTimings[idx];
+    }
+  }
+  if (shortest == 0xFFFF)
+  {
+    return 0;
+  }
+  
+  // into bytes: 1.6us each with MFM at 5Mbit/s, 16/15us with RLL at 7.5Mbit/s; keep 2% for a faster spinning drive
+  DWORD bytes = wdc->getParams()->UseRLL ? ((DWORD)shortest*15)/16 : ((DWORD)shortest*5)/8;
+  bytes -= bytes / 50;
+  
+  // less the rest of the sector: 11 bytes ID PLO, 7 bytes ID field, 3 bytes ID pad and splice, 12 bytes DATA PLO,
+  // 2 bytes data address mark, the data field and its CRC/ECC, 4 bytes data pad and splice (see getWriteIDOffset())
+  const BYTE mode = wdc->getParams()->DataVerifyMode;
+  const DWORD sectorBytes = 39 + cbSecSizeBytes + ((mode == MODE_ECC_56BIT) ? 7 : (mode == MODE_ECC_32BIT) ? 4 : 2);
+  if (bytes < sectorBytes + 4)
+  {
+    return 0; // too short, or a different data rate
+  }
+  
+  bytes -= sectorBytes;
+  return (bytes > 255) ? 255 : (BYTE)bytes;
+}
+
+// map entry of the current track to format first after the index, from its timing record
+BYTE CbTrackSkew()
+{
+  // the bad block flag is set on the first sector of a track with a different command; setBadSectors() tells it
+  // from the ID timing, but assumes the lowest logical sector if the index gap does not stand out, so no skew then
+  if (!cbTrackTimed || !cbTrackTimings || (cbWriteImgBadSectorMode == 1) || (cbWriteImgDataErrorsMode == 1))
+  {
+    return 0;
+  }
+  
+  // the longest interval is where the index was
+  BYTE first = 0;
+  for (WORD idx = 1; idx < cbSpt; idx++)
+  {
+    if (cbTrackTimings[idx+1] > cbTrackTimings[first+1])
+    {
+      first = (BYTE)idx;
+    }
+  }
+  
+  return first;
+}
+
+// bitwise CRC/ECC of a data field, MSB first; polynomials and initial values as shown by the Hexdump command
+void CbUpdateCheck(uint64_t& check, BYTE value, BYTE width, uint64_t polynomial)
+{
+  const uint64_t top = (uint64_t)1 << (width - 1);
+  
+  check ^= (uint64_t)value << (width - 8);
+  for (BYTE bit = 0; bit < 8; bit++)
+  {
+    check = (check & top) ? ((check << 1) ^ polynomial) : (check << 1);
+  }
+}
+
+// read a sector with a data error again in long mode, each read into its own region of the buffer,
+// and vote each bit of the data and CRC/ECC bytes by majority, into the first region (offset 0);
+// then check the voted data against the voted CRC/ECC bytes
+BYTE CbVoteSector(BYTE logicalSector, WORD logicalCylinder, BYTE logicalHead)
+{
+  const WORD checkBytes = CbCheckBytesCount();
+  const WORD stride = cbSecSizeBytes + checkBytes;
+  
+  // keep clear of the last 16 bytes (ECC correction), and an odd count (as accepted at the prompt);
+  // the prompt allowed as many as fit the sector size of the first track, fewer only with larger sectors here
+  BYTE reads = cbReadImgVotes;
+  while ((reads >= 3) && ((WORD)reads * stride > 2032))
+  {
+    reads -= 2;
+  }
+  if (reads < 3)
+  {
+    return VOTE_NONE;
+  }
+  
+  for (BYTE read = 0; read < reads; read++)
+  {
+    wdc->readSector(logicalSector, cbSecSizeBytes, true, &logicalCylinder, &logicalHead, read * stride);
+    if (wdc->getLastError())
+    {
+      return (wdc->getLastError() < 4) ? VOTE_FATAL : VOTE_NONE;
+    }
+  }
+  
+  const BYTE width = (BYTE)checkBytes * 8;
+  const uint64_t polynomial = (width == 16) ? 0x1021ULL : ((width == 32) ? 0x140A0445ULL : 0x140A0445000101ULL);
+  const uint64_t mask = ((uint64_t)1 << width) - 1;
+  uint64_t check = mask;
+  uint64_t stored = 0;
+  
+  // the data field begins with the address mark
+  CbUpdateCheck(check, 0xA1, width, polynomial);
+  CbUpdateCheck(check, 0xF8, width, polynomial);
+  
+  BYTE copies[VOTE_MAX_READS][VOTE_CHUNK];
+  for (WORD pos = 0; pos < stride; pos += VOTE_CHUNK)
+  {
+    const BYTE count = ((stride - pos) < VOTE_CHUNK) ? (BYTE)(stride - pos) : VOTE_CHUNK;
+    for (BYTE read = 0; read < reads; read++)
+    {
+      wdc->sramReadBuffer(copies[read], read * stride + pos, count);
+    }
+    
+    // bits set in more than half of the reads
+    for (BYTE idx = 0; idx < count; idx++)
+    {
+      BYTE voted = 0;
+      for (BYTE bit = 0x80; bit; bit >>= 1)
+      {
+        BYTE ones = 0;
+        for (BYTE read = 0; read < reads; read++)
+        {
+          if (copies[read][idx] & bit)
+          {
+            ones++;
+          }
+        }
+        if (ones > (reads / 2))
+        {
+          voted |= bit;
+        }
+      }
+      
+      copies[0][idx] = voted;
+      if ((pos + idx) < cbSecSizeBytes)
+      {
+        CbUpdateCheck(check, voted, width, polynomial);
+      }
+      else
+      {
+        stored = (stored << 8) | voted;
+      }
+    }
+    
+    wdc->sramWriteBuffer(copies[0], pos, count);
+  }
+  
+  return ((check & mask) == stored) ? VOTE_PASSED : VOTE_FAILED;
+}
+
 // read disk callback
 bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size)
 {
@@ -644,7 +920,7 @@ bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size)
     if (!cbHeadSpecified)
     {
       cbHead = wdc->getPhysicalHead();
-      data[packetIdx++] = cbHead;
+      data[packetIdx++] = cbReadImgTimings ? (cbHead | 0x80) : cbHead; // bit 7: timing record follows the sector map
       cbHeadSpecified = true;
       CHECK_STREAM_END;
     }
@@ -664,6 +940,16 @@ bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size)
         delete[] cbSectorsTable;
         cbSectorsTable = NULL;
       }
+      if (cbSectorsIntervals)
+      {
+        delete[] cbSectorsIntervals;
+        cbSectorsIntervals = NULL;
+      }
+      if (cbTrackTimings)
+      {
+        delete[] cbTrackTimings;
+        cbTrackTimings = NULL;
+      }
       cbSectorsTableCount = 0;
       
       // get SDH byte, 5 attempts
@@ -755,6 +1041,22 @@ bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size)
           }
         }
       }
+      
+      // timestamp the IDs over another few revolutions, the record is then filled in as the map is written
+      if (cbSpt && cbReadImgTimings)
+      {
+        cbSectorsIntervals = MeasureSectorIntervals(cbSectorsTable, cbSectorsTableCount);
+        cbTrackTimings = new WORD[cbSpt+1];
+        if (!cbSectorsIntervals || !cbTrackTimings)
+        {
+          cbSuccess = false;
+          cbProgmemResponseStr = Progmem::uiFeMemory;
+          return false;
+        }
+        
+        memset(cbTrackTimings, 0, (cbSpt+1)*sizeof(WORD));
+        cbTrackTimings[0] = 0xFFFF; // index to the first ID of the map: unknown, the index pulse does not reach the microcontroller
+      }
  
       cbSptSpecified = true;
       data[packetIdx++] = cbSpt;
@@ -823,6 +1125,11 @@ bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size)
         cbLastPos++;
         if ((cbLastPos % 4) == 0)
         {
+          if (cbTrackTimings)
+          {
+            cbTrackTimings[cbLastPos / 4] = cbSectorsIntervals[cbSectorIdx];
+          }
+          
           cbSectorIdx++; // 4 bytes per each sector
           sectorMapPos = 0;
         }
@@ -875,6 +1182,20 @@ bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size)
       cbSecMapSpecified = true;
     }
     
+    // timing record after the map, all WORDs LSB first
+    if (cbTrackTimings && !cbTimingsSpecified)
+    {
+      const BYTE* timingRecord = (const BYTE*)cbTrackTimings; // access by bytes
+      while (cbLastPos < ((WORD)cbSpt+1)*2)
+      {
+        data[packetIdx++] = timingRecord[cbLastPos++];
+        CHECK_STREAM_END;
+      }
+      
+      cbLastPos = 0;
+      cbTimingsSpecified = true;
+    }
+    
     // now try to read    
     while ((cbLastPos < cbSpt) && (cbSectorIdx < cbSectorsTableCount))
     {     
@@ -917,13 +1238,70 @@ bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size)
           else if (wdc->getLastError() == WDC_DATAERROR) // we have data, but likely faulty
           {
             cbSectorDataType = 2;
-            cbTotalDataErrors++;
+            
+            // read it a few more times and vote
+            BYTE vote = VOTE_NONE;
+            if (cbReadImgVotes)
+            {
+              vote = CbVoteSector(logicalSector, logicalCylinder, logicalHead);
+              if (vote == VOTE_FATAL)
+              {
+                cbSuccess = false;
+                cbProgmemResponseStr = wdc->getLastErrorMessage();
+                return false;
+              }
+            }
+            
+            if (vote == VOTE_PASSED)
+            {
+              cbSectorDataType = 1; // the voted data are good
+              cbTotalVotedSectors++;
+            }
+            else
+            {
+              cbTotalDataErrors++;
+            }
+            
+            // the voted CRC/ECC bytes are already in the buffer
+            if ((vote == VOTE_FAILED) && cbReadImgCheckBytes)
+            {
+              cbSectorDataType = 3;
+            }
+            
+            // otherwise one more read, in long mode: the data uncorrected as above, followed by the CRC/ECC bytes
+            else if ((vote == VOTE_NONE) && cbReadImgCheckBytes)
+            {
+              wdc->readSector(logicalSector, cbSecSizeBytes, true, &logicalCylinder, &logicalHead);
+              if (wdc->getLastError() && (wdc->getLastError() < 4))
+              {
+                cbSuccess = false;
+                cbProgmemResponseStr = wdc->getLastErrorMessage();
+                return false;
+              }
+              
+              if (!wdc->getLastError())
+              {
+                cbSectorDataType = 3;
+              }
+              else
+              {
+                // ID not found this time, get the data back in the buffer as it was
+                wdc->readSector(logicalSector, cbSecSizeBytes, false, &logicalCylinder, &logicalHead);
+                if (wdc->getLastError() && (wdc->getLastError() < 4))
+                {
+                  cbSuccess = false;
+                  cbProgmemResponseStr = wdc->getLastErrorMessage();
+                  return false;
+                }
+              }
+            }
           }
           
           else // no data in buffer
           {
             cbSectorDataType = 0;
             cbTotalBadBlocks++;
+            eepromAddDefect(logicalCylinder, logicalHead, logicalSector);
           }
         }
         else
@@ -931,8 +1309,8 @@ bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size)
           cbSectorDataType = 1; // valid data
         }
         
-        // determine whether to compress the data
-        if (cbSectorDataType)
+        // determine whether to compress the data; never with the check bytes
+        if ((cbSectorDataType == 1) || (cbSectorDataType == 2))
         {
           wdc->sramBeginBufferAccess(false, 0);
           bool compressedData = true;
@@ -955,7 +1333,11 @@ bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size)
           }
           
           wdc->sramBeginBufferAccess(false, 0); // rewind SRAM buffer          
-        }      
+        }
+        else if (cbSectorDataType == 3)
+        {
+          wdc->sramBeginBufferAccess(false, 0);
+        }
         
         data[packetIdx++] = cbSectorDataType; 
         cbSecDataTypeSpecified = true;
@@ -978,6 +1360,19 @@ bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size)
         wdc->sramFinishBufferAccess();
       }
       break;
+      case 3:
+      {
+        // data, and the CRC/ECC bytes following it in the buffer
+        while (rwBufferPos != cbSecSizeBytes + CbCheckBytesCount())
+        {
+          data[packetIdx++] = wdc->sramReadByteSequential();
+          rwBufferPos++;
+          CHECK_STREAM_END;
+        }
+        rwBufferPos = 0;
+        wdc->sramFinishBufferAccess();
+      }
+      break;
       case 0x81:
       case 0x82:      
       {
@@ -1040,6 +1435,7 @@ bool CbReadDisk(DWORD packetNo, BYTE* data, WORD size)
     cbSptSpecified = false;
     cbSecMapSpecified = false;
     cbSecDataTypeSpecified = false;
+    cbTimingsSpecified = false;
     cbLastPos = 0;
     cbSectorIdx = 0;
     cbCurrentSector = 0;
@@ -1140,7 +1536,12 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
       // apply new parameters?
       if (cbWriteImgOverrideParams)
       {
+        // step rate and format gap are calibrations of the target drive, keep them
+        const WORD stepRateUs = wdc->getParams()->StepRateUs;
+        const BYTE formatGapSize = wdc->getParams()->FormatGapSize;
         memcpy(wdc->getParams(), &cbParams[0], sizeof(WD42C22::DiskDriveParams));
+        wdc->getParams()->StepRateUs = stepRateUs;
+        wdc->getParams()->FormatGapSize = formatGapSize;
         wdc->applyParams();
         
         if (wdc->getLastError())
@@ -1162,6 +1563,12 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
         delete[] cbSectorsTable;
         cbSectorsTable = NULL;
       }
+      if (cbTrackTimings)
+      {
+        delete[] cbTrackTimings;
+        cbTrackTimings = NULL;
+      }
+      cbTrackGap = 0;
       
       if (cbLastPos == 0) // LSB
       {
@@ -1197,6 +1604,8 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
     if (!cbHeadSpecified)
     {
       cbHead = data[packetIdx++];
+      cbTrackTimed = (cbHead & 0x80) != 0; // timing record follows the sector map
+      cbHead &= 0x7F;
       if (cbHead >= wdc->getParams()->Heads)
       {
         cbSuccess = false;
@@ -1253,6 +1662,29 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
         CHECK_STREAM_END;
       }
       
+      // timing record: index offset, then one interval per sector
+      if (cbTrackTimed)
+      {
+        if (!cbTrackTimings)
+        {
+          cbTrackTimings = new WORD[cbSpt+1];
+          if (!cbTrackTimings)
+          {
+            cbSuccess = false;
+            cbProgmemResponseStr = Progmem::uiFeMemory;
+            return false;
+          }
+        }
+        
+        BYTE* timingRecord = (BYTE*)cbTrackTimings;
+        while (cbLastPos < (WORD)cbSpt*4 + ((WORD)cbSpt+1)*2)
+        {
+          timingRecord[cbLastPos - (WORD)cbSpt*4] = data[packetIdx++];
+          cbLastPos++;
+          CHECK_STREAM_END;
+        }
+      }
+      
       cbLastPos = 0;
       cbSectorIdx = 0;
       cbSecMapSpecified = true;
@@ -1276,10 +1708,6 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
       // as this command requires a precise byte offset where to write the changes...      
       
       // inspect the first logical sector and verify the rest
-      wdc->sramBeginBufferAccess(true, 0);
-      wdc->sramWriteByteSequential(0);
-      wdc->sramWriteByteSequential((BYTE)(cbSectorsTable[0] >> 16));
-      
       for (WORD idx = 1; idx < cbSpt; idx++)
       {
         const BYTE thisSdh = (BYTE)(cbSectorsTable[idx] >> 24);        
@@ -1298,10 +1726,18 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
           cbProgmemResponseStr = Progmem::imgXmodemErrVar2;
           return false;
         }
-        
-        // create format interleave table, set good sectors and later in the datastream, find out which ones are bad
+      }
+      
+      // create format interleave table, set good sectors and later in the datastream, find out which ones are bad
+      // with a timing record, start from the sector that followed the index, and use the gap in between sectors
+      const BYTE firstIdx = CbTrackSkew();
+      cbTrackGap = CbTrackGap();
+      
+      wdc->sramBeginBufferAccess(true, 0);
+      for (WORD idx = 0; idx < cbSpt; idx++)
+      {
         wdc->sramWriteByteSequential(0);
-        wdc->sramWriteByteSequential((BYTE)(cbSectorsTable[idx] >> 16));
+        wdc->sramWriteByteSequential((BYTE)(cbSectorsTable[(firstIdx + idx) % cbSpt] >> 16));
       }
       wdc->sramFinishBufferAccess();
       
@@ -1314,7 +1750,7 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
       }
       
       // format
-      wdc->formatTrack(cbSpt, cbSecSizeBytes, &logicalCylinder, &logicalHead);
+      wdc->formatTrack(cbSpt, cbSecSizeBytes, &logicalCylinder, &logicalHead, cbTrackGap);
       
       // formatTrack can only fail with WDC timeout, drive not ready or write fault
       if (wdc->getLastError())
@@ -1329,7 +1765,7 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
     if (!cbSecDataTypeSpecified)
     {
       cbSectorDataType = data[packetIdx++];
-      if ((cbSectorDataType & 0x7F) > 2)
+      if (((cbSectorDataType & 0x7F) > 2) && (cbSectorDataType != 3))
       {
         cbSuccess = false;
         cbProgmemResponseStr = Progmem::imgXmodemErrSecTyp;
@@ -1358,7 +1794,7 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
         // already formatted empty...
         if (cbWriteImgBadSectorMode == 1) // also flag as bad?
         {
-          wdc->setBadSector(logicalSector, &logicalCylinder, &logicalHead);
+          wdc->setBadSector(logicalSector, &logicalCylinder, &logicalHead, cbTrackGap);
         }
         
         // continue with the next
@@ -1377,8 +1813,8 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
         bool doNotWrite = false; 
         bool formatBad = false;  
         
-        // contains CRC/ECC error?
-        if ((cbSectorDataType & 0x7F) == 2)
+        // contains CRC/ECC error? the check bytes of type 3 are not written back
+        if (((cbSectorDataType & 0x7F) == 2) || (cbSectorDataType == 3))
         { 
           if (cbWriteImgDataErrorsMode == 0)
           {
@@ -1423,13 +1859,14 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
           wdc->sramFinishBufferAccess();          
         }
         
-        // normal data
+        // normal data, and skip over the check bytes if any
         else
         {
-          while (cbLastPos != cbSecSizeBytes)
+          const WORD recordSize = cbSecSizeBytes + ((cbSectorDataType == 3) ? CbCheckBytesCount() : 0);
+          while (cbLastPos != recordSize)
           {
             BYTE byte = data[packetIdx++];
-            if (!doNotWrite)
+            if (!doNotWrite && (cbLastPos < cbSecSizeBytes))
             {
               wdc->sramWriteByteSequential(byte);
             }
@@ -1458,13 +1895,13 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
         // or format as bad
         if (formatBad)
         {
-          wdc->setBadSector(logicalSector, &logicalCylinder, &logicalHead);
+          wdc->setBadSector(logicalSector, &logicalCylinder, &logicalHead, cbTrackGap);
         }
         
         // count errors
         // we can't increment this at the doNotWrite setter above;
         // as multiple reentrancies due to CHECK_STREAM_END would cause false counts
-        if ((cbSectorDataType & 0x7F) == 2)
+        if (((cbSectorDataType & 0x7F) == 2) || (cbSectorDataType == 3))
         {
           cbTotalDataErrors++;
         }
@@ -1503,9 +1940,9 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
             packetIdx++;
             cbLastPos++;
           }
-          else // sector data follows
+          else // sector data follows, with check bytes if type 3
           {
-            while (cbLastPos != cbSecSizeBytes)
+            while (cbLastPos != cbSecSizeBytes + ((cbSectorDataType == 3) ? CbCheckBytesCount() : 0))
             {
               packetIdx++;              
               cbLastPos++;            
@@ -1544,7 +1981,7 @@ bool CbWriteDisk(DWORD packetNo, BYTE* data, WORD size)
 bool CbVerifyParamsFromImage()
 { 
   // assume error
-  BYTE backup = cbProgmemResponseStr;
+  WORD backup = cbProgmemResponseStr;
   cbProgmemResponseStr = Progmem::imgXmodemErrParams;
   
   // access loaded array as disk drive parameters POD
@@ -1568,7 +2005,8 @@ bool CbVerifyParamsFromImage()
       (params->RWCStartCyl > 2048) ||
       (params->LandingZone > 2048) || 
       (params->PartialImageStartCyl >= params->Cylinders) ||
-      (params->PartialImageEndCyl >= params->Cylinders))
+      (params->PartialImageEndCyl >= params->Cylinders) ||
+      (params->StepRateUs > 16383))
   {
     return false;
   }
@@ -9,6 +9,11 @@
 void CommandReadImage();
 void CommandWriteImage();
 
+// XMODEM serial I/O, also used by the DOS file transfers
+int  RX(int msDelay);
+void TX(const char *data, int size);
+
 bool IsSerialTransfer();
+void SetSerialTransfer(bool inProgress);
 void DumpSerialTransfer();
 
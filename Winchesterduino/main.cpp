@@ -14,9 +14,15 @@ void CommandAnalyze();
 void CommandHexdump();
 void CommandFormat();
 void CommandScan();
+void CommandSurfaceTest();
 void CommandShowParams();
 void CommandSeekTest();
+void CommandCalibrateSeek();
+void CommandBenchmark();
 void CommandPark();
+#if defined(DUAL_DRIVE) && (DUAL_DRIVE == 1)
+void CommandCopy();
+#endif
 // declared in image.h
 //void CommandReadImage();
 //void CommandWriteImage();
@@ -70,16 +76,19 @@ void MainLoop()
   }
    
   // main menu
-  char allowedKeys[11] = {0};
-  strcat(allowedKeys, "AHFMRWSI");
+  char allowedKeys[15] = {0};
+  strcat(allowedKeys, "AHFMURWSI");
   if (wdc->getParams()->Cylinders >= 10)
   {
-    strcat(allowedKeys, "D"); // offer seek test command
+    strcat(allowedKeys, "DTB"); // offer seek test, step rate calibration and benchmark commands
   }
   if (wdc->getParams()->UseLandingZone)
   {
     strcat(allowedKeys, "P"); // offer park command
   }
+#if defined(DUAL_DRIVE) && (DUAL_DRIVE == 1)
+  strcat(allowedKeys, "C");
+#endif
   
   for (;;)
   {
@@ -92,6 +101,7 @@ void MainLoop()
     ui->print(Progmem::getString(Progmem::optionHexdump));
     ui->print(Progmem::getString(Progmem::optionFormat));
     ui->print(Progmem::getString(Progmem::optionScan));
+    ui->print(Progmem::getString(Progmem::optionSurface));
     ui->print(Progmem::getString(Progmem::optionReadImage));
     ui->print(Progmem::getString(Progmem::optionWriteImage));
     ui->print(Progmem::getString(Progmem::optionShowParams));
@@ -99,11 +109,16 @@ void MainLoop()
     if (wdc->getParams()->Cylinders >= 10)
     {
       ui->print(Progmem::getString(Progmem::optionSeektest));
+      ui->print(Progmem::getString(Progmem::optionCalibrate));
+      ui->print(Progmem::getString(Progmem::optionBenchmark));
     }
     if (wdc->getParams()->UseLandingZone)
     {
       ui->print(Progmem::getString(Progmem::optionPark));
     }
+#if defined(DUAL_DRIVE) && (DUAL_DRIVE == 1)
+    ui->print(Progmem::getString(Progmem::optionCopy));
+#endif
     
     ui->print(Progmem::getString(Progmem::uiNewLine));
     ui->print(Progmem::getString(Progmem::uiChooseOption));
@@ -125,6 +140,9 @@ void MainLoop()
     case 'M':
       CommandScan();
       break;
+    case 'U':
+      CommandSurfaceTest();
+      break;
     case 'R':
       CommandReadImage();
       break;
@@ -140,9 +158,20 @@ void MainLoop()
     case 'D':
       CommandSeekTest();
       break;
+    case 'T':
+      CommandCalibrateSeek();
+      break;
+    case 'B':
+      CommandBenchmark();
+      break;
     case 'P':
       CommandPark();
       break;
+#if defined(DUAL_DRIVE) && (DUAL_DRIVE == 1)
+    case 'C':
+      CommandCopy();
+      break;
+#endif
     }
   }
 }
@@ -212,6 +241,36 @@ void SetupParameters()
     ui->print(Progmem::getString(Progmem::uiNewLine));
   }
   
+  // other drives stored, choose one of them
+  if (eepromProfileCount())
+  {
+    BYTE name[EEPROM_PROFILE_NAME];
+    for (BYTE index = 0; index < EEPROM_PROFILES_MAX; index++)
+    {
+      if (eepromGetProfileName(index, name))
+      {
+        ui->print(Progmem::getString(Progmem::uiSetupProfile), index + 1, name);
+      }
+    }
+    
+    ui->print(Progmem::getString(Progmem::uiSetupSelect));
+    const BYTE* selection = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInput));
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    
+    const BYTE index = (BYTE)atoi(selection);
+    if (strlen(selection) && index && eepromLoadProfile(index - 1))
+    {
+      // boots with it the next time
+      eepromSetDefaultProfile(index - 1);
+      ui->print(Progmem::getString(Progmem::uiSetupSaved));
+      CommandShowParams();
+      return;
+    }
+    
+    memset(wdc->getParams(), 0, sizeof(WD42C22::DiskDriveParams));
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }
+  
   // (re-)specify
   ui->print(Progmem::getString(Progmem::uiSetupParams));
   
@@ -362,6 +421,10 @@ void SetupParameters()
   wdc->getParams()->SlowSeek = (key == 'S');
   ui->print(Progmem::getString(Progmem::uiEchoKey), key);
   
+  // default step rate until calibrated, default gap until formatted otherwise
+  wdc->getParams()->StepRateUs = 0;
+  wdc->getParams()->FormatGapSize = 0;
+  
   // later for disk image purposes
   wdc->getParams()->PartialImage = false;
   wdc->getParams()->PartialImageStartCyl = 0;
@@ -373,11 +436,24 @@ void SetupParameters()
   ui->print(Progmem::getString(Progmem::uiEchoKey), key);
   if (key == 'Y')
   {
+    ui->print(Progmem::getString(Progmem::uiSetupAskName));
+    BYTE name[EEPROM_PROFILE_NAME] = {0};
+    strncpy(name, ui->prompt(EEPROM_PROFILE_NAME - 1), EEPROM_PROFILE_NAME - 1);
+    if (!strlen(name))
+    {
+      snprintf_P(name, sizeof(name), PSTR("%uC %uH"), wdc->getParams()->Cylinders, wdc->getParams()->Heads);
+    }
+    ui->print(Progmem::getString(Progmem::uiNewLine));
     ui->print(Progmem::getString(Progmem::uiOperationPending));
-        
-    eepromStoreConfiguration();
-        
-    ui->print(Progmem::getString(Progmem::uiOK));
+    
+    if (eepromStoreConfiguration(name))
+    {
+      ui->print(Progmem::getString(Progmem::uiOK));
+    }
+    else
+    {
+      ui->print(Progmem::getString(Progmem::uiSetupFull));
+    }
     ui->print(Progmem::getString(Progmem::uiNewLine));
   }
 }
@@ -497,6 +573,21 @@ void CommandAnalyze()
   bool sectorNumberings = (key == 'Y');
   ui->print(Progmem::getString(Progmem::uiEchoKey), key);
   
+  // and how far apart the sector IDs pass under the head?
+  bool sectorTimings = false;
+  if (sectorNumberings)
+  {
+    ui->print(Progmem::getString(Progmem::analyzePrintTiming));
+    key = toupper(ui->readKey("YN\e"));
+    if (key == '\e')
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    sectorTimings = (key == 'Y');
+    ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  }
+  
   bool diskNotEmpty = false;
   
   // warnings
@@ -663,6 +754,21 @@ void CommandAnalyze()
           continue;
         }
 
+        // intervals of each ID in the table, and the same in the order printed
+        WORD* intervals = NULL;
+        WORD* orderIntervals = NULL;
+        WORD longest = 0;
+        BYTE longestSector = 0;
+        if (sectorTimings)
+        {
+          intervals = MeasureSectorIntervals(sectorsTable, tableCount);
+          orderIntervals = new WORD[sectorsPerTrack];
+          if (!intervals || !orderIntervals)
+          {
+            ui->fatalError(Progmem::uiFeMemory);
+          }
+        }
+        
         ui->print(Progmem::getString(Progmem::analyzeSectorInfo5));
         
         WORD idx2 = 0;
@@ -677,6 +783,16 @@ void CommandAnalyze()
               continue;
             }
             
+            if (orderIntervals)
+            {
+              orderIntervals[idx2] = intervals[idx];
+              if (!idx2 || (intervals[idx] > orderIntervals[longest]))
+              {
+                longest = idx2;
+                longestSector = (BYTE)(sectorsTable[idx] >> 16);
+              }
+            }
+            
             currentSector = (BYTE)(sectorsTable[idx++] >> 16);            
             ui->print("%u ", currentSector);
             idx2++;
@@ -718,6 +834,35 @@ void CommandAnalyze()
             break;
           }
         }
+        
+        // timings in the same order, each one from the ID before it (the first one wraps around the track)
+        // the longest gap normally holds the index pulse, which does not reach the microcontroller
+        if (orderIntervals)
+        {
+          ui->print(Progmem::getString(Progmem::analyzeSectorInfo6));
+          
+          DWORD rotation = 0;
+          for (WORD order = 0; order < idx2; order++)
+          {
+            if (!orderIntervals[order])
+            {
+              rotation = 0;
+              ui->print("? ");
+              break;
+            }
+            
+            ui->print("%u ", orderIntervals[order]);
+            rotation += orderIntervals[order];
+          }
+          
+          if (rotation && (idx2 == sectorsPerTrack))
+          {
+            ui->print(Progmem::getString(Progmem::analyzeSectorInfo7), rotation, longestSector);
+          }
+          
+          delete[] orderIntervals;
+          delete[] intervals;
+        }
       }      
                 
       delete[] sectorsTable;
@@ -911,7 +1056,7 @@ void CommandHexdump()
     // print out checksum bytes
     if (longMode)
     {     
-      BYTE polynomialStr = 0;
+      WORD polynomialStr = 0;
       BYTE checksumLength = 0;      
       
       switch(wdc->getParams()->DataVerifyMode)
@@ -961,284 +1106,448 @@ void CommandHexdump()
   }
 }
 
-void CommandFormat()
+// interleaves tried by the optimizer, 1:1 up to this or the sectors per track
+#define OPTIMIZE_MAX_INTERLEAVE 8
+
+// format the given cylinder with each interleave and time reading all of its sectors in order, the same way the
+// DOS glue does (sector read, then copied from the buffer to memory); returns the fastest interleave, or 0 on error
+BYTE OptimizeInterleave(WORD cylinder, BYTE sectorsPerTrack, WORD sectorSizeBytes, BYTE startSector, BYTE gapSize)
 {
-  ui->print(Progmem::getString(Progmem::formatWarning));
-  ui->print(Progmem::getString(Progmem::uiEscGoBack));
-  ui->print(Progmem::getString(Progmem::uiNewLine));
+  BYTE* buffer = new BYTE[sectorSizeBytes];
+  if (!buffer)
+  {
+    ui->fatalError(Progmem::uiFeMemory);
+    return 0;
+  }
   
-  // start and end cylinder
-  WORD startCylinder = 0;
+  ui->print(Progmem::getString(Progmem::formatOptimize), cylinder);
   
-  if (wdc->getParams()->Cylinders > 1)
+  BYTE best = 0;
+  DWORD bestRate = 0;
+  const BYTE maxInterleave = (sectorsPerTrack < OPTIMIZE_MAX_INTERLEAVE) ? sectorsPerTrack : OPTIMIZE_MAX_INTERLEAVE;
+  for (BYTE interleave = 1; interleave <= maxInterleave; interleave++)
   {
-    while(true)
+    DWORD bytes = 0;
+    DWORD elapsed = 0;
+    
+    for (BYTE head = 0; head < wdc->getParams()->Heads; head++)
     {
-      ui->print(Progmem::getString(Progmem::uiChooseStartCyl), 0, wdc->getParams()->Cylinders-1);
-      const BYTE* prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
-      if (!prompt)
+      wdc->prepareFormatInterleave(sectorsPerTrack, interleave, startSector);
+      wdc->seekDrive(cylinder, head);
+      wdc->formatTrack(sectorsPerTrack, sectorSizeBytes, NULL, NULL, gapSize);
+      if (wdc->getLastError())
       {
         ui->print(Progmem::getString(Progmem::uiNewLine));
-        return;
-      }
-      startCylinder = (WORD)atoi(prompt);
-      if (startCylinder < wdc->getParams()->Cylinders)
-      {  
-        if (!startCylinder && !strlen(ui->getPromptBuffer())) ui->print("0");
+        ui->print(Progmem::getString(wdc->getLastErrorMessage()));
         ui->print(Progmem::getString(Progmem::uiNewLine));
-        break;
+        delete[] buffer;
+        return 0;
       }
+    }
+    
+    for (BYTE head = 0; head < wdc->getParams()->Heads; head++)
+    {
+      wdc->seekDrive(cylinder, head);
       
-      ui->print(Progmem::getString(Progmem::uiDeleteLine));
-    }  
-  }  
+      const DWORD start = micros();
+      for (BYTE idx = 0; idx < sectorsPerTrack; idx++)
+      {
+        wdc->readSector(startSector + idx, sectorSizeBytes);
+        if (wdc->getLastError() && (wdc->getLastError() < 4))
+        {
+          ui->print(Progmem::getString(Progmem::uiNewLine));
+          ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+          ui->print(Progmem::getString(Progmem::uiNewLine));
+          delete[] buffer;
+          return 0;
+        }
+        
+        wdc->sramReadBuffer(buffer, 0, sectorSizeBytes);
+        bytes += sectorSizeBytes;
+      }
+      elapsed += micros() - start;
+    }
+    
+    // bytes per second, in KB/s with one decimal place
+    const DWORD rate = (bytes * 1000UL) / (elapsed / 1000UL + 1);
+    ui->print(Progmem::getString(Progmem::formatOptimizeRate), interleave, rate / 1024, ((rate % 1024) * 10) / 1024);
+    if (rate > bestRate)
+    {
+      bestRate = rate;
+      best = interleave;
+    }
+  }
   
-  WORD endCylinder = wdc->getParams()->Cylinders-1;
-  if (startCylinder != endCylinder)
+  delete[] buffer;
+  return best;
+}
+
+// samples taken for each skew measurement, the fastest one is used
+#define SKEW_SAMPLES 8
+
+// shortest time of one revolution on the current track, microseconds; 0 if no sector IDs
+DWORD MeasureRotation()
+{
+  WORD dummy;
+  BYTE first;
+  BYTE sdh;
+  wdc->scanID(dummy, first, sdh);
+  if (wdc->getLastError())
   {
-    while(true)
+    return 0;
+  }
+  
+  DWORD fastest = 0xFFFFFFFFUL;
+  DWORD start = micros();
+  for (BYTE revolutions = 0; revolutions < SKEW_SAMPLES;)
+  {
+    BYTE sector;
+    wdc->scanID(dummy, sector, sdh);
+    if (wdc->getLastError())
     {
-      ui->print(Progmem::getString(Progmem::uiChooseEndCyl), startCylinder, wdc->getParams()->Cylinders-1);
-      const BYTE* prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
-      if (!prompt)
+      return 0;
+    }
+    
+    if (sector == first)
+    {
+      const DWORD now = micros();
+      if ((now - start) < fastest)
       {
-        ui->print(Progmem::getString(Progmem::uiNewLine));
-        return;
-      }
-      endCylinder = (WORD)atoi(prompt);
-      if ((endCylinder >= startCylinder) && (endCylinder < wdc->getParams()->Cylinders))
-      {  
-        if (!endCylinder && !strlen(ui->getPromptBuffer())) ui->print("0");
-        ui->print(Progmem::getString(Progmem::uiNewLine));
-        break;
+        fastest = now - start;
       }
       
-      ui->print(Progmem::getString(Progmem::uiDeleteLine));
-    }  
+      start = now;
+      revolutions++;
+    }
   }
   
-  // SPT
-  BYTE sectorsPerTrack = 1;
-  while(true)
+  return fastest;
+}
+
+// how many sectors fly by from the end of reading a sector, until the next ID can be read after switching
+// to another head or cylinder; 0xFF on error
+BYTE MeasureSwitchSectors(WORD cylinder, BYTE head, BYTE sector, WORD sectorSizeBytes,
+                          WORD toCylinder, BYTE toHead, DWORD sectorTime)
+{
+  DWORD fastest = 0xFFFFFFFFUL;
+  for (BYTE sample = 0; sample < SKEW_SAMPLES; sample++)
   {
-    ui->print(Progmem::getString(Progmem::formatSpt), 1, 63);
-    const BYTE* prompt = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInputEsc), true);
-    if (!prompt)
+    wdc->seekDrive(cylinder, head);
+    wdc->readSector(sector, sectorSizeBytes);
+    if (wdc->getLastError() && (wdc->getLastError() < 4))
     {
-      ui->print(Progmem::getString(Progmem::uiNewLine));
-      return;
+      return 0xFF;
     }
-    sectorsPerTrack = (BYTE)atoi(prompt);
-    if ((sectorsPerTrack > 0) && (sectorsPerTrack <= 63))
+    
+    const DWORD start = micros();
+    wdc->seekDrive(toCylinder, toHead);
+    
+    WORD dummy;
+    BYTE dummy2;
+    BYTE dummy3;
+    wdc->scanID(dummy, dummy2, dummy3);
+    if (wdc->getLastError())
     {
-      ui->print(Progmem::getString(Progmem::uiNewLine));
-      break;
+      return 0xFF;
     }
     
-    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+    if ((micros() - start) < fastest)
+    {
+      fastest = micros() - start;
+    }
   }
   
-  // sector size
-  WORD sectorSizeBytes = 0;  
-  ui->print(Progmem::getString(Progmem::uiChooseSecSize));
-  BYTE key = toupper(ui->readKey("125K\e"));
-  switch(key)
+  // rounded up to whole sectors
+  const DWORD sectors = (fastest + sectorTime - 1) / sectorTime;
+  return (sectors < 0xFF) ? (BYTE)sectors : 0xFE;
+}
+
+// format the first cylinder of the range (and head 0 of the next one, if in range) without skew, and derive
+// the head and cylinder skew from the measured head switch and single step times; false on error
+bool MeasureSkew(WORD cylinder, bool useNextCylinder, BYTE sectorsPerTrack, WORD sectorSizeBytes,
+                 BYTE interleave, BYTE startSector, BYTE gapSize, BYTE& headSkew, BYTE& cylinderSkew)
+{
+  headSkew = 0;
+  cylinderSkew = 0;
+  ui->print(Progmem::getString(Progmem::formatSkewMeasure), cylinder);
+  
+  const BYTE heads = wdc->getParams()->Heads;
+  for (WORD track = 0; track < (WORD)(heads + (useNextCylinder ? 1 : 0)); track++)
   {
-    case '1':
-      sectorSizeBytes = 128;
-      break;
-    case '2':
-      sectorSizeBytes = 256;
-      break;
-    case '5':
-      sectorSizeBytes = 512;
-      break;
-    case 'K':
-      sectorSizeBytes = 1024;
-      break;
-    case '\e':
+    wdc->prepareFormatInterleave(sectorsPerTrack, interleave, startSector);
+    wdc->seekDrive((track < heads) ? cylinder : cylinder + 1, (track < heads) ? (BYTE)track : 0);
+    wdc->formatTrack(sectorsPerTrack, sectorSizeBytes, NULL, NULL, gapSize);
+    if (wdc->getLastError())
+    {
       ui->print(Progmem::getString(Progmem::uiNewLine));
-      return;
+      ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return false;
+    }
   }
-  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
   
-  // format interleave
-  BYTE interleave = 1;
-  while(true)
+  // physical position of the last logical sector, from the format table still in the buffer
+  BYTE lastIndex = 0;
+  BYTE lastSector = 0;
+  wdc->sramBeginBufferAccess(false, 0);
+  for (BYTE idx = 0; idx < sectorsPerTrack; idx++)
   {
-    ui->print(Progmem::getString(Progmem::formatInterleave));
-    const BYTE* prompt = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInputEsc), true);
-    if (!prompt)
+    wdc->sramReadByteSequential();
+    const BYTE sector = wdc->sramReadByteSequential();
+    if (!idx || (sector > lastSector))
     {
-      ui->print(Progmem::getString(Progmem::uiNewLine));
-      return;
+      lastSector = sector;
+      lastIndex = idx;
     }
-    interleave = (BYTE)atoi(prompt);
-    if (interleave > 0)
+  }
+  wdc->sramFinishBufferAccess();
+  
+  wdc->seekDrive(cylinder, 0);
+  const DWORD sectorTime = MeasureRotation() / sectorsPerTrack;
+  if (!sectorTime)
+  {
+    ui->print(Progmem::getString(Progmem::calibrateNoID), cylinder);
+    return false;
+  }
+  
+  // the first sector of the next track goes right where the heads are, once ready after the last one of this track
+  if (heads > 1)
+  {
+    const BYTE sectors = MeasureSwitchSectors(cylinder, 0, lastSector, sectorSizeBytes, cylinder, 1, sectorTime);
+    if (sectors == 0xFF)
     {
-      ui->print(Progmem::getString(Progmem::uiNewLine));
-      break;
+      ui->print(Progmem::getString(Progmem::calibrateNoID), cylinder);
+      return false;
     }
-    
-    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+    headSkew = (BYTE)((lastIndex + 1 + sectors) % sectorsPerTrack);
   }
   
-  // starting sector
-  WORD startSector = 0;
-  while(true)
+  if (useNextCylinder)
   {
-    ui->print(Progmem::getString(Progmem::formatStartSector), 256-sectorsPerTrack);
-    const BYTE* prompt = ui->prompt(3, Progmem::getString(Progmem::uiDecimalInputEsc), true);
-    if (!prompt)
+    const BYTE sectors = MeasureSwitchSectors(cylinder, heads - 1, lastSector, sectorSizeBytes, cylinder + 1, 0, sectorTime);
+    if (sectors == 0xFF)
     {
-      ui->print(Progmem::getString(Progmem::uiNewLine));
-      return;
+      ui->print(Progmem::getString(Progmem::calibrateNoID), cylinder + 1);
+      return false;
+    }
+    cylinderSkew = (BYTE)((lastIndex + 1 + sectors) % sectorsPerTrack);
+  }
+  
+  ui->print(Progmem::getString(Progmem::formatSkewResult), headSkew, cylinderSkew);
+  return true;
+}
+
+// capacity planner: zones of the format range, the smallest gap tried, and the safety margin given back to it
+#define PLAN_ZONES      4
+#define PLAN_MIN_GAP    5
+#define PLAN_GAP_MARGIN 3
+
+// format and verify all heads of the given cylinder, false if any of the tracks did not verify;
+// fatal is set on a WDC timeout, drive not ready or write fault (the message is printed)
+bool PlanTestCylinder(WORD cylinder, BYTE sectorsPerTrack, WORD sectorSizeBytes, BYTE gapSize, bool& fatal)
+{
+  fatal = false;
+  for (BYTE head = 0; head < wdc->getParams()->Heads; head++)
+  {
+    wdc->prepareFormatInterleave(sectorsPerTrack, 1);
+    wdc->seekDrive(cylinder, head);
+    wdc->formatTrack(sectorsPerTrack, sectorSizeBytes, NULL, NULL, gapSize);
+    if (!wdc->getLastError())
+    {
+      wdc->verifyTrack(sectorsPerTrack, sectorSizeBytes);
     }
     
-    if (strlen(prompt))
+    if (wdc->getLastError())
     {
-      startSector = (WORD)atoi(prompt);
-      if (startSector <= 256-sectorsPerTrack)
+      if (wdc->getLastError() < 4)
       {
         ui->print(Progmem::getString(Progmem::uiNewLine));
-        break;
+        ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        fatal = true;
       }
-    }    
-   
-    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+      return false;
+    }
   }
-   
-  // format with verify
-  ui->print(Progmem::getString(Progmem::formatVerify));
-  key = toupper(ui->readKey("YN\e"));
-  if (key == '\e')
+  
+  return true;
+}
+
+// for each zone of the range, find the most sectors per track that still verify, shrinking the gap in between sectors
+// (tested on the last, innermost cylinder of the zone), then settle on a geometry the whole range can use:
+// the DOS glue and PC BIOSes need the same sectors per track everywhere; false on error
+bool PlanFormat(WORD startCylinder, WORD endCylinder, WORD sectorSizeBytes, BYTE& sectorsPerTrack, BYTE& gapSize)
+{
+  const BYTE defaultGap = wdc->getDefaultGapSize(sectorSizeBytes);
+  
+  // start from the usual 17 (MFM) or 26 (RLL) sectors of 512 bytes, scaled to the sector size
+  WORD nominal = (WORD)((wdc->getParams()->UseRLL ? 26UL : 17UL) * 512 / sectorSizeBytes);
+  if (nominal > 63)
   {
-    ui->print(Progmem::getString(Progmem::uiNewLine));
-    return;
+    nominal = 63;
   }
-  bool withVerify = (key == 'Y');
-  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
   
-  // mark bad blocks
-  bool formatBadBlocks = false;
-  if (withVerify)
+  sectorsPerTrack = 0;
+  gapSize = 0;
+  
+  const WORD cylinders = endCylinder - startCylinder + 1;
+  const BYTE zones = (cylinders < PLAN_ZONES) ? (BYTE)cylinders : PLAN_ZONES;
+  for (BYTE zone = 0; zone < zones; zone++)
   {
-    ui->print(Progmem::getString(Progmem::formatBadBlocks));
-    key = toupper(ui->readKey("YN\e"));
-    if (key == '\e')
+    const WORD zoneStart = startCylinder + (WORD)((DWORD)cylinders * zone / zones);
+    const WORD zoneEnd = startCylinder + (WORD)((DWORD)cylinders * (zone + 1) / zones) - 1;
+    ui->print(Progmem::getString(Progmem::planZone), zoneStart, zoneEnd);
+    
+    // the nominal geometry with the default gap, or less sectors if even that does not fit
+    bool fatal;
+    BYTE spt = (BYTE)nominal;
+    while (!PlanTestCylinder(zoneEnd, spt, sectorSizeBytes, defaultGap, fatal))
     {
-      ui->print(Progmem::getString(Progmem::uiNewLine));
-      return;
+      if (fatal)
+      {
+        return false;
+      }
+      if (!--spt)
+      {
+        ui->print(Progmem::getString(Progmem::planUnusable));
+        return false;
+      }
     }
-    formatBadBlocks = (key == 'Y');
-    ui->print(Progmem::getString(Progmem::uiEchoKey), key);  
-  }
-  
-  BYTE badBlocksCount = 0;
-  
-  // format
-  ui->print(Progmem::getString(Progmem::uiNewLine));  
-  for (WORD cylinder = startCylinder; cylinder <= endCylinder; cylinder++)
-  {
-    // for all heads
-    BYTE head = 0;
-    while (head < wdc->getParams()->Heads)
-    {   
-      ui->print(Progmem::getString(Progmem::formatProgress), cylinder, head);
-      
-      wdc->prepareFormatInterleave(sectorsPerTrack, interleave, startSector);
-      wdc->seekDrive(cylinder, head);      
-      wdc->formatTrack(sectorsPerTrack, sectorSizeBytes);
-      
-      // formatTrack can only fail with WDC timeout, drive not ready or write fault
-      if (wdc->getLastError())
+    
+    // one more sector each time it fits, otherwise shorten the gap and try again
+    BYTE gap = defaultGap;
+    BYTE zoneGap = defaultGap;
+    while (spt < 63)
+    {
+      if (PlanTestCylinder(zoneEnd, spt + 1, sectorSizeBytes, gap, fatal))
       {
-        ui->print(Progmem::getString(Progmem::uiNewLine2x));
-        ui->print(Progmem::getString(wdc->getLastErrorMessage()));
-        ui->print(Progmem::getString(Progmem::uiNewLine));
-        return;
+        spt++;
+        zoneGap = gap;
+        ui->print(Progmem::getString(Progmem::planTrying), spt, gap);
+        continue;
+      }
+      if (fatal)
+      {
+        return false;
       }
       
-      // with verify?
-      if (withVerify)
+      if (gap <= PLAN_MIN_GAP)
       {
-        badBlocksCount = 0;
-
-        wdc->verifyTrack(sectorsPerTrack, sectorSizeBytes, startSector);
-        if (wdc->getLastError())
-        {
-          // WDC timeout, drive not ready, writefault - abort the command
-          if (wdc->getLastError() < 4)
-          {  
-            ui->print(Progmem::getString(Progmem::uiNewLine2x));
-            ui->print(Progmem::getString(wdc->getLastErrorMessage()));
-            ui->print(Progmem::getString(Progmem::uiNewLine));
-            return;        
-          }
-          
-          // adjust which range sectors to check, depending on the starting sector
-          WORD endSector = sectorsPerTrack;
-          if (startSector == 0)
-          {
-            endSector--;
-          }
-          else if (startSector > 1)
-          {
-            endSector += startSector-1;
-          }
-          
-          // fall back to single sector reads to determine which failed
-          for (WORD sector = startSector; sector <= endSector; sector++)
-          {
-            wdc->readSector(sector, sectorSizeBytes); 
-            
-            if (wdc->getLastError())
-            {
-              if (wdc->getLastError() < 4)
-              {  
-                ui->print(Progmem::getString(Progmem::uiNewLine2x));
-                ui->print(Progmem::getString(wdc->getLastErrorMessage()));
-                ui->print(Progmem::getString(Progmem::uiNewLine));
-                return;        
-              }
-              
-              // prepend CHS information
-              ui->print(Progmem::getString(Progmem::uiCHSInfo), cylinder, head, sector);
-              ui->print(Progmem::getString(wdc->getLastErrorMessage()));
-              
-              // mark sector as bad
-              if (formatBadBlocks)
-              {
-                wdc->setBadSector(sector);
-              }
-              badBlocksCount++;
-            }
-          }
-        }
-        
-        if (badBlocksCount)
-        {
-          ui->print(Progmem::getString(Progmem::uiNewLine));
-        }
+        break;
       }
+      gap--;
+    }
+    
+    // safety margin: a geometry that only fits with a shortened gap gives up one sector, for a longer gap
+    // to absorb motor speed variations when sectors get rewritten
+    if (zoneGap < defaultGap)
+    {
+      spt--;
+      zoneGap = ((zoneGap + PLAN_GAP_MARGIN) < defaultGap) ? (zoneGap + PLAN_GAP_MARGIN) : defaultGap;
+    }
+    ui->print(Progmem::getString(Progmem::planResult), spt, zoneGap);
+    
+    // the zone fitting the least sectors determines the geometry, with its gap
+    if (!sectorsPerTrack || (spt < sectorsPerTrack) || ((spt == sectorsPerTrack) && (zoneGap < gapSize)))
+    {
+      sectorsPerTrack = spt;
+      gapSize = zoneGap;
+    }
+    
+    if (ui->readKey("\e", false) == '\e')
+    {
+      return false;
+    }
+  }
+  
+  return true;
+}
 
-      head++;
-    }    
+// BisectVerify() results
+#define BISECT_GOOD  0
+#define BISECT_BAD   1
+#define BISECT_FATAL 2 // WDC timeout, drive not ready or write fault
+
+// failing sectors found by BisectVerify(), with their error codes and Progmem messages, and WDC commands issued
+struct BisectResult
+{
+  BYTE Count;
+  BYTE Sectors[64];
+  BYTE Errors[64];
+  WORD Messages[64];
+  WORD Commands;
+};
+
+// locate the failing sectors of a range of consecutive logical sectors: verify the first half,
+// recurse into the failing halves, and read single sectors only at the end
+// knownBad: the range as a whole already failed a verify, so if its first half is good, the second one is not
+BYTE BisectVerify(BYTE firstSector, BYTE count, bool knownBad, WORD sectorSizeBytes,
+                  WORD* overrideCyl, BYTE* overrideHead, BisectResult& result)
+{
+  if (count == 1)
+  {
+    wdc->readSector(firstSector, sectorSizeBytes, false, overrideCyl, overrideHead);
+    result.Commands++;
+    
+    const BYTE error = wdc->getLastError();
+    if (!error)
+    {
+      return BISECT_GOOD;
+    }
+    if (error < 4)
+    {
+      return BISECT_FATAL;
+    }
+    
+    if (result.Count < sizeof(result.Sectors))
+    {
+      result.Sectors[result.Count] = firstSector;
+      result.Errors[result.Count] = error;
+      result.Messages[result.Count] = wdc->getLastErrorMessage();
+      result.Count++;
+    }
+    return BISECT_BAD;
   }
-   
-  ui->print(Progmem::getString(Progmem::formatComplete));  
+  
+  if (!knownBad)
+  {
+    wdc->verifyTrack(count, sectorSizeBytes, firstSector, overrideCyl, overrideHead);
+    result.Commands++;
+    
+    if (!wdc->getLastError())
+    {
+      return BISECT_GOOD;
+    }
+    if (wdc->getLastError() < 4)
+    {
+      return BISECT_FATAL;
+    }
+  }
+  
+  const BYTE half = count / 2;
+  const BYTE first = BisectVerify(firstSector, half, false, sectorSizeBytes, overrideCyl, overrideHead, result);
+  if (first == BISECT_FATAL)
+  {
+    return BISECT_FATAL;
+  }
+  
+  if (BisectVerify(firstSector + half, count - half, first == BISECT_GOOD, sectorSizeBytes, overrideCyl, overrideHead, result) == BISECT_FATAL)
+  {
+    return BISECT_FATAL;
+  }
+  
+  return BISECT_BAD;
 }
 
-void CommandScan()
+void CommandFormat()
 {
-  ui->print(Progmem::getString(Progmem::scanWarning1));
-  ui->print(Progmem::getString(Progmem::scanWarning2));
-  ui->print(Progmem::getString(Progmem::scanWarning3));
+  ui->print(Progmem::getString(Progmem::formatWarning));
   ui->print(Progmem::getString(Progmem::uiEscGoBack));
   ui->print(Progmem::getString(Progmem::uiNewLine));
   
   // start and end cylinder
   WORD startCylinder = 0;
+  
   if (wdc->getParams()->Cylinders > 1)
   {
     while(true)
@@ -1286,409 +1595,2040 @@ void CommandScan()
     }  
   }
   
-  bool marginalSectorsAsBad = true;
-  if (wdc->getParams()->DataVerifyMode != MODE_CRC_16BIT)
+  // SPT, 0: plan for the most capacity
+  BYTE sectorsPerTrack = 1;
+  while(true)
   {
-    ui->print(Progmem::getString(Progmem::scanMarginal));
-    BYTE key = toupper(ui->readKey("YN\e"));
-    if (key == '\e')
+    ui->print(Progmem::getString(Progmem::formatSpt), 1, 63);
+    const BYTE* prompt = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+    if (!prompt)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    sectorsPerTrack = (BYTE)atoi(prompt);
+    if (((sectorsPerTrack > 0) && (sectorsPerTrack <= 63)) || (!sectorsPerTrack && strlen(prompt)))
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      break;
+    }
+    
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  }
+  
+  // sector size
+  WORD sectorSizeBytes = 0;  
+  ui->print(Progmem::getString(Progmem::uiChooseSecSize));
+  BYTE key = toupper(ui->readKey("125K\e"));
+  switch(key)
+  {
+    case '1':
+      sectorSizeBytes = 128;
+      break;
+    case '2':
+      sectorSizeBytes = 256;
+      break;
+    case '5':
+      sectorSizeBytes = 512;
+      break;
+    case 'K':
+      sectorSizeBytes = 1024;
+      break;
+    case '\e':
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+  }
+  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  
+  // search the geometry on test cylinders of the range (formatted anyway)
+  BYTE gapSize = 0; // default
+  if (!sectorsPerTrack)
+  {
+    if (!PlanFormat(startCylinder, endCylinder, sectorSizeBytes, sectorsPerTrack, gapSize))
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    
+    ui->print(Progmem::getString(Progmem::planAskFormat), sectorsPerTrack, gapSize);
+    key = toupper(ui->readKey("YN\e"));
+    if (key != 'Y')
     {
       ui->print(Progmem::getString(Progmem::uiNewLine));
       return;
     }
-    marginalSectorsAsBad = (key == 'Y');
     ui->print(Progmem::getString(Progmem::uiEchoKey), key);
   }
   
-  DWORD existingBadBlocks = 0;
-  DWORD unreadableTracks = 0;
-  DWORD dataErrors = 0;
-  ui->print(Progmem::getString(Progmem::uiNewLine));
-   
-  for (WORD cylinder = startCylinder; cylinder <= endCylinder; cylinder++)
+  // format interleave, 0: measure the fastest one
+  BYTE interleave = 1;
+  while(true)
   {
-    ui->print(Progmem::getString(Progmem::scanProgress), cylinder);
+    ui->print(Progmem::getString(Progmem::formatInterleave));
+    const BYTE* prompt = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+    if (!prompt)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    interleave = (BYTE)atoi(prompt);
+    if ((interleave > 0) || strlen(prompt))
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      break;
+    }
     
-    BYTE head = 0;
-    while (head < wdc->getParams()->Heads)
-    {   
-      wdc->seekDrive(cylinder, head);
-
-      BYTE sdh;
-      BYTE attempts = 5;      
-      while (attempts)
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  }
+  
+  // starting sector
+  WORD startSector = 0;
+  while(true)
+  {
+    ui->print(Progmem::getString(Progmem::formatStartSector), 256-sectorsPerTrack);
+    const BYTE* prompt = ui->prompt(3, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+    if (!prompt)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    
+    if (strlen(prompt))
+    {
+      startSector = (WORD)atoi(prompt);
+      if (startSector <= 256-sectorsPerTrack)
       {
-        WORD dummy;
-        BYTE dummy2;        
-        wdc->scanID(dummy, dummy2, sdh);
-        
-        if (wdc->getLastError())
-        {
-          if (wdc->getLastError() < 4)
-          {
-            ui->print(Progmem::getString(Progmem::uiNewLine));
-            ui->print(Progmem::getString(wdc->getLastErrorMessage()));
-            ui->print(Progmem::getString(Progmem::uiNewLine));
-            return;        
-          }
-          
-          attempts--;
-        }
-        else
-        {
-          break;
-        }
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        break;
       }
+    }    
+   
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  }
+  
+  // skew of the first sector in between tracks, so that sequential reads do not lose a revolution
+  // when switching heads or stepping to the next cylinder; Enter: measure both
+  BYTE headSkew = 0;
+  BYTE cylinderSkew = 0;
+  bool measureSkew = false;
+  while(true)
+  {
+    ui->print(Progmem::getString(Progmem::formatHeadSkew), sectorsPerTrack-1);
+    const BYTE* prompt = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+    if (!prompt)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    
+    measureSkew = !strlen(prompt);
+    headSkew = (BYTE)atoi(prompt);
+    if (headSkew < sectorsPerTrack)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      break;
+    }
+    
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  }
+  
+  while(!measureSkew)
+  {
+    ui->print(Progmem::getString(Progmem::formatCylinderSkew), sectorsPerTrack-1);
+    const BYTE* prompt = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+    if (!prompt)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    
+    cylinderSkew = (BYTE)atoi(prompt);
+    if (strlen(prompt) && (cylinderSkew < sectorsPerTrack))
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      break;
+    }
+    
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  }
+  
+  // try the interleaves on the first cylinder of the range (formatted anyway), and offer the fastest
+  if (!interleave)
+  {
+    interleave = OptimizeInterleave(startCylinder, sectorsPerTrack, sectorSizeBytes, startSector, gapSize);
+    if (!interleave)
+    {
+      return;
+    }
+    
+    ui->print(Progmem::getString(Progmem::formatOptimizeBest), interleave);
+    key = toupper(ui->readKey("YN\e"));
+    if (key != 'Y')
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  }
+  
+  // from the head switch and single step times, with the interleave to use
+  if (measureSkew &&
+      !MeasureSkew(startCylinder, endCylinder > startCylinder, sectorsPerTrack, sectorSizeBytes,
+                   interleave, startSector, gapSize, headSkew, cylinderSkew))
+  {
+    return;
+  }
+   
+  // format with verify
+  ui->print(Progmem::getString(Progmem::formatVerify));
+  key = toupper(ui->readKey("YN\e"));
+  if (key == '\e')
+  {
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return;
+  }
+  bool withVerify = (key == 'Y');
+  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  
+  // mark bad blocks
+  bool formatBadBlocks = false;
+  if (withVerify)
+  {
+    ui->print(Progmem::getString(Progmem::formatBadBlocks));
+    key = toupper(ui->readKey("YN\e"));
+    if (key == '\e')
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    formatBadBlocks = (key == 'Y');
+    ui->print(Progmem::getString(Progmem::uiEchoKey), key);  
+  }
+  
+  BYTE badBlocksCount = 0;
+  
+  // keep the gap in the profile: marking bad sectors (here, with Scan, or the surface test) needs it later
+  if (wdc->getParams()->FormatGapSize != gapSize)
+  {
+    wdc->getParams()->FormatGapSize = gapSize;
+    eepromUpdateDefaultProfile();
+  }
+  
+  // format
+  ui->print(Progmem::getString(Progmem::uiNewLine));  
+  for (WORD cylinder = startCylinder; cylinder <= endCylinder; cylinder++)
+  {
+    // for all heads
+    BYTE head = 0;
+    while (head < wdc->getParams()->Heads)
+    {   
+      // step there while the progress is printed and the format table is prepared in the buffer
+      wdc->beginSeek(cylinder, head);
+      ui->print(Progmem::getString(Progmem::formatProgress), cylinder, head);
       
-      if (!attempts)
-      {
-        unreadableTracks++;
-        head++;
-        continue;
-      }   
-      
-      bool dummy;      
-      WORD tableCount = 0;
-      BYTE sectorsPerTrack = 0;
-      DWORD* sectorsTable = CalculateSectorsPerTrack(sdh, sectorsPerTrack, tableCount,
-                                                     dummy, dummy, dummy);
-      if (!sectorsPerTrack)
+      // the first sector moves on by the head skew each head, and by the cylinder skew from the last head to the next cylinder
+      const BYTE heads = wdc->getParams()->Heads;
+      const BYTE skew = (BYTE)(((DWORD)cylinder * ((heads - 1) * headSkew + cylinderSkew) + head * headSkew) % sectorsPerTrack);
+      wdc->prepareFormatInterleave(sectorsPerTrack, interleave, startSector, NULL, skew);
+      wdc->finishSeek();
+      wdc->formatTrack(sectorsPerTrack, sectorSizeBytes, NULL, NULL, gapSize);
+      
+      // formatTrack can only fail with WDC timeout, drive not ready or write fault
+      if (wdc->getLastError())
       {
-        unreadableTracks++;
-        if (sectorsTable)
-        {
-          delete[] sectorsTable;
-        }
-        
-        head++;
-        continue;
+        ui->print(Progmem::getString(Progmem::uiNewLine2x));
+        ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        return;
       }
       
-      WORD trySectorSize = wdc->getSectorSizeFromSDH(sdh);
-            
-      // try whole track with uniform sector size
-      wdc->verifyTrack(sectorsPerTrack, trySectorSize);      
+      // the track is new, forget its defects
+      eepromRemoveDefects(cylinder, head);
       
-      if (wdc->getLastError())
+      // with verify?
+      if (withVerify)
       {
-        if (wdc->getLastError() < 4)
-        {  
-          ui->print(Progmem::getString(Progmem::uiNewLine2x));
-          ui->print(Progmem::getString(wdc->getLastErrorMessage()));
-          ui->print(Progmem::getString(Progmem::uiNewLine));
-          delete[] sectorsTable;
-          return;        
-        }
-                
-        for (BYTE sector = 0; sector < sectorsPerTrack; sector++)
+        badBlocksCount = 0;
+
+        wdc->verifyTrack(sectorsPerTrack, sectorSizeBytes, startSector);
+        if (wdc->getLastError())
         {
-          if (sectorsTable[sector] == 0xFFFFFFFFUL)
+          // WDC timeout, drive not ready, writefault - abort the command
+          if (wdc->getLastError() < 4)
+          {  
+            ui->print(Progmem::getString(Progmem::uiNewLine2x));
+            ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+            ui->print(Progmem::getString(Progmem::uiNewLine));
+            return;        
+          }
+          
+          // fall back to verifying halves of the track to determine which failed, single sector reads only at the end
+          BisectResult result;
+          memset(&result, 0, sizeof(result));
+          if (BisectVerify((BYTE)startSector, sectorsPerTrack, true, sectorSizeBytes, NULL, NULL, result) == BISECT_FATAL)
           {
-            continue;
+            ui->print(Progmem::getString(Progmem::uiNewLine2x));
+            ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+            ui->print(Progmem::getString(Progmem::uiNewLine));
+            return;
           }
           
-          const BYTE sdh2 = (BYTE)(sectorsTable[sector] >> 24);
-          trySectorSize = wdc->getSectorSizeFromSDH(sdh2);        
+          for (BYTE idx = 0; idx < result.Count; idx++)
+          {
+            // prepend CHS information
+            ui->print(Progmem::getString(Progmem::uiCHSInfo), cylinder, head, result.Sectors[idx]);
+            ui->print(Progmem::getString(result.Messages[idx]));
+            
+            eepromAddDefect(cylinder, head, result.Sectors[idx]);
+          }
+          badBlocksCount = result.Count;
           
-          const BYTE logicalSector = (BYTE)(sectorsTable[sector] >> 16);
-          const WORD logicalCylinder = (WORD)sectorsTable[sector];
-          const BYTE logicalHead = sdh2 & 0xF;        
-        
-          // single sector with variable sector size
-          wdc->readSector(logicalSector, trySectorSize, false, &logicalCylinder, &logicalHead);
-          BYTE error = wdc->getLastError();
-          if ((error == WDC_CORRECTED) && !marginalSectorsAsBad)
+          // mark them bad, all at once
+          if (formatBadBlocks && badBlocksCount)
           {
-            error = WDC_OK; // cancel off error flag
+            wdc->setBadSectors(result.Sectors, badBlocksCount, NULL, NULL, gapSize);
           }
           
-          if (error)
+          if (badBlocksCount)
           {
-            if (error < 4)
-            {  
-              ui->print(Progmem::getString(Progmem::uiNewLine2x));
-              ui->print(Progmem::getString(wdc->getLastErrorMessage()));
-              ui->print(Progmem::getString(Progmem::uiNewLine));
-              delete[] sectorsTable;
-              return;        
-            }
-            
-            if ((error == WDC_DATAERROR) || (error == WDC_CORRECTED))
-            {
-              dataErrors++;
-              
-              // write ID as bad sector
-              wdc->setBadSector(logicalSector, &logicalCylinder, &logicalHead);
-            }
-            
-            else
-            {
-              existingBadBlocks++;
-            }
+            ui->print(Progmem::getString(Progmem::verifyCommands), result.Commands + 1); // and the whole track verify
           }
         }
-      }        
         
-      delete[] sectorsTable;     
+        if (badBlocksCount)
+        {
+          ui->print(Progmem::getString(Progmem::uiNewLine));
+        }
+      }
+
       head++;
     }    
   }
-
-  ui->print(Progmem::getString(Progmem::uiNewLine2x));
-  
-  // results
-  ui->print(Progmem::getString(Progmem::imgBadTracks), unreadableTracks);
-  ui->print(Progmem::getString(Progmem::imgBadBlocksKnown), existingBadBlocks);
-  ui->print(Progmem::getString(Progmem::imgDataErrorsConv), dataErrors);
-  
+   
+  ui->print(Progmem::getString(Progmem::formatComplete));  
 }
 
-void CommandShowParams()
+void CommandScan()
 {
-  ui->print(Progmem::getString(Progmem::uiShowDataMode));
-  ui->print(wdc->getParams()->UseRLL ? "RLL" : "MFM");
+  ui->print(Progmem::getString(Progmem::scanWarning1));
+  ui->print(Progmem::getString(Progmem::scanWarning2));
+  ui->print(Progmem::getString(Progmem::scanWarning3));
+  ui->print(Progmem::getString(Progmem::uiEscGoBack));
+  ui->print(Progmem::getString(Progmem::uiNewLine));
   
-  ui->print(Progmem::getString(Progmem::uiShowVerifyMode));
-  switch(wdc->getParams()->DataVerifyMode)
+  // start and end cylinder
+  WORD startCylinder = 0;
+  if (wdc->getParams()->Cylinders > 1)
   {
-  case MODE_CRC_16BIT:
-    ui->print(Progmem::getString(Progmem::uiShowVerifyCRC));
-    break;
-  case MODE_ECC_32BIT:
-    ui->print(Progmem::getString(Progmem::uiShowVerifyECC));
-    break;
-  case MODE_ECC_56BIT:
-    ui->print(Progmem::getString(Progmem::uiShowVerifyECC56));
-    break;
-  }
-  
-  ui->print(Progmem::getString(Progmem::uiShowCylinders), wdc->getParams()->Cylinders);    
-  ui->print(Progmem::getString(Progmem::uiShowHeads), wdc->getParams()->Heads);
+    while(true)
+    {
+      ui->print(Progmem::getString(Progmem::uiChooseStartCyl), 0, wdc->getParams()->Cylinders-1);
+      const BYTE* prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+      if (!prompt)
+      {
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        return;
+      }
+      startCylinder = (WORD)atoi(prompt);
+      if (startCylinder < wdc->getParams()->Cylinders)
+      {  
+        if (!startCylinder && !strlen(ui->getPromptBuffer())) ui->print("0");
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        break;
+      }
+      
+      ui->print(Progmem::getString(Progmem::uiDeleteLine));
+    }  
+  }  
   
-  ui->print(Progmem::getString(Progmem::uiShowRWC));
-  if (wdc->getParams()->UseReduceWriteCurrent)
-  {
+  WORD endCylinder = wdc->getParams()->Cylinders-1;
+  if (startCylinder != endCylinder)
+  {
+    while(true)
+    {
+      ui->print(Progmem::getString(Progmem::uiChooseEndCyl), startCylinder, wdc->getParams()->Cylinders-1);
+      const BYTE* prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+      if (!prompt)
+      {
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        return;
+      }
+      endCylinder = (WORD)atoi(prompt);
+      if ((endCylinder >= startCylinder) && (endCylinder < wdc->getParams()->Cylinders))
+      {  
+        if (!endCylinder && !strlen(ui->getPromptBuffer())) ui->print("0");
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        break;
+      }
+      
+      ui->print(Progmem::getString(Progmem::uiDeleteLine));
+    }  
+  }
+  
+  bool marginalSectorsAsBad = true;
+  if (wdc->getParams()->DataVerifyMode != MODE_CRC_16BIT)
+  {
+    ui->print(Progmem::getString(Progmem::scanMarginal));
+    BYTE key = toupper(ui->readKey("YN\e"));
+    if (key == '\e')
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    marginalSectorsAsBad = (key == 'Y');
+    ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  }
+  
+  DWORD existingBadBlocks = 0;
+  DWORD unreadableTracks = 0;
+  DWORD dataErrors = 0;
+  DWORD locateCommands = 0;
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+   
+  for (WORD cylinder = startCylinder; cylinder <= endCylinder; cylinder++)
+  {
+    ui->print(Progmem::getString(Progmem::scanProgress), cylinder);
+    
+    BYTE head = 0;
+    while (head < wdc->getParams()->Heads)
+    {   
+      wdc->seekDrive(cylinder, head);
+
+      BYTE sdh;
+      BYTE attempts = 5;      
+      while (attempts)
+      {
+        WORD dummy;
+        BYTE dummy2;        
+        wdc->scanID(dummy, dummy2, sdh);
+        
+        if (wdc->getLastError())
+        {
+          if (wdc->getLastError() < 4)
+          {
+            ui->print(Progmem::getString(Progmem::uiNewLine));
+            ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+            ui->print(Progmem::getString(Progmem::uiNewLine));
+            return;        
+          }
+          
+          attempts--;
+        }
+        else
+        {
+          break;
+        }
+      }
+      
+      if (!attempts)
+      {
+        unreadableTracks++;
+        head++;
+        continue;
+      }   
+      
+      bool dummy;      
+      WORD tableCount = 0;
+      BYTE sectorsPerTrack = 0;
+      DWORD* sectorsTable = CalculateSectorsPerTrack(sdh, sectorsPerTrack, tableCount,
+                                                     dummy, dummy, dummy);
+      if (!sectorsPerTrack)
+      {
+        unreadableTracks++;
+        if (sectorsTable)
+        {
+          delete[] sectorsTable;
+        }
+        
+        head++;
+        continue;
+      }
+      
+      WORD trySectorSize = wdc->getSectorSizeFromSDH(sdh);
+            
+      // try whole track with uniform sector size
+      wdc->verifyTrack(sectorsPerTrack, trySectorSize);      
+      
+      if (wdc->getLastError())
+      {
+        if (wdc->getLastError() < 4)
+        {  
+          ui->print(Progmem::getString(Progmem::uiNewLine2x));
+          ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+          ui->print(Progmem::getString(Progmem::uiNewLine));
+          delete[] sectorsTable;
+          return;        
+        }
+        
+        // track with consecutive sectors of one size and logical cylinder and head: locate the failed ones by bisecting
+        bool uniform = true;
+        BYTE lowestSector = 0xFF;
+        BYTE highestSector = 0;
+        BYTE validCount = 0;
+        WORD uniformCylinder = 0;
+        BYTE uniformHead = 0;
+        for (BYTE sector = 0; sector < sectorsPerTrack; sector++)
+        {
+          if (sectorsTable[sector] == 0xFFFFFFFFUL)
+          {
+            continue;
+          }
+          
+          const BYTE sdh2 = (BYTE)(sectorsTable[sector] >> 24);
+          const BYTE logicalSector = (BYTE)(sectorsTable[sector] >> 16);
+          if (!validCount)
+          {
+            uniformCylinder = (WORD)sectorsTable[sector];
+            uniformHead = sdh2 & 0xF;
+          }
+          else if ((wdc->getSectorSizeFromSDH(sdh2) != trySectorSize) ||
+                   ((WORD)sectorsTable[sector] != uniformCylinder) || ((sdh2 & 0xF) != uniformHead))
+          {
+            uniform = false;
+            break;
+          }
+          
+          lowestSector = (logicalSector < lowestSector) ? logicalSector : lowestSector;
+          highestSector = (logicalSector > highestSector) ? logicalSector : highestSector;
+          validCount++;
+        }
+        uniform = uniform && validCount && (highestSector - lowestSector + 1 == validCount);
+        
+        BisectResult result;
+        memset(&result, 0, sizeof(result));
+        if (uniform)
+        {
+          // the whole track verify above covered the same range, so it's known to fail
+          const bool knownBad = (lowestSector == 1) && (validCount == sectorsPerTrack) &&
+                                (uniformCylinder == cylinder) && (uniformHead == head);
+          
+          if (BisectVerify(lowestSector, validCount, knownBad, trySectorSize, &uniformCylinder, &uniformHead, result) == BISECT_FATAL)
+          {
+            ui->print(Progmem::getString(Progmem::uiNewLine2x));
+            ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+            ui->print(Progmem::getString(Progmem::uiNewLine));
+            delete[] sectorsTable;
+            return;
+          }
+          
+          locateCommands += result.Commands;
+        }
+        
+        // data errors to be marked bad, all at once after the track is read; batched if on the same logical cylinder and head
+        BYTE badSectors[64];
+        BYTE badCount = 0;
+        WORD badCylinder = 0;
+        BYTE badHead = 0;
+                
+        for (BYTE sector = 0; sector < sectorsPerTrack; sector++)
+        {
+          if (sectorsTable[sector] == 0xFFFFFFFFUL)
+          {
+            continue;
+          }
+          
+          const BYTE sdh2 = (BYTE)(sectorsTable[sector] >> 24);
+          trySectorSize = wdc->getSectorSizeFromSDH(sdh2);        
+          
+          const BYTE logicalSector = (BYTE)(sectorsTable[sector] >> 16);
+          const WORD logicalCylinder = (WORD)sectorsTable[sector];
+          const BYTE logicalHead = sdh2 & 0xF;        
+        
+          BYTE error = WDC_OK;
+          if (uniform)
+          {
+            // already read by bisecting, if it failed
+            for (BYTE idx = 0; idx < result.Count; idx++)
+            {
+              if (result.Sectors[idx] == logicalSector)
+              {
+                error = result.Errors[idx];
+                break;
+              }
+            }
+          }
+          else
+          {
+            // single sector with variable sector size
+            wdc->readSector(logicalSector, trySectorSize, false, &logicalCylinder, &logicalHead);
+            error = wdc->getLastError();
+            locateCommands++;
+          }
+          
+          if ((error == WDC_CORRECTED) && !marginalSectorsAsBad)
+          {
+            error = WDC_OK; // cancel off error flag
+          }
+          
+          if (error)
+          {
+            if (error < 4)
+            {  
+              ui->print(Progmem::getString(Progmem::uiNewLine2x));
+              ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+              ui->print(Progmem::getString(Progmem::uiNewLine));
+              delete[] sectorsTable;
+              return;        
+            }
+            
+            if ((error == WDC_DATAERROR) || (error == WDC_CORRECTED))
+            {
+              dataErrors++;
+              
+              // write ID as bad sector
+              if (!badCount || ((badCylinder == logicalCylinder) && (badHead == logicalHead) && (badCount < sizeof(badSectors))))
+              {
+                badSectors[badCount++] = logicalSector;
+                badCylinder = logicalCylinder;
+                badHead = logicalHead;
+              }
+              else
+              {
+                wdc->setBadSector(logicalSector, &logicalCylinder, &logicalHead);
+              }
+            }
+            
+            else
+            {
+              existingBadBlocks++;
+            }
+            
+            eepromAddDefect(logicalCylinder, logicalHead, logicalSector);
+          }
+        }
+        
+        if (badCount)
+        {
+          wdc->setBadSectors(badSectors, badCount, &badCylinder, &badHead);
+        }
+      }        
+        
+      delete[] sectorsTable;     
+      head++;
+    }    
+  }
+
+  ui->print(Progmem::getString(Progmem::uiNewLine2x));
+  
+  // results
+  ui->print(Progmem::getString(Progmem::imgBadTracks), unreadableTracks);
+  ui->print(Progmem::getString(Progmem::imgBadBlocksKnown), existingBadBlocks);
+  ui->print(Progmem::getString(Progmem::imgDataErrorsConv), dataErrors);
+  ui->print(Progmem::getString(Progmem::scanDefectList), eepromDefectCount());
+  ui->print(Progmem::getString(Progmem::scanCommands), locateCommands);
+  
+}
+
+// surface test patterns, bit mask of those selected
+#define SURFACE_6DB6       0 // MFM/RLL worst case
+#define SURFACE_A5         1
+#define SURFACE_INCREMENT  2
+#define SURFACE_RANDOM     3 // xorshift, seeded per track
+#define SURFACE_PATTERNS   4
+
+// status of a tested sector besides the WDC error codes
+#define SURFACE_MISCOMPARE 0xFF
+
+// pattern byte at index, state only used and advanced by the random pattern
+BYTE SurfacePatternByte(BYTE pattern, WORD index, DWORD& state)
+{
+  static const BYTE worstCase[3] = {0x6D, 0xB6, 0xDB};
+  
+  switch (pattern)
+  {
+  case SURFACE_6DB6:
+    return worstCase[index % 3];
+  case SURFACE_A5:
+    return 0xA5;
+  case SURFACE_INCREMENT:
+    return (BYTE)index;
+  }
+  
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return (BYTE)state;
+}
+
+// random pattern state of a track; the other patterns ignore it
+DWORD SurfacePatternSeed(WORD seed, WORD cylinder, BYTE head)
+{
+  const DWORD state = (((DWORD)seed << 16) | ((DWORD)cylinder << 4) | head) ^ 0x2545F491UL;
+  return state ? state : 1;
+}
+
+// the same pattern goes into every sector of the track, so it is written into the buffer once
+void SurfaceFillBuffer(BYTE pattern, DWORD state, WORD sectorSizeBytes)
+{
+  wdc->sramBeginBufferAccess(true, 0);
+  for (WORD index = 0; index < sectorSizeBytes; index++)
+  {
+    wdc->sramWriteByteSequential(SurfacePatternByte(pattern, index, state));
+  }
+  wdc->sramFinishBufferAccess();
+}
+
+// byte compare of a sector read back into the buffer at bufferOffset
+bool SurfaceCompareBuffer(BYTE pattern, DWORD state, WORD sectorSizeBytes, WORD bufferOffset)
+{
+  bool match = true;
+  wdc->sramBeginBufferAccess(false, bufferOffset);
+  for (WORD index = 0; index < sectorSizeBytes; index++)
+  {
+    if (wdc->sramReadByteSequential() != SurfacePatternByte(pattern, index, state))
+    {
+      match = false;
+      break;
+    }
+  }
+  wdc->sramFinishBufferAccess();
+  return match;
+}
+
+// write the pattern in the buffer over the whole current track, then read the sectors back and compare
+// the reads are issued one right after another, as many as fit the buffer (below the ECC area at 2032),
+// and compared only after each batch: a compare in between would let the next sector pass by on a 1:1 track
+// status, messages: per sector, error code and its Progmem message; only a corrected sector is tested again
+// returns false on WDC timeout, drive not ready or write fault
+bool SurfaceTestPattern(BYTE pattern, DWORD state, BYTE firstSector, BYTE sectorsPerTrack, WORD sectorSizeBytes,
+                        BYTE* status, WORD* messages)
+{
+  for (BYTE idx = 0; idx < sectorsPerTrack; idx++)
+  {
+    if (status[idx] && (status[idx] != WDC_CORRECTED))
+    {
+      continue; // not worth retesting
+    }
+    
+    wdc->writeSector(firstSector + idx, sectorSizeBytes);
+    if (wdc->getLastError())
+    {
+      if (wdc->getLastError() < 4)
+      {
+        return false;
+      }
+      
+      status[idx] = wdc->getLastError();
+      messages[idx] = wdc->getLastErrorMessage();
+    }
+  }
+  
+  // the buffer holds the pattern until the first read
+  const BYTE batch = 2032 / sectorSizeBytes;
+  BYTE idx = 0;
+  while (idx < sectorsPerTrack)
+  {
+    BYTE batchSectors[2032 / 128]; // status index of each buffer region read into
+    BYTE count = 0;
+    
+    for (; (idx < sectorsPerTrack) && (count < batch); idx++)
+    {
+      if (status[idx] && (status[idx] != WDC_CORRECTED))
+      {
+        continue;
+      }
+      
+      wdc->readSector(firstSector + idx, sectorSizeBytes, false, NULL, NULL, count * sectorSizeBytes);
+      const BYTE error = wdc->getLastError();
+      if (error && (error < 4))
+      {
+        return false;
+      }
+      
+      if (error)
+      {
+        status[idx] = error;
+        messages[idx] = wdc->getLastErrorMessage();
+      }
+      
+      // corrected data is compared as well
+      if (!error || (error == WDC_CORRECTED))
+      {
+        batchSectors[count++] = idx;
+      }
+    }
+    
+    for (BYTE region = 0; region < count; region++)
+    {
+      if (!SurfaceCompareBuffer(pattern, state, sectorSizeBytes, region * sectorSizeBytes))
+      {
+        status[batchSectors[region]] = SURFACE_MISCOMPARE;
+        messages[batchSectors[region]] = Progmem::surfaceMismatch;
+      }
+    }
+  }
+  
+  return true;
+}
+
+void CommandSurfaceTest()
+{
+  ui->print(Progmem::getString(Progmem::surfaceWarning));
+  ui->print(Progmem::getString(Progmem::uiEscGoBack));
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  
+  // start and end cylinder
+  WORD startCylinder = 0;
+  if (wdc->getParams()->Cylinders > 1)
+  {
+    while(true)
+    {
+      ui->print(Progmem::getString(Progmem::uiChooseStartCyl), 0, wdc->getParams()->Cylinders-1);
+      const BYTE* prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+      if (!prompt)
+      {
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        return;
+      }
+      startCylinder = (WORD)atoi(prompt);
+      if (startCylinder < wdc->getParams()->Cylinders)
+      {  
+        if (!startCylinder && !strlen(ui->getPromptBuffer())) ui->print("0");
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        break;
+      }
+      
+      ui->print(Progmem::getString(Progmem::uiDeleteLine));
+    }  
+  }  
+  
+  WORD endCylinder = wdc->getParams()->Cylinders-1;
+  if (startCylinder != endCylinder)
+  {
+    while(true)
+    {
+      ui->print(Progmem::getString(Progmem::uiChooseEndCyl), startCylinder, wdc->getParams()->Cylinders-1);
+      const BYTE* prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+      if (!prompt)
+      {
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        return;
+      }
+      endCylinder = (WORD)atoi(prompt);
+      if ((endCylinder >= startCylinder) && (endCylinder < wdc->getParams()->Cylinders))
+      {  
+        if (!endCylinder && !strlen(ui->getPromptBuffer())) ui->print("0");
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        break;
+      }
+      
+      ui->print(Progmem::getString(Progmem::uiDeleteLine));
+    }  
+  }
+  
+  // patterns
+  ui->print(Progmem::getString(Progmem::surfacePattern));
+  BYTE key = toupper(ui->readKey("1234A\e"));
+  if (key == '\e')
+  {
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return;
+  }
+  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  const BYTE patterns = (key == 'A') ? ((1 << SURFACE_PATTERNS) - 1) : (1 << (key - '1'));
+  
+  WORD seed = 0;
+  if (patterns & (1 << SURFACE_RANDOM))
+  {
+    ui->print(Progmem::getString(Progmem::surfaceSeed));
+    const BYTE* prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+    if (!prompt)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    seed = (WORD)atoi(prompt);
+    if (!seed && !strlen(ui->getPromptBuffer())) ui->print("0");
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }
+  
+  bool marginalSectorsAsBad = true;
+  if (wdc->getParams()->DataVerifyMode != MODE_CRC_16BIT)
+  {
+    ui->print(Progmem::getString(Progmem::scanMarginal));
+    key = toupper(ui->readKey("YN\e"));
+    if (key == '\e')
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    marginalSectorsAsBad = (key == 'Y');
+    ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  }
+  
+  ui->print(Progmem::getString(Progmem::surfaceMarkBad));
+  key = toupper(ui->readKey("YN\e"));
+  if (key == '\e')
+  {
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return;
+  }
+  const bool markBad = (key == 'Y');
+  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  
+  // the whole range is tested with the layout found on its first track, logical CHS same as physical
+  wdc->seekDrive(startCylinder, 0);
+  BYTE sdh = 0;
+  for (BYTE attempts = 0; attempts < 5; attempts++)
+  {
+    WORD dummy;
+    BYTE dummy2;
+    wdc->scanID(dummy, dummy2, sdh);
+    if (!wdc->getLastError() || (wdc->getLastError() < 4))
+    {
+      break;
+    }
+  }
+  if (wdc->getLastError())
+  {
+    if (wdc->getLastError() < 4)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+    }
+    else
+    {
+      ui->print(Progmem::getString(Progmem::surfaceNoLayout), startCylinder);
+    }
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return;
+  }
+  
+  bool dummy;
+  WORD tableCount = 0;
+  BYTE sectorsPerTrack = 0;
+  DWORD* sectorsTable = CalculateSectorsPerTrack(sdh, sectorsPerTrack, tableCount, dummy, dummy, dummy);
+  BYTE firstSector = 0xFF;
+  for (WORD index = 0; index < tableCount; index++)
+  {
+    if (sectorsTable[index] != 0xFFFFFFFFUL)
+    {
+      const BYTE sector = (BYTE)(sectorsTable[index] >> 16);
+      firstSector = (sector < firstSector) ? sector : firstSector;
+    }
+  }
+  if (sectorsTable)
+  {
+    delete[] sectorsTable;
+  }
+  if (!sectorsPerTrack || (sectorsPerTrack > 64))
+  {
+    ui->print(Progmem::getString(Progmem::surfaceNoLayout), startCylinder);
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return;
+  }
+  
+  const WORD sectorSizeBytes = wdc->getSectorSizeFromSDH(sdh);
+  ui->print(Progmem::getString(Progmem::surfaceLayout), sectorsPerTrack, sectorSizeBytes, firstSector);
+  ui->print(Progmem::getString(Progmem::surfaceEscStop));
+  
+  DWORD existingBadBlocks = 0;
+  DWORD unreadableSectors = 0;
+  DWORD correctedErrors = 0;
+  DWORD miscompares = 0;
+  DWORD dataErrors = 0;
+  DWORD markedBad = 0;
+  bool aborted = false;
+  
+  for (WORD cylinder = startCylinder; (cylinder <= endCylinder) && !aborted; cylinder++)
+  {
+    for (BYTE head = 0; head < wdc->getParams()->Heads; head++)
+    {
+      BYTE status[64] = {0};
+      WORD messages[64];
+      
+      // step there while the progress is printed and the first pattern is put into the buffer
+      wdc->beginSeek(cylinder, head);
+      ui->print(Progmem::getString(Progmem::surfaceProgress), cylinder, head);
+      
+      bool filled = false;
+      for (BYTE pattern = 0; pattern < SURFACE_PATTERNS; pattern++)
+      {
+        if (!(patterns & (1 << pattern)))
+        {
+          continue;
+        }
+        
+        const DWORD state = SurfacePatternSeed(seed, cylinder, head);
+        SurfaceFillBuffer(pattern, state, sectorSizeBytes);
+        if (!filled)
+        {
+          wdc->finishSeek();
+          filled = true;
+        }
+        
+        if (!SurfaceTestPattern(pattern, state, firstSector, sectorsPerTrack, sectorSizeBytes, status, messages))
+        {
+          ui->print(Progmem::getString(Progmem::uiNewLine2x));
+          ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+          ui->print(Progmem::getString(Progmem::uiNewLine));
+          return;
+        }
+      }
+      
+      // tally the track and mark its failing sectors bad, all at once
+      BYTE badSectors[64];
+      BYTE badCount = 0;
+      bool reported = false;
+      for (BYTE idx = 0; idx < sectorsPerTrack; idx++)
+      {
+        const BYTE sector = firstSector + idx;
+        bool markSector = true;
+        
+        switch (status[idx])
+        {
+        case WDC_OK:
+          continue;
+        case WDC_BADBLOCK:
+          existingBadBlocks++;
+          continue;
+        case WDC_NOADDRMARK:
+        case WDC_NOSECTORID:
+          unreadableSectors++;
+          markSector = false; // no ID to mark
+          break;
+        case WDC_CORRECTED:
+          correctedErrors++;
+          if (!marginalSectorsAsBad)
+          {
+            continue;
+          }
+          break;
+        case SURFACE_MISCOMPARE:
+          miscompares++;
+          break;
+        default:
+          dataErrors++;
+          break;
+        }
+        
+        // prepend CHS information
+        ui->print(Progmem::getString(Progmem::uiCHSInfo), cylinder, head, sector);
+        ui->print(Progmem::getString(messages[idx]));
+        eepromAddDefect(cylinder, head, sector);
+        reported = true;
+        
+        if (markBad && markSector)
+        {
+          badSectors[badCount++] = sector;
+        }
+      }
+      
+      if (badCount)
+      {
+        wdc->setBadSectors(badSectors, badCount);
+        if (wdc->getLastError() && (wdc->getLastError() < 4))
+        {
+          ui->print(Progmem::getString(Progmem::uiNewLine2x));
+          ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+          ui->print(Progmem::getString(Progmem::uiNewLine));
+          return;
+        }
+        markedBad += badCount;
+      }
+      
+      if (reported)
+      {
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+      }
+      
+      if (ui->readKey("\e", false) == '\e')
+      {
+        aborted = true;
+        break;
+      }
+    }
+  }
+  
+  ui->print(Progmem::getString(Progmem::uiNewLine2x));
+  
+  // results
+  ui->print(Progmem::getString(Progmem::imgBadBlocksKnown), existingBadBlocks);
+  ui->print(Progmem::getString(Progmem::surfaceUnreadable), unreadableSectors);
+  ui->print(Progmem::getString(Progmem::imgDataCorrected), correctedErrors);
+  ui->print(Progmem::getString(Progmem::surfaceMiscompares), miscompares);
+  ui->print(Progmem::getString(Progmem::imgDataErrors), dataErrors);
+  ui->print(Progmem::getString(Progmem::surfaceMarked), markedBad);
+  ui->print(Progmem::getString(Progmem::scanDefectList), eepromDefectCount());
+}
+
+void CommandShowParams()
+{
+  ui->print(Progmem::getString(Progmem::uiShowDataMode));
+  ui->print(wdc->getParams()->UseRLL ? "RLL" : "MFM");
+  
+  ui->print(Progmem::getString(Progmem::uiShowVerifyMode));
+  switch(wdc->getParams()->DataVerifyMode)
+  {
+  case MODE_CRC_16BIT:
+    ui->print(Progmem::getString(Progmem::uiShowVerifyCRC));
+    break;
+  case MODE_ECC_32BIT:
+    ui->print(Progmem::getString(Progmem::uiShowVerifyECC));
+    break;
+  case MODE_ECC_56BIT:
+    ui->print(Progmem::getString(Progmem::uiShowVerifyECC56));
+    break;
+  }
+  
+  ui->print(Progmem::getString(Progmem::uiShowCylinders), wdc->getParams()->Cylinders);    
+  ui->print(Progmem::getString(Progmem::uiShowHeads), wdc->getParams()->Heads);
+  
+  ui->print(Progmem::getString(Progmem::uiShowRWC));
+  if (wdc->getParams()->UseReduceWriteCurrent)
+  {
     ui->print(Progmem::getString(Progmem::uiEnabled));
     ui->print(Progmem::getString(Progmem::uiShowFromCyl), wdc->getParams()->RWCStartCyl);
   }
-  else
+  else
+  {
+    ui->print(Progmem::getString(Progmem::uiDisabled));
+  }
+  
+  ui->print(Progmem::getString(Progmem::uiShowPrecomp));
+  if (wdc->getParams()->UseWritePrecomp)
+  {
+    ui->print(Progmem::getString(Progmem::uiEnabled));
+    ui->print(Progmem::getString(Progmem::uiShowFromCyl), wdc->getParams()->WritePrecompStartCyl);
+  }
+  else
+  {
+    ui->print(Progmem::getString(Progmem::uiDisabled));
+  }
+  
+  ui->print(Progmem::getString(Progmem::uiShowLZStatus));
+  if (wdc->getParams()->UseLandingZone)
+  {
+    ui->print(Progmem::getString(Progmem::uiNo));
+    ui->print(Progmem::getString(Progmem::uiShowLZ), wdc->getParams()->LandingZone); 
+  }
+  else
+  {
+    ui->print(Progmem::getString(Progmem::uiYes));
+  }
+  
+  ui->print(Progmem::getString(Progmem::uiShowSeekMode));
+  ui->print(Progmem::getString(wdc->getParams()->SlowSeek ? Progmem::uiShowSeekSlow : Progmem::uiShowSeekFast));
+  if (wdc->getParams()->StepRateUs)
+  {
+    ui->print(Progmem::getString(Progmem::uiShowStepRate), wdc->getParams()->StepRateUs);
+  }
+  if (wdc->getParams()->FormatGapSize)
+  {
+    ui->print(Progmem::getString(Progmem::uiShowFormatGap), wdc->getParams()->FormatGapSize);
+  }
+}
+
+void CommandSeekTest()
+{
+  ui->print(Progmem::getString(Progmem::uiEscGoBack));
+  if (wdc->getParams()->SlowSeek)
+  {
+    ui->print(Progmem::getString(Progmem::seektestLegacy));
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }
+  
+  // start and end cylinder
+  WORD startCylinder = 0;  
+  BYTE* prompt = NULL;
+
+  while(true)
+  {
+    ui->print(Progmem::getString(Progmem::uiChooseStartCyl), 0, wdc->getParams()->Cylinders-5);
+    prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+    if (!prompt)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    startCylinder = (WORD)atoi(prompt);
+    if (startCylinder <= wdc->getParams()->Cylinders-5)
+    {  
+      if (!startCylinder && !strlen(ui->getPromptBuffer())) ui->print("0");
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      break;
+    }
+    
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  }  
+
+  WORD endCylinder = wdc->getParams()->Cylinders-1;
+  if (startCylinder+5 < endCylinder)
+  {
+    while(true)
+    {
+      ui->print(Progmem::getString(Progmem::uiChooseEndCyl), startCylinder+5, wdc->getParams()->Cylinders-1);
+      prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+      if (!prompt)
+      {
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        return;
+      }
+      endCylinder = (WORD)atoi(prompt);
+      if ((endCylinder >= startCylinder+5) && (endCylinder < wdc->getParams()->Cylinders))
+      {  
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        break;
+      }
+      
+      ui->print(Progmem::getString(Progmem::uiDeleteLine));
+    }  
+  }
+  
+  // test repetitions for back and forth moves, butterfly tests and random seeks
+  const char input[] = ": ";
+  const char ellipsis[] = "...";
+  ui->print(Progmem::getString(Progmem::seektestRepeats));
+  
+  WORD backForthTests = 0;
+  ui->print(Progmem::getString(Progmem::seektestBackForth));
+  ui->print(input);
+  prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+  if (!prompt)
+  {
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return;
+  }
+  backForthTests = (WORD)atoi(prompt);
+  if (!backForthTests && !strlen(ui->getPromptBuffer())) ui->print("0");
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  
+  // full butterfly tests offered on buffered seek only
+  WORD butterflyTests = 0;
+  if (!wdc->getParams()->SlowSeek)
+  {
+    ui->print(Progmem::getString(Progmem::seektestButterfly));
+    ui->print(input);
+    prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+    if (!prompt)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return;
+    }
+    butterflyTests = (WORD)atoi(prompt);
+    if (!butterflyTests && !strlen(ui->getPromptBuffer())) ui->print("0");
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }
+  
+  WORD randomTests = 0;
+  ui->print(Progmem::getString(Progmem::seektestRandom));
+  ui->print(input);
+  prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+  if (!prompt)
+  {
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+    return;
+  }
+  randomTests = (WORD)atoi(prompt);
+  if (!randomTests && !strlen(ui->getPromptBuffer())) ui->print("0");
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  
+  // nothing selected
+  if (!backForthTests && !butterflyTests && !randomTests)
+  {
+    return;
+  }
+  
+  WORD count;
+  ui->print(Progmem::getString(Progmem::seektestProgress), startCylinder, endCylinder);
+  
+  // back and forth tests (seekDrive on error halts execution)
+  if (backForthTests)
+  {
+    ui->print(Progmem::getString(Progmem::seektestBackForth));
+    ui->print(ellipsis);
+    
+    for (count = 0; count < backForthTests; count++)
+    {
+      wdc->seekDrive(endCylinder, 0);
+      wdc->seekDrive(startCylinder, 0);
+    }
+    
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }
+  
+  // butterfly tests
+  if (butterflyTests)
+  {
+    ui->print(Progmem::getString(Progmem::seektestButterfly));
+    ui->print(ellipsis);
+    
+    for (count = 0; count < butterflyTests; count++)
+    {
+      WORD start = startCylinder;
+      WORD end = endCylinder;
+      WORD count2 = end-start + 1;
+      
+      while (count2--)
+      {
+        wdc->seekDrive(start++, 0);
+        wdc->seekDrive(end--, 0);        
+      }
+    }
+    
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }
+  
+  // random
+  if (randomTests)
+  {
+    ui->print(Progmem::getString(Progmem::seektestRandom));
+    ui->print(ellipsis);
+    
+    for (count = 0; count < randomTests; count++)
+    {
+      wdc->seekDrive(random(startCylinder, endCylinder+1), 0);
+    }
+    
+    ui->print(Progmem::getString(Progmem::uiNewLine));
+  }  
+}
+
+// head step rates to try, in microseconds from the slowest
+const WORD calibrateRates[] PROGMEM = {3000, 2000, 1500, 1000, 700, 500, 300, 200, 100, 50, 30, 20, 10, 5, 3, 2, 1};
+
+// seek from cylinder 0 to the given one and back, at the step rate set;
+// true if the heads arrived over the expected sector IDs and back at track 0
+bool CalibrateSeek(WORD cylinder, WORD expectedCylinder, DWORD& settleTime)
+{
+  settleTime = 0;
+  if (!wdc->seekDrive(cylinder, 0))
+  {
+    return false;
+  }
+  settleTime = wdc->getLastSettleTime();
+  
+  WORD idCylinder;
+  BYTE idSector;
+  BYTE sdh;
+  wdc->scanID(idCylinder, idSector, sdh);
+  if (wdc->getLastError() || (idCylinder != expectedCylinder))
+  {
+    return false;
+  }
+  
+  return wdc->seekDrive(0, 0) && wdc->isAtCylinder0();
+}
+
+void CommandCalibrateSeek()
+{
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  
+  // short, medium, half and full stroke seeks
+  const WORD cylinders = wdc->getParams()->Cylinders;
+  const WORD distances[4] = {1, (WORD)(cylinders / 8), (WORD)(cylinders / 2), (WORD)(cylinders - 1)};
+  WORD references[4];
+  
+  // sector IDs to expect, at the step rate in use
+  for (BYTE idx = 0; idx < 4; idx++)
   {
-    ui->print(Progmem::getString(Progmem::uiDisabled));
+    BYTE dummy;
+    BYTE dummy2;
+    wdc->seekDrive(distances[idx], 0);
+    wdc->scanID(references[idx], dummy, dummy2);
+    if (wdc->getLastError())
+    {
+      ui->print(Progmem::getString(Progmem::calibrateNoID), distances[idx]);
+      return;
+    }
+  }
+  wdc->seekDrive(0, 0);
+  
+  const WORD rateInUse = wdc->getParams()->StepRateUs ? wdc->getParams()->StepRateUs :
+                         wdc->getParams()->SlowSeek ? (SLOWSEEK_SRT_MS * 1000) : FASTSEEK_SRT_US;
+  const WORD previousRate = wdc->getParams()->StepRateUs;
+  WORD fastestRate = 0;
+  WORD marginRate = 0;
+  bool failed = false;
+  
+  ui->print(Progmem::getString(Progmem::calibrateInUse), rateInUse);
+  ui->print(Progmem::getString(Progmem::uiEscGoBack));
+  wdc->setSeekTimeoutFatal(false);
+  
+  for (BYTE rateIdx = 0; rateIdx < (sizeof(calibrateRates) / sizeof(WORD)); rateIdx++)
+  {
+    const WORD rate = pgm_read_word(&calibrateRates[rateIdx]);
+    if (rate >= rateInUse)
+    {
+      continue; // only faster ones
+    }
+    
+    wdc->getParams()->StepRateUs = rate;
+    ui->print(Progmem::getString(Progmem::calibrateRate), rate);
+    
+    // a few times each distance, and the longest settle time
+    DWORD longestSettle = 0;
+    for (BYTE repeat = 0; (repeat < 3) && !failed; repeat++)
+    {
+      for (BYTE idx = 0; (idx < 4) && !failed; idx++)
+      {
+        DWORD settleTime;
+        failed = !CalibrateSeek(distances[idx], references[idx], settleTime);
+        if (settleTime > longestSettle)
+        {
+          longestSettle = settleTime;
+        }
+      }
+    }
+    
+    if (failed)
+    {
+      ui->print(Progmem::getString(Progmem::uiFAIL));
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      break;
+    }
+    
+    ui->print(Progmem::getString(Progmem::calibrateSettle), longestSettle);
+    marginRate = fastestRate;
+    fastestRate = rate;
+    
+    if (ui->readKey("\e", false) == '\e')
+    {
+      break;
+    }
+  }
+  
+  wdc->setSeekTimeoutFatal(true);
+  wdc->getParams()->StepRateUs = previousRate;
+  
+  // steps might have been lost, find track 0 again
+  if (failed)
+  {
+    ui->print(Progmem::getString(Progmem::parkRecalibrating));
+    wdc->recalibrate();
+    ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  }
+  
+  if (!fastestRate)
+  {
+    ui->print(Progmem::getString(Progmem::calibrateNone));
+    return;
+  }
+  
+  // keep a margin of one rate slower than the fastest one that worked
+  if (!marginRate)
+  {
+    marginRate = fastestRate;
+  }
+  
+  ui->print(Progmem::getString(Progmem::calibrateResult), fastestRate, marginRate);
+  ui->print(Progmem::getString(Progmem::calibrateAskStore));
+  const BYTE key = toupper(ui->readKey("YN"));
+  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  if (key == 'Y')
+  {
+    wdc->getParams()->StepRateUs = marginRate;
+    eepromUpdateDefaultProfile();
+  }
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+}
+
+// benchmark: timing samples per measurement (at most), and histogram bins
+#define BENCH_SAMPLES 32
+#define BENCH_BINS    8
+
+// print minimum, average and maximum of the samples with a histogram, then the same as a machine readable line:
+// BENCH;<measurement>;<samples>;<min>;<avg>;<max>;<bin 1 count>;...;<bin 8 count> (microseconds)
+void BenchmarkReport(WORD label, const DWORD* samples, BYTE count)
+{
+  if (!count)
+  {
+    return;
+  }
+  
+  DWORD minimum = samples[0];
+  DWORD maximum = samples[0];
+  DWORD sum = 0;
+  for (BYTE idx = 0; idx < count; idx++)
+  {
+    minimum = (samples[idx] < minimum) ? samples[idx] : minimum;
+    maximum = (samples[idx] > maximum) ? samples[idx] : maximum;
+    sum += samples[idx];
+  }
+  const DWORD average = sum / count;
+  
+  // linear bins in between the minimum and maximum
+  const DWORD binWidth = (maximum - minimum) / BENCH_BINS + 1;
+  BYTE bins[BENCH_BINS] = {0};
+  for (BYTE idx = 0; idx < count; idx++)
+  {
+    bins[(samples[idx] - minimum) / binWidth]++;
+  }
+  
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  ui->print(Progmem::getString(label));
+  ui->print(Progmem::getString(Progmem::benchSummary), count, minimum, average, maximum);
+  
+  for (BYTE bin = 0; bin < BENCH_BINS; bin++)
+  {
+    char bar[BENCH_SAMPLES + 1] = {0};
+    memset(bar, '#', bins[bin]);
+    ui->print(Progmem::getString(Progmem::benchBin), minimum + bin * binWidth, bar, bins[bin]);
+  }
+  
+  ui->print(Progmem::getString(Progmem::benchCsvPrefix));
+  ui->print(Progmem::getString(label));
+  ui->print(Progmem::getString(Progmem::benchCsv), count, minimum, average, maximum);
+  for (BYTE bin = 0; bin < BENCH_BINS; bin++)
+  {
+    ui->print(";%u", bins[bin]);
+  }
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+}
+
+// first sector ID on the current track, false if none (fatal errors also print the message)
+bool BenchmarkScanID(BYTE& sector, BYTE& sdh)
+{
+  BYTE attempts = 5;
+  while (attempts--)
+  {
+    WORD cylinder;
+    wdc->scanID(cylinder, sector, sdh);
+    if (!wdc->getLastError())
+    {
+      return true;
+    }
+    
+    if (wdc->getLastError() < 4)
+    {
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      return false;
+    }
+  }
+  
+  ui->print(Progmem::getString(Progmem::calibrateNoID), wdc->getPhysicalCylinder());
+  return false;
+}
+
+// read all sectors of one cylinder, in the order they are numbered, and return bytes read and time taken;
+// false if the tracks cannot be read that way (no IDs, variable sector sizes), or on fatal error
+bool BenchmarkReadCylinder(WORD cylinder, DWORD& bytes, DWORD& elapsed)
+{
+  bytes = 0;
+  elapsed = 0;
+  
+  for (BYTE head = 0; head < wdc->getParams()->Heads; head++)
+  {
+    wdc->seekDrive(cylinder, head);
+    
+    BYTE sector;
+    BYTE sdh;
+    if (!BenchmarkScanID(sector, sdh))
+    {
+      return false;
+    }
+    
+    bool dummy;
+    bool variableSectorSize;
+    WORD tableCount = 0;
+    BYTE sectorsPerTrack = 0;
+    DWORD* sectorsTable = CalculateSectorsPerTrack(sdh, sectorsPerTrack, tableCount,
+                                                   dummy, dummy, variableSectorSize);
+    if (!sectorsTable)
+    {
+      return false;
+    }
+    
+    // lowest sector number, and the logical cylinder and head of the track
+    DWORD first = 0xFFFFFFFFUL;
+    for (WORD idx = 0; idx < tableCount; idx++)
+    {
+      if ((sectorsTable[idx] != 0xFFFFFFFFUL) &&
+          ((first == 0xFFFFFFFFUL) || ((BYTE)(sectorsTable[idx] >> 16) < (BYTE)(first >> 16))))
+      {
+        first = sectorsTable[idx];
+      }
+    }
+    delete[] sectorsTable;
+    
+    if (!sectorsPerTrack || variableSectorSize || (first == 0xFFFFFFFFUL))
+    {
+      ui->print(Progmem::getString(Progmem::benchZoneSkip));
+      return false;
+    }
+    
+    WORD logicalCylinder = (WORD)first;
+    BYTE logicalHead = (BYTE)(first >> 24) & 0xF;
+    const WORD sectorSizeBytes = wdc->getSectorSizeFromSDH((BYTE)(first >> 24));
+    const BYTE startSector = (BYTE)(first >> 16);
+    
+    // timed from the first read command, so includes the rotational latency to the first sector
+    const DWORD start = micros();
+    for (BYTE idx = 0; idx < sectorsPerTrack; idx++)
+    {
+      wdc->readSector(startSector + idx, sectorSizeBytes, false, &logicalCylinder, &logicalHead);
+      if (wdc->getLastError() && (wdc->getLastError() < 4))
+      {
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        return false;
+      }
+      
+      bytes += sectorSizeBytes;
+    }
+    elapsed += micros() - start;
+  }
+  
+  return elapsed != 0;
+}
+
+void CommandBenchmark()
+{
+  ui->print(Progmem::getString(Progmem::benchEscStop));
+  
+  const WORD cylinders = wdc->getParams()->Cylinders;
+  const BYTE heads = wdc->getParams()->Heads;
+  DWORD samples[BENCH_SAMPLES];
+  BYTE count;
+  BYTE sector;
+  BYTE sdh;
+  
+  // rotational period: time in between the same sector ID flying by
+  wdc->seekDrive(0, 0);
+  if (!BenchmarkScanID(sector, sdh))
+  {
+    return;
+  }
+  
+  DWORD start = micros();
+  for (count = 0; count < 16;)
+  {
+    BYTE current;
+    if (!BenchmarkScanID(current, sdh))
+    {
+      return;
+    }
+    
+    if (current == sector)
+    {
+      const DWORD now = micros();
+      samples[count++] = now - start;
+      start = now;
+    }
+  }
+  BenchmarkReport(Progmem::benchRotation, samples, count);
+  if (ui->readKey("\e", false) == '\e')
+  {
+    return;
+  }
+  
+  // track to track seeks, from random cylinders
+  for (count = 0; count < BENCH_SAMPLES; count++)
+  {
+    const WORD cylinder = random(0, cylinders - 1);
+    wdc->seekDrive(cylinder, 0);
+    
+    start = micros();
+    wdc->seekDrive(cylinder + 1, 0);
+    samples[count] = micros() - start;
+  }
+  BenchmarkReport(Progmem::benchTrackSeek, samples, count);
+  if (ui->readKey("\e", false) == '\e')
+  {
+    return;
+  }
+  
+  // random seeks in between any two cylinders, their average approaching the 1/3 stroke average seek time
+  for (count = 0; count < BENCH_SAMPLES; count++)
+  {
+    WORD cylinder;
+    do
+    {
+      cylinder = random(0, cylinders);
+    }
+    while (cylinder == wdc->getPhysicalCylinder());
+    
+    start = micros();
+    wdc->seekDrive(cylinder, 0);
+    samples[count] = micros() - start;
+  }
+  BenchmarkReport(Progmem::benchRandomSeek, samples, count);
+  if (ui->readKey("\e", false) == '\e')
+  {
+    return;
+  }
+  
+  // full stroke both ways (a few seconds each with ST506 slow seeks)
+  wdc->seekDrive(0, 0);
+  for (count = 0; count < 8; count++)
+  {
+    start = micros();
+    wdc->seekDrive((count % 2) ? 0 : cylinders - 1, 0);
+    samples[count] = micros() - start;
+  }
+  BenchmarkReport(Progmem::benchFullSeek, samples, count);
+  if (ui->readKey("\e", false) == '\e')
+  {
+    return;
+  }
+  
+  // head switch: from an ID just read on one head, until an ID is read on the next one
+  if (heads > 1)
+  {
+    wdc->seekDrive(0, 0);
+    for (count = 0; count < BENCH_SAMPLES; count++)
+    {
+      if (!BenchmarkScanID(sector, sdh))
+      {
+        return;
+      }
+      
+      start = micros();
+      wdc->seekDrive(0, (wdc->getPhysicalHead() + 1) % heads);
+      if (!BenchmarkScanID(sector, sdh))
+      {
+        return;
+      }
+      samples[count] = micros() - start;
+    }
+    BenchmarkReport(Progmem::benchHeadSwitch, samples, count);
+    if (ui->readKey("\e", false) == '\e')
+    {
+      return;
+    }
+  }
+  
+  // sustained sequential reads at the outer, middle and inner zone, sector by sector in their numbered order,
+  // so that the effect of the interleave is included
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  const WORD zones[3] = {0, (WORD)(cylinders / 2), (WORD)(cylinders - 1)};
+  for (BYTE zone = 0; zone < 3; zone++)
+  {
+    ui->print(Progmem::getString(Progmem::benchZone), zones[zone]);
+    
+    DWORD bytes;
+    DWORD elapsed;
+    if (!BenchmarkReadCylinder(zones[zone], bytes, elapsed))
+    {
+      continue;
+    }
+    
+    // bytes per second, without overflowing 32 bits
+    const DWORD rate = (bytes * 1000UL) / (elapsed / 1000UL + 1);
+    ui->print(Progmem::getString(Progmem::benchZoneRate), rate, elapsed / heads);
+    ui->print(Progmem::getString(Progmem::benchCsvRead), zones[zone], bytes, elapsed);
+    
+    if (ui->readKey("\e", false) == '\e')
+    {
+      return;
+    }
+  }
+}
+
+void CommandPark()
+{
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  ui->print(Progmem::getString(Progmem::uiOperationPending));
+  
+  // temporarily override the seek check and park to the landing zone
+  const WORD cyls = wdc->getParams()->Cylinders;
+  wdc->getParams()->Cylinders = 2048;
+  wdc->seekDrive(wdc->getParams()->LandingZone, 0);
+  wdc->getParams()->Cylinders = cyls;
+  wdc->selectDrive(false);
+  
+  ui->print(Progmem::getString(Progmem::parkSuccess), wdc->getParams()->LandingZone);
+  ui->print(Progmem::getString(Progmem::parkPowerdownSafe));
+  ui->print(Progmem::getString(Progmem::parkContinue));
+  ui->readKey(NULL);
+
+  // use the slow recalibrate command to seek back to 0, as the landing zone might be sometimes outside the cylinders count
+  ui->print(Progmem::getString(Progmem::parkRecalibrating));
+  wdc->recalibrate();
+  ui->print(Progmem::getString(Progmem::uiDeleteLine));
+}
+
+#if defined(DUAL_DRIVE) && (DUAL_DRIVE == 1)
+// copy one track of drive 0 onto drive 1, formatted with the same sector IDs;
+// false on a controller or drive error, unreadable set if the track could not be copied
+bool CopyTrack(WORD cylinder, BYTE head, bool& unreadable, DWORD& errors)
+{
+  unreadable = true;
+  wdc->setActiveDrive(0);
+  wdc->seekDrive(cylinder, head);
+  
+  BYTE sdh;
+  BYTE attempts = 5;
+  while (attempts)
+  {
+    WORD dummy;
+    BYTE dummy2;
+    wdc->scanID(dummy, dummy2, sdh);
+    if (!wdc->getLastError())
+    {
+      break;
+    }
+    if (wdc->getLastError() < 4)
+    {
+      return false;
+    }
+    attempts--;
+  }
+  if (!attempts)
+  {
+    return true;
+  }
+  
+  bool dummy;
+  bool variableSectorSize;
+  WORD tableCount = 0;
+  BYTE sectorsPerTrack = 0;
+  DWORD* sectorsTable = CalculateSectorsPerTrack(sdh, sectorsPerTrack, tableCount,
+                                                 dummy, dummy, variableSectorSize);
+  if (!sectorsTable || !sectorsPerTrack || variableSectorSize)
+  {
+    if (sectorsTable)
+    {
+      delete[] sectorsTable;
+    }
+    return true;
+  }
+  
+  // the sector IDs in their physical order, from the lowest sector number
+  DWORD* sectorMap = new DWORD[sectorsPerTrack];
+  if (!sectorMap)
+  {
+    delete[] sectorsTable;
+    ui->fatalError(Progmem::uiFeMemory);
+    return false;
+  }
+  
+  WORD startIdx = (WORD)-1;
+  for (WORD idx = 0; idx < tableCount; idx++)
+  {
+    if ((sectorsTable[idx] != 0xFFFFFFFFUL) &&
+        ((startIdx == (WORD)-1) || ((BYTE)(sectorsTable[idx] >> 16) < (BYTE)(sectorsTable[startIdx] >> 16))))
+    {
+      startIdx = idx;
+    }
+  }
+  
+  BYTE count = 0;
+  for (WORD idx = startIdx; count < sectorsPerTrack; idx = (idx + 1) % tableCount)
+  {
+    if (sectorsTable[idx] == 0xFFFFFFFFUL)
+    {
+      continue;
+    }
+    
+    // back at a sector already seen: missing IDs, and the format cannot be reproduced
+    const BYTE sector = (BYTE)(sectorsTable[idx] >> 16);
+    BYTE seen = 0;
+    while ((seen < count) && ((BYTE)(sectorMap[seen] >> 16) != sector))
+    {
+      seen++;
+    }
+    if (seen < count)
+    {
+      break;
+    }
+    sectorMap[count++] = sectorsTable[idx];
   }
+  delete[] sectorsTable;
   
-  ui->print(Progmem::getString(Progmem::uiShowPrecomp));
-  if (wdc->getParams()->UseWritePrecomp)
+  // the same logical cylinder and head for the whole track, see WriteImage
+  const WORD logicalCylinder = (WORD)sectorMap[0];
+  const BYTE logicalHead = (BYTE)(sectorMap[0] >> 24) & 0xF;
+  const WORD sectorSizeBytes = wdc->getSectorSizeFromSDH((BYTE)(sectorMap[0] >> 24));
+  for (BYTE idx = 1; idx < count; idx++)
   {
-    ui->print(Progmem::getString(Progmem::uiEnabled));
-    ui->print(Progmem::getString(Progmem::uiShowFromCyl), wdc->getParams()->WritePrecompStartCyl);
+    if (((WORD)sectorMap[idx] != logicalCylinder) || (((BYTE)(sectorMap[idx] >> 24) & 0xF) != logicalHead))
+    {
+      count = 0;
+      break;
+    }
   }
-  else
+  if (count < sectorsPerTrack)
   {
-    ui->print(Progmem::getString(Progmem::uiDisabled));
+    delete[] sectorMap;
+    return true;
   }
   
-  ui->print(Progmem::getString(Progmem::uiShowLZStatus));
-  if (wdc->getParams()->UseLandingZone)
-  {
-    ui->print(Progmem::getString(Progmem::uiNo));
-    ui->print(Progmem::getString(Progmem::uiShowLZ), wdc->getParams()->LandingZone); 
-  }
-  else
+  // format drive 1
+  wdc->setActiveDrive(1);
+  wdc->sramBeginBufferAccess(true, 0);
+  for (BYTE idx = 0; idx < sectorsPerTrack; idx++)
   {
-    ui->print(Progmem::getString(Progmem::uiYes));
+    wdc->sramWriteByteSequential(0);
+    wdc->sramWriteByteSequential((BYTE)(sectorMap[idx] >> 16));
   }
+  wdc->sramFinishBufferAccess();
   
-  ui->print(Progmem::getString(Progmem::uiShowSeekMode));
-  ui->print(Progmem::getString(wdc->getParams()->SlowSeek ? Progmem::uiShowSeekSlow : Progmem::uiShowSeekFast));
-}
-
-void CommandSeekTest()
-{
-  ui->print(Progmem::getString(Progmem::uiEscGoBack));
-  if (wdc->getParams()->SlowSeek)
+  wdc->seekDrive(cylinder, head);
+  wdc->formatTrack(sectorsPerTrack, sectorSizeBytes, &logicalCylinder, &logicalHead);
+  if (wdc->getLastError())
   {
-    ui->print(Progmem::getString(Progmem::seektestLegacy));
-    ui->print(Progmem::getString(Progmem::uiNewLine));
+    delete[] sectorMap;
+    return false;
   }
   
-  // start and end cylinder
-  WORD startCylinder = 0;  
-  BYTE* prompt = NULL;
-
-  while(true)
+  // move the data through the WDC buffer, as many sectors as fit (below the ECC area at 2032) per drive switch
+  const BYTE batch = 2032 / sectorSizeBytes;
+  BYTE results[2032 / 128];
+  
+  for (BYTE first = 0; first < sectorsPerTrack; first += batch)
   {
-    ui->print(Progmem::getString(Progmem::uiChooseStartCyl), 0, wdc->getParams()->Cylinders-5);
-    prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
-    if (!prompt)
+    const BYTE last = ((first + batch) < sectorsPerTrack) ? (first + batch) : sectorsPerTrack;
+    
+    wdc->setActiveDrive(0);
+    wdc->seekDrive(cylinder, head);
+    for (BYTE idx = first; idx < last; idx++)
     {
-      ui->print(Progmem::getString(Progmem::uiNewLine));
-      return;
-    }
-    startCylinder = (WORD)atoi(prompt);
-    if (startCylinder <= wdc->getParams()->Cylinders-5)
-    {  
-      if (!startCylinder && !strlen(ui->getPromptBuffer())) ui->print("0");
-      ui->print(Progmem::getString(Progmem::uiNewLine));
-      break;
+      wdc->readSector((BYTE)(sectorMap[idx] >> 16), sectorSizeBytes, false, &logicalCylinder, &logicalHead, (idx - first) * sectorSizeBytes);
+      results[idx - first] = wdc->getLastError();
+      if (results[idx - first] && (results[idx - first] < 4))
+      {
+        delete[] sectorMap;
+        return false;
+      }
     }
     
-    ui->print(Progmem::getString(Progmem::uiDeleteLine));
-  }  
-
-  WORD endCylinder = wdc->getParams()->Cylinders-1;
-  if (startCylinder+5 < endCylinder)
-  {
-    while(true)
+    wdc->setActiveDrive(1);
+    wdc->seekDrive(cylinder, head);
+    for (BYTE idx = first; idx < last; idx++)
     {
-      ui->print(Progmem::getString(Progmem::uiChooseEndCyl), startCylinder+5, wdc->getParams()->Cylinders-1);
-      prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
-      if (!prompt)
+      const BYTE sector = (BYTE)(sectorMap[idx] >> 16);
+      const BYTE result = results[idx - first];
+      
+      // no data: mark bad on the copy too
+      if ((result != WDC_OK) && (result != WDC_CORRECTED) && (result != WDC_DATAERROR))
       {
-        ui->print(Progmem::getString(Progmem::uiNewLine));
-        return;
+        wdc->setBadSector(sector, &logicalCylinder, &logicalHead);
+        errors++;
       }
-      endCylinder = (WORD)atoi(prompt);
-      if ((endCylinder >= startCylinder+5) && (endCylinder < wdc->getParams()->Cylinders))
-      {  
-        ui->print(Progmem::getString(Progmem::uiNewLine));
-        break;
+      else
+      {
+        wdc->writeSector(sector, sectorSizeBytes, &logicalCylinder, &logicalHead, (idx - first) * sectorSizeBytes);
+        if (result == WDC_DATAERROR)
+        {
+          errors++; // copied as read
+        }
       }
       
-      ui->print(Progmem::getString(Progmem::uiDeleteLine));
-    }  
+      if (wdc->getLastError() && (wdc->getLastError() < 4))
+      {
+        delete[] sectorMap;
+        return false;
+      }
+    }
   }
   
-  // test repetitions for back and forth moves, butterfly tests and random seeks
-  const char input[] = ": ";
-  const char ellipsis[] = "...";
-  ui->print(Progmem::getString(Progmem::seektestRepeats));
-  
-  WORD backForthTests = 0;
-  ui->print(Progmem::getString(Progmem::seektestBackForth));
-  ui->print(input);
-  prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
-  if (!prompt)
-  {
-    ui->print(Progmem::getString(Progmem::uiNewLine));
-    return;
-  }
-  backForthTests = (WORD)atoi(prompt);
-  if (!backForthTests && !strlen(ui->getPromptBuffer())) ui->print("0");
+  delete[] sectorMap;
+  unreadable = false;
+  return true;
+}
+
+void CommandCopy()
+{
   ui->print(Progmem::getString(Progmem::uiNewLine));
   
-  // full butterfly tests offered on buffered seek only
-  WORD butterflyTests = 0;
-  if (!wdc->getParams()->SlowSeek)
+  // drive 1 parameters: one of the stored profiles, or the same as drive 0
+  const WD42C22::DiskDriveParams sourceParams = *wdc->getParams();
+  wdc->setActiveDrive(1);
+  *wdc->getParams() = sourceParams;
+  
+  BYTE name[EEPROM_PROFILE_NAME];
+  for (BYTE index = 0; index < EEPROM_PROFILES_MAX; index++)
   {
-    ui->print(Progmem::getString(Progmem::seektestButterfly));
-    ui->print(input);
-    prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
-    if (!prompt)
+    if (eepromGetProfileName(index, name))
     {
-      ui->print(Progmem::getString(Progmem::uiNewLine));
-      return;
+      ui->print(Progmem::getString(Progmem::uiSetupProfile), index + 1, name);
     }
-    butterflyTests = (WORD)atoi(prompt);
-    if (!butterflyTests && !strlen(ui->getPromptBuffer())) ui->print("0");
-    ui->print(Progmem::getString(Progmem::uiNewLine));
   }
   
-  WORD randomTests = 0;
-  ui->print(Progmem::getString(Progmem::seektestRandom));
-  ui->print(input);
-  prompt = ui->prompt(4, Progmem::getString(Progmem::uiDecimalInputEsc), true);
-  if (!prompt)
+  ui->print(Progmem::getString(Progmem::copyProfile));
+  const BYTE* selection = ui->prompt(2, Progmem::getString(Progmem::uiDecimalInputEsc), true);
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  if (!selection)
   {
-    ui->print(Progmem::getString(Progmem::uiNewLine));
+    wdc->setActiveDrive(0);
     return;
   }
-  randomTests = (WORD)atoi(prompt);
-  if (!randomTests && !strlen(ui->getPromptBuffer())) ui->print("0");
-  ui->print(Progmem::getString(Progmem::uiNewLine));
   
-  // nothing selected
-  if (!backForthTests && !butterflyTests && !randomTests)
+  const BYTE index = (BYTE)atoi(selection);
+  if (strlen(selection) && index && !eepromLoadProfile(index - 1))
   {
-    return;
+    *wdc->getParams() = sourceParams;
   }
   
-  WORD count;
-  ui->print(Progmem::getString(Progmem::seektestProgress), startCylinder, endCylinder);
+  if ((wdc->getParams()->Cylinders < sourceParams.Cylinders) || (wdc->getParams()->Heads < sourceParams.Heads))
+  {
+    ui->print(Progmem::getString(Progmem::copyTooSmall));
+    wdc->setActiveDrive(0);
+    return;
+  }
   
-  // back and forth tests (seekDrive on error halts execution)
-  if (backForthTests)
+  // select drive 1 and wait until it is ready
+  wdc->applyParams();
+  wdc->selectDrive();
+  ui->print(Progmem::getString(Progmem::copyWaitReady));
+  while (!wdc->isDriveReady())
   {
-    ui->print(Progmem::getString(Progmem::seektestBackForth));
-    ui->print(ellipsis);
-    
-    for (count = 0; count < backForthTests; count++)
+    if (ui->readKey("\e", false) == '\e')
     {
-      wdc->seekDrive(endCylinder, 0);
-      wdc->seekDrive(startCylinder, 0);
+      ui->print(Progmem::getString(Progmem::uiNewLine));
+      wdc->setActiveDrive(0);
+      return;
     }
-    
+  }
+  ui->print(" ");
+  ui->print(Progmem::getString(Progmem::uiOK));
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  wdc->recalibrate();
+  
+  ui->print(Progmem::getString(Progmem::copyWarning));
+  const BYTE key = toupper(ui->readKey("YN"));
+  ui->print(Progmem::getString(Progmem::uiEchoKey), key);
+  if (key != 'Y')
+  {
     ui->print(Progmem::getString(Progmem::uiNewLine));
+    wdc->setActiveDrive(0);
+    return;
   }
   
-  // butterfly tests
-  if (butterflyTests)
+  DWORD unreadableTracks = 0;
+  DWORD errors = 0;
+  ui->print(Progmem::getString(Progmem::uiNewLine));
+  
+  for (WORD cylinder = 0; cylinder < sourceParams.Cylinders; cylinder++)
   {
-    ui->print(Progmem::getString(Progmem::seektestButterfly));
-    ui->print(ellipsis);
-    
-    for (count = 0; count < butterflyTests; count++)
+    for (BYTE head = 0; head < sourceParams.Heads; head++)
     {
-      WORD start = startCylinder;
-      WORD end = endCylinder;
-      WORD count2 = end-start + 1;
+      ui->print(Progmem::getString(Progmem::copyProgress), cylinder, head);
       
-      while (count2--)
+      bool unreadable;
+      if (!CopyTrack(cylinder, head, unreadable, errors))
       {
-        wdc->seekDrive(start++, 0);
-        wdc->seekDrive(end--, 0);        
+        ui->print(Progmem::getString(Progmem::uiNewLine2x));
+        ui->print(Progmem::getString(wdc->getLastErrorMessage()));
+        ui->print(Progmem::getString(Progmem::uiNewLine));
+        
+        wdc->setActiveDrive(1);
+        wdc->seekDrive(0, 0);
+        wdc->setActiveDrive(0);
+        return;
+      }
+      
+      if (unreadable)
+      {
+        unreadableTracks++;
       }
     }
-    
-    ui->print(Progmem::getString(Progmem::uiNewLine));
   }
   
-  // random
-  if (randomTests)
-  {
-    ui->print(Progmem::getString(Progmem::seektestRandom));
-    ui->print(ellipsis);
-    
-    for (count = 0; count < randomTests; count++)
-    {
-      wdc->seekDrive(random(startCylinder, endCylinder+1), 0);
-    }
-    
-    ui->print(Progmem::getString(Progmem::uiNewLine));
-  }  
-}
-
-void CommandPark()
-{
-  ui->print(Progmem::getString(Progmem::uiNewLine));
-  ui->print(Progmem::getString(Progmem::uiOperationPending));
-  
-  // temporarily override the seek check and park to the landing zone
-  const WORD cyls = wdc->getParams()->Cylinders;
-  wdc->getParams()->Cylinders = 2048;
-  wdc->seekDrive(wdc->getParams()->LandingZone, 0);
-  wdc->getParams()->Cylinders = cyls;
-  wdc->selectDrive(false);
+  // leave drive 1 at cylinder 0 too
+  wdc->setActiveDrive(1);
+  wdc->seekDrive(0, 0);
+  wdc->setActiveDrive(0);
   
-  ui->print(Progmem::getString(Progmem::parkSuccess), wdc->getParams()->LandingZone);
-  ui->print(Progmem::getString(Progmem::parkPowerdownSafe));
-  ui->print(Progmem::getString(Progmem::parkContinue));
-  ui->readKey(NULL);
-
-  // use the slow recalibrate command to seek back to 0, as the landing zone might be sometimes outside the cylinders count
-  ui->print(Progmem::getString(Progmem::parkRecalibrating));
-  wdc->recalibrate();
-  ui->print(Progmem::getString(Progmem::uiDeleteLine));
+  ui->print(Progmem::getString(Progmem::uiNewLine2x));
+  ui->print(Progmem::getString(Progmem::imgBadTracks), unreadableTracks);
+  ui->print(Progmem::getString(Progmem::copyResult), errors);
 }
+#endif
 
 DWORD* CalculateSectorsPerTrack(BYTE sdh, // input
                                 BYTE& sectorsPerTrack, WORD& tableCount, // outputs
@@ -1828,6 +3768,64 @@ DWORD* CalculateSectorsPerTrack(BYTE sdh, // input
   return result;  
 }
 
+WORD* MeasureSectorIntervals(const DWORD* sectorsTable, WORD tableCount)
+{
+  // returns a table of tableCount entries: for each sector ID in sectorsTable, microseconds elapsed
+  // from the preceding ID on track passing under the head, or 0 if not observed
+  // the shortest of the intervals seen is taken, as an ID missed in between only makes it longer
+  // deallocation handled by caller
+  if (!sectorsTable || !tableCount)
+  {
+    return NULL;
+  }
+  
+  WORD* result = new WORD[tableCount];
+  if (!result)
+  {
+    return NULL;
+  }
+  memset(result, 0, tableCount*sizeof(WORD));
+  
+  // another revolution or few, timestamped
+  WORD timedCount = 0;
+  WORD* timedIntervals = NULL;
+  DWORD* timedTable = wdc->fillSectorsTable(timedCount, &timedIntervals);
+  if (!timedTable)
+  {
+    delete[] result;
+    return NULL;
+  }
+  
+  if (timedIntervals)
+  {
+    for (WORD idx = 0; idx < tableCount; idx++)
+    {
+      if (sectorsTable[idx] == 0xFFFFFFFFUL)
+      {
+        continue;
+      }
+      
+      for (WORD index = 1; index < timedCount; index++)
+      {
+        if ((timedTable[index] != sectorsTable[idx]) || (timedTable[index-1] == 0xFFFFFFFFUL) || !timedIntervals[index])
+        {
+          continue;
+        }
+        
+        if (!result[idx] || (timedIntervals[index] < result[idx]))
+        {
+          result[idx] = timedIntervals[index];
+        }
+      }
+    }
+    
+    delete[] timedIntervals;
+  }
+  
+  delete[] timedTable;
+  return result;
+}
+
 bool CalculateInterleave(const DWORD* sectorsTable, WORD tableCount, BYTE sectorsPerTrack, BYTE& result)
 {
   // sequential
@@ -1914,3 +3912,13 @@ bool CalculateInterleave(const DWORD* sectorsTable, WORD tableCount, BYTE sector
   return false;
 }
 
+// free RAM between the heap and the stack
+WORD GetFreeMemory()
+{
+  extern BYTE __heap_start;
+  extern BYTE* __brkval;
+  
+  BYTE top;
+  return (WORD)(&top - (__brkval ? __brkval : &__heap_start));
+}
+
@@ -12,4 +12,6 @@ DWORD* CalculateSectorsPerTrack(BYTE sdh,
                                 BYTE& sectorsPerTrack, WORD& tableCount,
                                 bool& headMismatch, bool& cylinderMismatch, bool& variableSectorSize);
 
-bool CalculateInterleave(const DWORD* sectorsTable, WORD tableCount, BYTE sectorsPerTrack, BYTE& result);
\ No newline at end of file
+WORD* MeasureSectorIntervals(const DWORD* sectorsTable, WORD tableCount);
+bool CalculateInterleave(const DWORD* sectorsTable, WORD tableCount, BYTE sectorsPerTrack, BYTE& result);
+WORD GetFreeMemory();
\ No newline at end of file
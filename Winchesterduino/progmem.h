@@ -88,6 +88,10 @@ public:
     uiSetupAskRemove,    
     uiSetupSaved,
     uiSetupSavedLoad,
+    uiSetupProfile,
+    uiSetupSelect,
+    uiSetupAskName,
+    uiSetupFull,
     uiShowFromCyl,
     uiShowSeekSlow,
     uiShowSeekFast,
@@ -103,6 +107,8 @@ public:
     uiShowLZStatus,
     uiShowLZ,
     uiShowSeekMode,
+    uiShowStepRate,
+    uiShowFormatGap,
     
     // minimal mode
     uiMinimalModeSeek1,
@@ -114,21 +120,28 @@ public:
     optionHexdump,
     optionFormat,
     optionScan,
+    optionSurface,
     optionReadImage,
     optionWriteImage,
     optionShowParams,
     optionDos,
     optionSeektest,
+    optionCalibrate,
+    optionBenchmark,
     optionPark,
+    optionCopy,
     
     // analyze command
     analyzePrintOrder,
+    analyzePrintTiming,
     analyzeNoSectors,
     analyzeSectorInfo,
     analyzeSectorInfo2,
     analyzeSectorInfo3,
     analyzeSectorInfo4,
     analyzeSectorInfo5,
+    analyzeSectorInfo6,
+    analyzeSectorInfo7,
     analyzeCylHdNormal,
     analyzeConstSsize, 
     analyzeWarning,
@@ -150,9 +163,22 @@ public:
     formatWarning,
     formatSpt,
     formatInterleave,
+    formatOptimize,
+    formatOptimizeRate,
+    formatOptimizeBest,
+    formatHeadSkew,
+    formatCylinderSkew,
+    formatSkewMeasure,
+    formatSkewResult,
+    planZone,
+    planTrying,
+    planResult,
+    planUnusable,
+    planAskFormat,
     formatStartSector,
     formatVerify, 
     formatBadBlocks,
+    verifyCommands,
     formatProgress,
     formatComplete,
     
@@ -163,6 +189,20 @@ public:
     scanMarginal,
     scanProgress,
     
+    // surface test command
+    surfaceWarning,
+    surfacePattern,
+    surfaceSeed,
+    surfaceMarkBad,
+    surfaceLayout,
+    surfaceNoLayout,
+    surfaceEscStop,
+    surfaceProgress,
+    surfaceMismatch,
+    surfaceUnreadable,
+    surfaceMiscompares,
+    surfaceMarked,
+    
     // seektest command
     seektestLegacy,
     seektestRepeats,
@@ -171,16 +211,53 @@ public:
     seektestButterfly,
     seektestRandom,
     
+    // step rate calibration
+    calibrateNoID,
+    calibrateInUse,
+    calibrateRate,
+    calibrateSettle,
+    calibrateNone,
+    calibrateResult,
+    calibrateAskStore,
+    
+    // benchmark command
+    benchEscStop,
+    benchRotation,
+    benchTrackSeek,
+    benchRandomSeek,
+    benchFullSeek,
+    benchHeadSwitch,
+    benchSummary,
+    benchBin,
+    benchCsvPrefix,
+    benchCsv,
+    benchZone,
+    benchZoneSkip,
+    benchZoneRate,
+    benchCsvRead,
+    
     // park command
     parkSuccess, 
     parkPowerdownSafe, 
     parkContinue,
     parkRecalibrating,
     
+    // copy command
+    copyProfile,
+    copyTooSmall,
+    copyWaitReady,
+    copyWarning,
+    copyProgress,
+    copyResult,
+    
     // image file transfer
     imgReadWholeDisk,
     imgWriteWholeDisk,
     imgXmodem1k,
+    imgReadCheckBytes,
+    imgReadVotes,
+    imgReadNoVotes,
+    imgReadTimings,
     imgXmodemPrefix,
     imgXmodem1kPrefix,
     imgXmodemWaitSend, 
@@ -204,8 +281,11 @@ public:
     imgBadBlocks,
     imgBadBlocksKnown,
     imgDataCorrected,
+    imgDataVoted,
     imgDataErrors,
     imgDataErrorsConv,
+    scanDefectList,
+    scanCommands,
     imgBadTracks,
     imgOverrideWrite1,
     imgOverrideWrite2,
@@ -221,6 +301,8 @@ public:
     
     // DOS
     dosInvalidSsize,
+    dosPartition,
+    dosSelectPartition,
     dosFsMountError,
     dosDiskError,
     dosFileNotFound,
@@ -237,14 +319,30 @@ public:
     dosBytesFormat, 
     dosBytesFree,
     dosTypeInto,
+    dosDiskFull,
+    dosSkippedDirs,
+    dosDefragConfirm,
+    dosDefragBefore,
+    dosDefragAfter,
+    dosDefragResult,
+    dosDefragLeftover,
+    dosFragReport,
+    chkdskPass,
+    chkdskCrossLinked,
+    chkdskBadChain,
+    chkdskMismatch,
+    chkdskFiles,
+    chkdskErrors,
+    chkdskLost,
     dosMounted,
+    dosRamSaved,
     dosCommands,
     dosCommandsList,
     dosForbiddenChars
   };
   
   // retrieve string from progmem, buffer valid until next call
-  static const unsigned char* getString(unsigned char stringIndex)
+  static const unsigned char* getString(unsigned int stringIndex)
   {   
     strncpy_P(m_strBuffer, pgm_read_ptr(&(m_stringTable[stringIndex])), MAX_PROGMEM_STRING_LEN);
     return (const unsigned char*)&m_strBuffer[0];
@@ -326,9 +424,13 @@ private:
   PROGMEM_STR m_uiSetupCylLZ[]       PROGMEM = "Landing zone (parking cylinder): ";
   PROGMEM_STR m_uiSetupAskSeek[]     PROGMEM = "Drive seeking: (F)ast buffered / (S)low ST-506 compatible: ";
   PROGMEM_STR m_uiSetupAskSave[]     PROGMEM = "\r\nRemember these settings? Y/N: ";
-  PROGMEM_STR m_uiSetupAskRemove[]   PROGMEM = "Remove saved settings? Y/N: ";
+  PROGMEM_STR m_uiSetupAskRemove[]   PROGMEM = "Remove this drive profile? Y/N: ";
   PROGMEM_STR m_uiSetupSaved[]       PROGMEM = "Stored settings:\r\n";
   PROGMEM_STR m_uiSetupSavedLoad[]   PROGMEM = "\r\nLoading these settings.\r\n";
+  PROGMEM_STR m_uiSetupProfile[]     PROGMEM = "%2u: %s\r\n";
+  PROGMEM_STR m_uiSetupSelect[]      PROGMEM = "\r\nDrive profile to load, Enter for new parameters: ";
+  PROGMEM_STR m_uiSetupAskName[]     PROGMEM = "Profile name: ";
+  PROGMEM_STR m_uiSetupFull[]        PROGMEM = "FAIL, all profiles in use";
   PROGMEM_STR m_uiShowFromCyl[]      PROGMEM = ", from cylinder %u";
   PROGMEM_STR m_uiShowSeekSlow[]     PROGMEM = "slow, ST-506 compatible\r\n";
   PROGMEM_STR m_uiShowSeekFast[]     PROGMEM = "fast, buffered\r\n";
@@ -344,6 +446,8 @@ private:
   PROGMEM_STR m_uiShowLZStatus[]     PROGMEM = "\r\nAutopark on powerdown: ";
   PROGMEM_STR m_uiShowLZ[]           PROGMEM = "\r\nLanding zone cylinder: %u";
   PROGMEM_STR m_uiShowSeekMode[]     PROGMEM = "\r\nDrive seeking mode:    ";
+  PROGMEM_STR m_uiShowStepRate[]     PROGMEM = "Head step rate:        %u us, calibrated\r\n";
+  PROGMEM_STR m_uiShowFormatGap[]    PROGMEM = "Format gap (GAP3):     %u bytes, planned\r\n";
   
 // minimal mode
   PROGMEM_STR m_uiMinimalModeSeek1[] PROGMEM = "Seek to cylinder (0-2047): ";
@@ -355,21 +459,28 @@ private:
   PROGMEM_STR m_optionHexdump[]      PROGMEM = "(H)ex dump of one sector\r\n";
   PROGMEM_STR m_optionFormat[]       PROGMEM = "(F)ormat low-level\r\n";
   PROGMEM_STR m_optionScan[]         PROGMEM = "(M)ark data errors into bad blocks\r\n";
+  PROGMEM_STR m_optionSurface[]      PROGMEM = "S(U)rface test with write patterns\r\n";
   PROGMEM_STR m_optionReadImage[]    PROGMEM = "(R)ead disk into WDI image\r\n";
   PROGMEM_STR m_optionWriteImage[]   PROGMEM = "(W)rite disk from WDI image\r\n";
   PROGMEM_STR m_optionShowParams[]   PROGMEM = "(S)how current drive settings\r\n";
   PROGMEM_STR m_optionDos[]          PROGMEM = "(I)nspect DOS primary partition\r\n";
   PROGMEM_STR m_optionSeektest[]     PROGMEM = "(D)rive heads seek test / exercise\r\n";
+  PROGMEM_STR m_optionCalibrate[]    PROGMEM = "(T)une head step rate for this drive\r\n";
+  PROGMEM_STR m_optionBenchmark[]    PROGMEM = "(B)enchmark seek, rotation and read timings\r\n";
   PROGMEM_STR m_optionPark[]         PROGMEM = "(P)ark drive heads\r\n";  
+  PROGMEM_STR m_optionCopy[]         PROGMEM = "(C)opy drive 0 onto drive 1\r\n";
   
 // analyze command
   PROGMEM_STR m_analyzePrintOrder[]  PROGMEM = "Show logical sector numbers (interleave tables)? Y/N: ";
+  PROGMEM_STR m_analyzePrintTiming[] PROGMEM = "Show sector ID timings (microseconds)? Y/N: ";
   PROGMEM_STR m_analyzeNoSectors[]   PROGMEM = "No valid sectors read";
   PROGMEM_STR m_analyzeSectorInfo[]  PROGMEM = "%u sectors, %u bytes each, ";
   PROGMEM_STR m_analyzeSectorInfo2[] PROGMEM = "%u sectors, VARIABLE SIZE!, ";
   PROGMEM_STR m_analyzeSectorInfo3[] PROGMEM = "unknown";
   PROGMEM_STR m_analyzeSectorInfo4[] PROGMEM = " interleave";
   PROGMEM_STR m_analyzeSectorInfo5[] PROGMEM = "\r\nOrder: ";
+  PROGMEM_STR m_analyzeSectorInfo6[] PROGMEM = "\r\nTiming: ";
+  PROGMEM_STR m_analyzeSectorInfo7[] PROGMEM = "\r\nRotation %lu us, longest gap before sector %u";
   PROGMEM_STR m_analyzeCylHdNormal[] PROGMEM = "ID field cylinder and head numbers match seek position.\r\n";
   PROGMEM_STR m_analyzeConstSsize[]  PROGMEM = "Sector sizes inside single tracks are consistent.\r\n";
   PROGMEM_STR m_analyzeWarning[]     PROGMEM = "Warning(s):\r\n";
@@ -389,11 +500,24 @@ private:
   
 // format command
   PROGMEM_STR m_formatWarning[]      PROGMEM = "\r\nDestroys data between specified cylinders.";
-  PROGMEM_STR m_formatSpt[]          PROGMEM = "Sectors per track (%u-%u): ";
-  PROGMEM_STR m_formatInterleave[]   PROGMEM = "Interleave (1: none): ";
+  PROGMEM_STR m_formatSpt[]          PROGMEM = "Sectors per track (%u-%u, 0: plan for capacity): ";
+  PROGMEM_STR m_formatInterleave[]   PROGMEM = "Interleave (1: none, 0: measure the fastest): ";
+  PROGMEM_STR m_formatOptimize[]     PROGMEM = "\r\nFormatting and reading cylinder %u at interleave:\r\n";
+  PROGMEM_STR m_formatOptimizeRate[] PROGMEM = "%2u:1 - %lu.%lu KB/s\r\n";
+  PROGMEM_STR m_formatOptimizeBest[] PROGMEM = "\r\nFastest is %u:1, format the range with it? Y/N: ";
+  PROGMEM_STR m_formatHeadSkew[]     PROGMEM = "Head skew (0-%u sectors, Enter: measure): ";
+  PROGMEM_STR m_formatCylinderSkew[] PROGMEM = "Cylinder skew (0-%u sectors): ";
+  PROGMEM_STR m_formatSkewMeasure[]  PROGMEM = "\r\nMeasuring skew on cylinder %u... ";
+  PROGMEM_STR m_formatSkewResult[]   PROGMEM = "head skew %u, cylinder skew %u\r\n";
+  PROGMEM_STR m_planZone[]           PROGMEM = "\r\nZone cylinders %u-%u: ";
+  PROGMEM_STR m_planTrying[]         PROGMEM = "%u/gap %u ";
+  PROGMEM_STR m_planResult[]         PROGMEM = "\r\n  %u sectors per track, gap %u bytes";
+  PROGMEM_STR m_planUnusable[]       PROGMEM = "no sectors verify.\r\n";
+  PROGMEM_STR m_planAskFormat[]      PROGMEM = "\r\n\r\nFormat with %u sectors, gap %u? Y/N: ";
   PROGMEM_STR m_formatStartSector[]  PROGMEM = "Starting sector (0-%u, default 1): ";
   PROGMEM_STR m_formatVerify[]       PROGMEM = "Verify during format? Y/N: ";
   PROGMEM_STR m_formatBadBlocks[]    PROGMEM = "Mark *any* errors as bad blocks? Y/N: ";
+  PROGMEM_STR m_verifyCommands[]     PROGMEM = "\r\n  Located in %u verify/read command(s)";
   PROGMEM_STR m_formatProgress[]     PROGMEM = "\rFormatting cyl %u head %u... ";
   PROGMEM_STR m_formatComplete[]     PROGMEM = "\r\n\r\nFormat complete\r\n";
   
@@ -404,6 +528,20 @@ private:
   PROGMEM_STR m_scanMarginal[]       PROGMEM = "Treat marginal (ECC correctable) sectors as bad? Y/N: ";
   PROGMEM_STR m_scanProgress[]       PROGMEM = "\rProcessing cylinder %u...";
   
+// surface test command
+  PROGMEM_STR m_surfaceWarning[]     PROGMEM = "\r\nWrites test patterns into all sectors, destroys data.";
+  PROGMEM_STR m_surfacePattern[]     PROGMEM = "(1) 6DB6, (2) A5, (3) Incrementing, (4) Random, (A)ll: ";
+  PROGMEM_STR m_surfaceSeed[]        PROGMEM = "Random pattern seed (0-9999, default 0): ";
+  PROGMEM_STR m_surfaceMarkBad[]     PROGMEM = "Mark failing sectors as bad blocks? Y/N: ";
+  PROGMEM_STR m_surfaceLayout[]      PROGMEM = "\r\nTesting %u sectors of %u bytes per track, from sector %u\r\n";
+  PROGMEM_STR m_surfaceNoLayout[]    PROGMEM = "\r\nNo sector IDs on cylinder %u, format it first.\r\n";
+  PROGMEM_STR m_surfaceEscStop[]     PROGMEM = "Press Esc to stop after the current track.\r\n\r\n";
+  PROGMEM_STR m_surfaceProgress[]    PROGMEM = "\rTesting cyl %u head %u... ";
+  PROGMEM_STR m_surfaceMismatch[]    PROGMEM = "Data read back differs";
+  PROGMEM_STR m_surfaceUnreadable[]  PROGMEM = "%lu sector(s) not found,\r\n";
+  PROGMEM_STR m_surfaceMiscompares[] PROGMEM = "%lu sector(s) read back with different data,\r\n";
+  PROGMEM_STR m_surfaceMarked[]      PROGMEM = "%lu sector(s) marked as bad blocks.\r\n";
+  
 // seektest command
   PROGMEM_STR m_seektestLegacy[]     PROGMEM = "Use buffered drive seeking to offer butterfly seek tests.\r\n";
   PROGMEM_STR m_seektestRepeats[]    PROGMEM = "\r\nEnter number of repetitions for each test, 0: skip:\r\n";
@@ -412,16 +550,53 @@ private:
   PROGMEM_STR m_seektestButterfly[]  PROGMEM = "Full butterfly tests";
   PROGMEM_STR m_seektestRandom[]     PROGMEM = "Random seeks";
   
+// step rate calibration
+  PROGMEM_STR m_calibrateNoID[]      PROGMEM = "No sector ID found on cylinder %u.\r\n";
+  PROGMEM_STR m_calibrateInUse[]     PROGMEM = "Step rate in use: %u us\r\n";
+  PROGMEM_STR m_calibrateRate[]      PROGMEM = "Trying %u us per step... ";
+  PROGMEM_STR m_calibrateSettle[]    PROGMEM = "OK, longest settle time %lu us\r\n";
+  PROGMEM_STR m_calibrateNone[]      PROGMEM = "No faster step rate is reliable.\r\n";
+  PROGMEM_STR m_calibrateResult[]    PROGMEM = "\r\nFastest reliable: %u us, with margin: %u us\r\n";
+  PROGMEM_STR m_calibrateAskStore[]  PROGMEM = "Use it and store into the drive profile? Y/N: ";
+  
+// benchmark command
+  PROGMEM_STR m_benchEscStop[]       PROGMEM = "\r\nPress Esc to stop after a measurement.\r\n";
+  PROGMEM_STR m_benchRotation[]      PROGMEM = "Rotation period";
+  PROGMEM_STR m_benchTrackSeek[]     PROGMEM = "Track to track seek";
+  PROGMEM_STR m_benchRandomSeek[]    PROGMEM = "Random seek";
+  PROGMEM_STR m_benchFullSeek[]      PROGMEM = "Full stroke seek";
+  PROGMEM_STR m_benchHeadSwitch[]    PROGMEM = "Head switch to next ID";
+  PROGMEM_STR m_benchSummary[]       PROGMEM = ": %u samples, min %lu avg %lu max %lu us\r\n";
+  PROGMEM_STR m_benchBin[]           PROGMEM = "%9lu us |%s %u\r\n";
+  PROGMEM_STR m_benchCsvPrefix[]     PROGMEM = "BENCH;";
+  PROGMEM_STR m_benchCsv[]           PROGMEM = ";%u;%lu;%lu;%lu";
+  PROGMEM_STR m_benchZone[]          PROGMEM = "Reading cylinder %u... ";
+  PROGMEM_STR m_benchZoneSkip[]      PROGMEM = "no uniform sector IDs, skipped\r\n";
+  PROGMEM_STR m_benchZoneRate[]      PROGMEM = "%lu bytes/s, %lu us per track\r\n";
+  PROGMEM_STR m_benchCsvRead[]       PROGMEM = "BENCH;Read;%u;%lu;%lu\r\n";
+  
 // park command
   PROGMEM_STR m_parkSuccess[]        PROGMEM = "\rDrive heads sent to landing zone cylinder %u.\r\n";
   PROGMEM_STR m_parkPowerdownSafe[]  PROGMEM = "After powerdown, it is safe to relocate the drive.\r\n";
   PROGMEM_STR m_parkContinue[]       PROGMEM = "\r\nOr, press any key to resume working with the drive.\r\n";
   PROGMEM_STR m_parkRecalibrating[]  PROGMEM = "Recalibrating, please wait...";
+  
+// copy command
+  PROGMEM_STR m_copyProfile[]        PROGMEM = "Drive 1 profile, Enter for the same as drive 0: ";
+  PROGMEM_STR m_copyTooSmall[]       PROGMEM = "Drive 1 has less cylinders or heads than drive 0.\r\n";
+  PROGMEM_STR m_copyWaitReady[]      PROGMEM = "Waiting until drive 1 becomes /READY...";
+  PROGMEM_STR m_copyWarning[]        PROGMEM = "All data on drive 1 will be lost. Continue? Y/N: ";
+  PROGMEM_STR m_copyProgress[]       PROGMEM = "\rCopying cyl %u head %u... ";
+  PROGMEM_STR m_copyResult[]         PROGMEM = "%lu sector(s) with errors, bad on drive 1.\r\n";
     
 // image file transfer
   PROGMEM_STR m_imgReadWholeDisk[]   PROGMEM = "Read whole disk (normally Yes)? Y/N: ";
   PROGMEM_STR m_imgWriteWholeDisk[]  PROGMEM = "\r\nWrite whole disk image (normally Yes)? Y/N: ";
   PROGMEM_STR m_imgXmodem1k[]        PROGMEM = "Use XMODEM-1K? Y/N: ";
+  PROGMEM_STR m_imgReadCheckBytes[]  PROGMEM = "Store CRC/ECC bytes of data errors (long read)? Y/N: ";
+  PROGMEM_STR m_imgReadVotes[]       PROGMEM = "Reads to vote on per data error (0: off, odd 3-%u): ";
+  PROGMEM_STR m_imgReadNoVotes[]     PROGMEM = "No voting on data errors, %u B sectors too big.\r\n";
+  PROGMEM_STR m_imgReadTimings[]     PROGMEM = "Store sector ID timings (track layout)? Y/N: ";
   PROGMEM_STR m_imgXmodemPrefix[]    PROGMEM = "XMODEM: ";
   PROGMEM_STR m_imgXmodem1kPrefix[]  PROGMEM = "XMODEM-1K: ";
   PROGMEM_STR m_imgXmodemWaitSend[]  PROGMEM = "OK to launch Send\r\nTimeout 4 minutes\r\n";
@@ -445,8 +620,11 @@ private:
   PROGMEM_STR m_imgBadBlocks[]       PROGMEM = "%lu bad block(s),\r\n";
   PROGMEM_STR m_imgBadBlocksKnown[]  PROGMEM = "%lu pre-existing bad block(s),\r\n";
   PROGMEM_STR m_imgDataCorrected[]   PROGMEM = "%lu corrected ECC error(s),\r\n";
+  PROGMEM_STR m_imgDataVoted[]       PROGMEM = "%lu CRC/ECC error(s) recovered by voting,\r\n";
   PROGMEM_STR m_imgDataErrors[]      PROGMEM = "%lu uncorrectable CRC/ECC error(s).\r\n";
   PROGMEM_STR m_imgDataErrorsConv[]  PROGMEM = "%lu CRC/ECC error(s) converted to bad blocks.\r\n";
+  PROGMEM_STR m_scanDefectList[]     PROGMEM = "%u bad block(s) known to DOS mode.\r\n";
+  PROGMEM_STR m_scanCommands[]       PROGMEM = "%lu verify/read command(s) to locate them.\r\n";
   PROGMEM_STR m_imgBadTracks[]       PROGMEM = "%lu unreadable track(s),\r\n";
   PROGMEM_STR m_imgOverrideWrite1[]  PROGMEM = "\r\nInspect the image with 'inspect.py', beforehand.";
   PROGMEM_STR m_imgOverrideWrite2[]  PROGMEM = "\r\nIf unsure, choose No on the following option.";
@@ -462,6 +640,8 @@ private:
   
 // DOS  
   PROGMEM_STR m_dosInvalidSsize[]    PROGMEM = "Invalid sector size on track 0 (%u bytes)";
+  PROGMEM_STR m_dosPartition[]       PROGMEM = "Partition %u: type %02Xh, %u MB\r\n";
+  PROGMEM_STR m_dosSelectPartition[] PROGMEM = "Select partition to mount: ";
   PROGMEM_STR m_dosFsMountError[]    PROGMEM = "No primary DOS partition or not formatted";
   PROGMEM_STR m_dosDiskError[]       PROGMEM = "\rAborted due to disk error\r\n";  
   PROGMEM_STR m_dosFileNotFound[]    PROGMEM = "Not found in current path\r\n";
@@ -478,9 +658,25 @@ private:
   PROGMEM_STR m_dosBytesFormat[]     PROGMEM = "%9lu ";
   PROGMEM_STR m_dosBytesFree[]       PROGMEM = "bytes free on disk.\r\n";  
   PROGMEM_STR m_dosTypeInto[]        PROGMEM = "Type two empty newlines to quit\r\n";
-  PROGMEM_STR m_dosMounted[]         PROGMEM = "%u MB partition mounted.\r\n\r\n";
-  PROGMEM_STR m_dosCommands[]        PROGMEM = "Supported commands:\r\nCD, DIR, MKDIR, RMDIR, DEL, ";
-  PROGMEM_STR m_dosCommandsList[]    PROGMEM = "HEXDUMP, TYPE, TYPEINTO, EXIT.\r\n\r\n";
+  PROGMEM_STR m_dosDiskFull[]        PROGMEM = "Disk full\r\n";
+  PROGMEM_STR m_dosSkippedDirs[]     PROGMEM = "%u directories nested too deep, skipped\r\n";
+  PROGMEM_STR m_dosDefragConfirm[]   PROGMEM = "Relocate fragmented files on the whole disk? Y/N: ";
+  PROGMEM_STR m_dosDefragBefore[]    PROGMEM = "Before: ";
+  PROGMEM_STR m_dosDefragAfter[]     PROGMEM = "After:  ";
+  PROGMEM_STR m_dosDefragResult[]    PROGMEM = "%lu files relocated, %lu skipped (no room or bad chain)\r\n";
+  PROGMEM_STR m_dosDefragLeftover[]  PROGMEM = "%s is left from an interrupted run, check it first\r\n";
+  PROGMEM_STR m_dosFragReport[]      PROGMEM = "%lu of %lu files fragmented, %lu fragments\r\n";
+  PROGMEM_STR m_chkdskPass[]         PROGMEM = "\rChecking, pass %u of %u ";
+  PROGMEM_STR m_chkdskCrossLinked[]  PROGMEM = "Cross-linked: %s\r\n";
+  PROGMEM_STR m_chkdskBadChain[]     PROGMEM = "Invalid cluster chain: %s\r\n";
+  PROGMEM_STR m_chkdskMismatch[]     PROGMEM = "Size mismatch: %s, %lu clusters allocated\r\n";
+  PROGMEM_STR m_chkdskFiles[]        PROGMEM = "%lu files in %lu directories checked\r\n";
+  PROGMEM_STR m_chkdskErrors[]       PROGMEM = "%lu cross-linked clusters, %lu bad chains, %lu bad sizes\r\n";
+  PROGMEM_STR m_chkdskLost[]         PROGMEM = "%lu lost clusters in %lu chains\r\n";
+  PROGMEM_STR m_dosMounted[]         PROGMEM = "%u MB partition mounted, %u bytes of RAM free\r\n";
+  PROGMEM_STR m_dosRamSaved[]        PROGMEM = "(%u of them saved by sharing the FatFs sector buffer).\r\n\r\n";
+  PROGMEM_STR m_dosCommands[]        PROGMEM = "Supported commands:\r\nCD, DIR, MKDIR, RMDIR, DEL, HEXDUMP, ";
+  PROGMEM_STR m_dosCommandsList[]    PROGMEM = "TYPE, TYPEINTO, GET, PUT, TAR, CHKDSK, DEFRAG, EXIT.\r\n\r\n";
   PROGMEM_STR m_dosForbiddenChars[]  PROGMEM = "*?\\/\":<>|";
    
 // tables
@@ -505,50 +701,66 @@ private:
                                                   m_uiSetupDataMode, m_uiSetupDataVerify, m_uiSetupCylinders, m_uiSetupHeads,
                                                   m_uiSetupAskRWC, m_uiSetupCylRWC, m_uiSetupAskPrecomp, m_uiSetupCylPrecomp,
                                                   m_uiSetupAskLZ, m_uiSetupCylLZ, m_uiSetupAskSeek, m_uiSetupAskSave, m_uiSetupAskRemove, 
-                                                  m_uiSetupSaved, m_uiSetupSavedLoad, m_uiShowFromCyl, m_uiShowSeekSlow, m_uiShowSeekFast,
+                                                  m_uiSetupSaved, m_uiSetupSavedLoad, m_uiSetupProfile, m_uiSetupSelect, m_uiSetupAskName, m_uiSetupFull, m_uiShowFromCyl, m_uiShowSeekSlow, m_uiShowSeekFast,
                                                   m_uiShowVerifyCRC, m_uiShowVerifyECC, m_uiShowVerifyECC56, m_uiShowDataMode, 
                                                   m_uiShowVerifyMode, m_uiShowCylinders, m_uiShowHeads, m_uiShowRWC, m_uiShowPrecomp,
-                                                  m_uiShowLZStatus, m_uiShowLZ, m_uiShowSeekMode,
+                                                  m_uiShowLZStatus, m_uiShowLZ, m_uiShowSeekMode, m_uiShowStepRate, m_uiShowFormatGap,
                                                   
                                                   m_uiMinimalModeSeek1, m_uiMinimalModeSeek2, m_uiMinimalModeSeek3,
                                                   
-                                                  m_optionAnalyze, m_optionHexdump, m_optionFormat, m_optionScan, m_optionReadImage,
-                                                  m_optionWriteImage, m_optionShowParams, m_optionDos, m_optionSeektest, m_optionPark,
+                                                  m_optionAnalyze, m_optionHexdump, m_optionFormat, m_optionScan, m_optionSurface, m_optionReadImage,
+                                                  m_optionWriteImage, m_optionShowParams, m_optionDos, m_optionSeektest, m_optionCalibrate, m_optionBenchmark, m_optionPark, m_optionCopy,
                                                   
-                                                  m_analyzePrintOrder, m_analyzeNoSectors, m_analyzeSectorInfo, m_analyzeSectorInfo2,
-                                                  m_analyzeSectorInfo3, m_analyzeSectorInfo4, m_analyzeSectorInfo5, 
+                                                  m_analyzePrintOrder, m_analyzePrintTiming, m_analyzeNoSectors, m_analyzeSectorInfo, m_analyzeSectorInfo2,
+                                                  m_analyzeSectorInfo3, m_analyzeSectorInfo4, m_analyzeSectorInfo5, m_analyzeSectorInfo6, m_analyzeSectorInfo7,
                                                   m_analyzeCylHdNormal, m_analyzeConstSsize, m_analyzeWarning,
                                                   m_analyzeCylMismatch, m_analyzeHdMismatch, m_analyzeVarSsize,
                                                   
                                                   m_hexdumpLongMode, m_hexdumpDump, m_hexdumpChecksum, m_hexdumpPolynomial1, 
                                                   m_hexdumpPolynomial2, m_hexdumpPolynomial3, m_hexdumpChecksum2, m_hexdumpOk,
                                                   
-                                                  m_formatWarning, m_formatSpt, m_formatInterleave, m_formatStartSector,
-                                                  m_formatVerify, m_formatBadBlocks, m_formatProgress, m_formatComplete,
+                                                  m_formatWarning, m_formatSpt, m_formatInterleave, m_formatOptimize,
+                                                  m_formatOptimizeRate, m_formatOptimizeBest, m_formatHeadSkew, m_formatCylinderSkew,
+                                                  m_formatSkewMeasure, m_formatSkewResult, m_planZone, m_planTrying, m_planResult,
+                                                  m_planUnusable, m_planAskFormat, m_formatStartSector,
+                                                  m_formatVerify, m_formatBadBlocks, m_verifyCommands, m_formatProgress, m_formatComplete,
                                                   
                                                   m_scanWarning1, m_scanWarning2, m_scanWarning3, m_scanMarginal, m_scanProgress,
+                                                  m_surfaceWarning, m_surfacePattern, m_surfaceSeed, m_surfaceMarkBad, m_surfaceLayout,
+                                                  m_surfaceNoLayout, m_surfaceEscStop, m_surfaceProgress, m_surfaceMismatch,
+                                                  m_surfaceUnreadable, m_surfaceMiscompares, m_surfaceMarked,
                                                   
                                                   m_seektestLegacy, m_seektestRepeats, m_seektestProgress, m_seektestBackForth,
                                                   m_seektestButterfly, m_seektestRandom,
+                                                  m_calibrateNoID, m_calibrateInUse, m_calibrateRate, m_calibrateSettle,
+                                                  m_calibrateNone, m_calibrateResult, m_calibrateAskStore,
+                                                  m_benchEscStop, m_benchRotation, m_benchTrackSeek, m_benchRandomSeek, m_benchFullSeek,
+                                                  m_benchHeadSwitch, m_benchSummary, m_benchBin, m_benchCsvPrefix, m_benchCsv,
+                                                  m_benchZone, m_benchZoneSkip, m_benchZoneRate, m_benchCsvRead,
                                                   
                                                   m_parkSuccess, m_parkPowerdownSafe, m_parkContinue, m_parkRecalibrating,
                                                   
-                                                  m_imgReadWholeDisk, m_imgWriteWholeDisk, m_imgXmodem1k, m_imgXmodemPrefix, m_imgXmodem1kPrefix,
+                                                  m_copyProfile, m_copyTooSmall, m_copyWaitReady, m_copyWarning, m_copyProgress, m_copyResult,
+                                                  
+                                                  m_imgReadWholeDisk, m_imgWriteWholeDisk, m_imgXmodem1k, m_imgReadCheckBytes, m_imgReadVotes, m_imgReadNoVotes, m_imgReadTimings, m_imgXmodemPrefix, m_imgXmodem1kPrefix,
                                                   m_imgXmodemWaitSend, m_imgXmodemWaitRecv, m_imgXmodemXferEnd, m_imgXmodemXferFail,                                                  
                                                   m_imgXmodemErrPacket, m_imgXmodemErrHeader, m_imgXmodemErrParams, m_imgXmodemErrSecTyp,
                                                   m_imgXmodemErrMFMRLL, m_imgXmodemErrCyls, m_imgXmodemErrHeads,                                                  
                                                   m_imgXmodemErrVar1, m_imgXmodemErrVar2, m_imgXmodemErrPart, m_imgWriteHeader, m_imgWriteComment, 
-                                                  m_imgWriteDone, m_imgWriteEnterEsc, m_imgBadBlocks, m_imgBadBlocksKnown, m_imgDataCorrected,
-                                                  m_imgDataErrors, m_imgDataErrorsConv, m_imgBadTracks, m_imgOverrideWrite1, 
+                                                  m_imgWriteDone, m_imgWriteEnterEsc, m_imgBadBlocks, m_imgBadBlocksKnown, m_imgDataCorrected, m_imgDataVoted,
+                                                  m_imgDataErrors, m_imgDataErrorsConv, m_scanDefectList, m_scanCommands, m_imgBadTracks, m_imgOverrideWrite1, 
                                                   m_imgOverrideWrite2, m_imgOverrideWrite3, m_imgBadBloxOption1, m_imgBadBloxOption2,
                                                   m_imgDataErrorsOpt1, m_imgDataErrorsOpt2, m_imgDiskStats, m_imgImageStats, m_imgRunScan,
                                                   m_imgRestoreParams,
                                                   
-                                                  m_dosInvalidSsize, m_dosFsMountError, m_dosDiskError, m_dosFileNotFound,
+                                                  m_dosInvalidSsize, m_dosPartition, m_dosSelectPartition, m_dosFsMountError, m_dosDiskError, m_dosFileNotFound,
                                                   m_dosPathNotFound, m_dosDirectoryFull, m_dosFileExists, m_dosFsError, 
                                                   m_dosInvalidName, m_dosInvalidDirName, m_dosMaxPath, m_dosInvalidCommand, 
-                                                  m_dosDirectory, m_dosDirectoryEmpty, m_dosBytesFormat, m_dosBytesFree, m_dosTypeInto,
-                                                  m_dosMounted, m_dosCommands, m_dosCommandsList, m_dosForbiddenChars
+                                                  m_dosDirectory, m_dosDirectoryEmpty, m_dosBytesFormat, m_dosBytesFree, m_dosTypeInto, m_dosDiskFull, m_dosSkippedDirs,
+                                                  m_dosDefragConfirm, m_dosDefragBefore, m_dosDefragAfter, m_dosDefragResult, m_dosDefragLeftover, m_dosFragReport,
+                                                  m_chkdskPass, m_chkdskCrossLinked, m_chkdskBadChain, m_chkdskMismatch,
+                                                  m_chkdskFiles, m_chkdskErrors, m_chkdskLost,
+                                                  m_dosMounted, m_dosRamSaved, m_dosCommands, m_dosCommandsList, m_dosForbiddenChars
                                                };
 
 // provides for transfering messages between program space and our address space
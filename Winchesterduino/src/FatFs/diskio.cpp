@@ -18,32 +18,34 @@ DSTATUS disk_initialize(BYTE pdrv)
 
 DRESULT disk_read(BYTE pdrv, BYTE *buf, DWORD sec, UINT count)
 { 
-  // FATFS operates in single sectors
-  if ((count != 1) || (sec > DOSGetTotalSectorCount()))
+  // with FF_FS_TINY, FATFS reads whole sectors of a file directly into the caller's buffer,
+  // and there can be more of them in one request
+  if (!count || ((sec + count) > DOSGetTotalSectorCount()))
   {
     return RES_PARERR; 
   }
   
-  WORD cyl;
-  BYTE head;
-  BYTE sector;
-  DOSConvertLogicalSectorToCHS(sec, cyl, head, sector);
-  
-  wdc->seekDrive(cyl, head);
-  wdc->readSector(sector, DOSGetSectorSize());
-  
-  // allow ECC
-  if (wdc->getLastError() && (wdc->getLastError() != WDC_CORRECTED))
+  const WORD sectorSize = DOSGetSectorSize();
+  while (count--)
   {
-    return RES_ERROR;
-  }
+    // fail fast, instead of a full revolution of ID searching
+    if (DOSIsKnownDefect(sec))
+    {
+      return RES_ERROR;
+    }
+    
+    const BYTE sector = DOSSeekLogicalSector(sec++);
+    wdc->readSector(sector, sectorSize);
   
-  wdc->sramBeginBufferAccess(false, 0);
-  for (WORD idx = 0; idx < DOSGetSectorSize(); idx++)
-  {
-    buf[idx] = wdc->sramReadByteSequential();
+    // allow ECC
+    if (wdc->getLastError() && (wdc->getLastError() != WDC_CORRECTED))
+    {
+      return RES_ERROR;
+    }
+  
+    wdc->sramReadBuffer(buf, 0, sectorSize);
+    buf += sectorSize;
   }
-  wdc->sramFinishBufferAccess();
 
   return RES_OK;
 }
@@ -52,30 +54,30 @@ DRESULT disk_read(BYTE pdrv, BYTE *buf, DWORD sec, UINT count)
 // analog to the one above
 DRESULT disk_write(BYTE pdrv, BYTE *buf, DWORD sec, UINT count)
 { 
-  if ((count != 1) || (sec > DOSGetTotalSectorCount()))
+  if (!count || ((sec + count) > DOSGetTotalSectorCount()))
   {
     return RES_PARERR;
   }
   
-  WORD cyl;
-  BYTE head;
-  BYTE sector;
-  DOSConvertLogicalSectorToCHS(sec, cyl, head, sector);
-  
-  wdc->sramBeginBufferAccess(true, 0);
-  for (WORD idx = 0; idx < DOSGetSectorSize(); idx++)
+  const WORD sectorSize = DOSGetSectorSize();
+  while (count--)
   {
-    wdc->sramWriteByteSequential(buf[idx]);
-  }
-  wdc->sramFinishBufferAccess();
+    if (DOSIsKnownDefect(sec))
+    {
+      return RES_ERROR;
+    }
+    
+    wdc->sramWriteBuffer(buf, 0, sectorSize);
+    buf += sectorSize;
   
-  wdc->seekDrive(cyl, head);
-  wdc->writeSector(sector, DOSGetSectorSize());
+    const BYTE sector = DOSSeekLogicalSector(sec++);
+    wdc->writeSector(sector, sectorSize);
     
-  // write
-  if (wdc->getLastError() && (wdc->getLastError() != WDC_CORRECTED))
-  {
-    return RES_ERROR;
+    // write
+    if (wdc->getLastError() && (wdc->getLastError() != WDC_CORRECTED))
+    {
+      return RES_ERROR;
+    }
   }
   
   return RES_OK;
@@ -97,7 +99,8 @@ DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff)
     break;
 
   case GET_SECTOR_SIZE:
-    *((DWORD *) buff) = (DWORD)DOSGetSectorSize();
+    *((WORD *) buff) = DOSGetSectorSize();
+    res = RES_OK;
     break;
 
   case GET_BLOCK_SIZE:
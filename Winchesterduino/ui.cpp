@@ -198,7 +198,7 @@ const BYTE* Ui::prompt(BYTE maximumPromptLen, const BYTE* allowedKeys, bool escR
 }
 
 // print an error that doesn't continue (in a XMODEM callback, this function does nothing)
-void Ui::fatalError(BYTE progmemStrIndex)
+void Ui::fatalError(WORD progmemStrIndex)
 {
   wdc->selectDrive(false); // turn the LED off
   
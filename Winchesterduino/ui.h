@@ -26,7 +26,7 @@ public:
   BYTE* getPrintBuffer() { return &m_printBuffer[0]; }
   void setPrintLength(WORD length) { m_printLength = length; }   
   void setPrintDisabled(bool disable) { m_printDisabled = disable; }
-  void fatalError(BYTE progmemStrIndex);
+  void fatalError(WORD progmemStrIndex);
   
 private:  
   Ui(); 
@@ -9,7 +9,7 @@
 // PORTA7-A0 (D29-22): AD7-AD0*; input/output
 // PORTC7-C0 (D30-37): /RESET*, RLL/MFM@, DIRECTION$, STEP$, HDSEL3$, HDSEL2$, HDSEL1$, HDSEL0$; outputs
 // PORTL7-L0 (D42-49): /DACK*, /HCS*, /HWE*, /HRE*, ALE*, /MWE*, /MRE*, DS0$; outputs
-// PORTG2-G0 (D39-41): n/c, n/c, SC@; output
+// PORTG2-G0 (D39-41): n/c, DS1$ (with DUAL_DRIVE, otherwise n/c), SC@; outputs
 //
 // PWM 7-0 pinheader:
 // PORTE4       (D02): /SC%;  input
@@ -24,16 +24,20 @@
 #define TIMEOUT_READY     200000UL  // disk is ready if /READY is consistently low for ~120ms during powerup test
 #define TIMEOUT_SETTLE    800000UL  // seek must be complete within half a second of last pulse sent
 #define TIMEOUT_IO       5000000UL  // any other WDC I/O timeout, up to 3 seconds
+#define TIMEOUT_SETTLE_US 500000UL  // as TIMEOUT_SETTLE, in microseconds since the last step pulse (non-blocking seek)
 
 // interrupts - WDC "microcontroller interrupt" and drive "seek complete"
 volatile bool mcintFired = false;
+volatile DWORD mcintTime = 0;
 void MCINT()
 {
-  // on falling edge, set internal flag
+  // on falling edge, set internal flag and note when it happened
+  mcintTime = micros();
   mcintFired = true;
 }
 
 volatile bool seekComplete = false;
+volatile DWORD seekCompleteTime = 0;
 void SC()
 {
   // on change, invert drive /SC to SC output for the separator board, 
@@ -47,6 +51,46 @@ void SC()
   {
     PORTG |= 1;
     seekComplete = true;
+    seekCompleteTime = micros();
+  }
+}
+
+// step pulse generator - Timer4 in CTC mode, a pulse begins each compare match A and ends on compare match B
+// (Timer4 PWM outputs are pins 6-8; 6 and 7 are used here as drive inputs, so nothing else needs it)
+volatile WORD stepsRemaining = 0;
+volatile bool steppingDone = true;
+volatile DWORD lastStepTime = 0;
+volatile BYTE stepPulseTicks = 0;
+ISR(TIMER4_COMPA_vect)
+{
+  // one more period after the last pulse: a drive asserting /SC after each step
+  // has dropped it by now for the last one, so it can be checked
+  if (!stepsRemaining)
+  {
+    TCCR4B = 0;
+    TIMSK4 = 0;
+    steppingDone = true;
+    return;
+  }
+  
+  PORTC ^= 0x10;
+  stepsRemaining--;
+  
+  // end the pulse at least SEEK_PULSE_US from now
+  OCR4B = TCNT4 + stepPulseTicks;
+  TIFR4 = 4;
+  TIMSK4 = 6;
+}
+
+ISR(TIMER4_COMPB_vect)
+{
+  PORTC ^= 0x10;
+  TIMSK4 = 2;
+  
+  if (!stepsRemaining)
+  {
+    // all sent, the timer stops on the next match A
+    lastStepTime = micros();
   }
 }
 
@@ -59,8 +103,21 @@ WD42C22::WD42C22()
   
   cli(); 
   m_seekForward = false;
+  m_seekTimeoutFatal = true;
+  m_seeking = false;
+  m_seekResult = true;
+  m_seekCylinder = 0;
+  m_settleTime = 0;
+  m_formatSpt = 0;
+  m_formatInterleave = 0;
+  m_formatStartSector = 0;
+  m_formatSkew = 0;
+  m_formatTableLoaded = false;
   m_physicalCylinder = 0;
   m_physicalHead = 0;
+  m_activeDrive = 0;
+  m_otherCylinder = 0;
+  m_otherHead = 0;
   m_result = WDC_OK;
   m_errorMessage = 0;
   
@@ -82,9 +139,13 @@ WD42C22::WD42C22()
   PORTL = 0xF6;
   DDRL = 0xFF;
   
-  // input: WINDOW Hi-Z, output: SC low (seek complete output to separator board)
+  // input: WINDOW Hi-Z, output: SC low (seek complete output to separator board), DS1 low
   PORTG = 0;
+#if defined(DUAL_DRIVE) && (DUAL_DRIVE == 1)
+  DDRG = 3;
+#else
   DDRG = 1;
+#endif
   
   // input: drive /SC and controller /MCINT both input pullup (drive /SC also has external pullup)
   // output: WPCEN output low 
@@ -192,6 +253,7 @@ void WD42C22::sramBeginBufferAccess(bool write /* false: read */, WORD startingO
   adWrite(0x3B, icr);                         // make sure MAC = 0 before changing DRWB
   if (write)
   {
+    m_formatTableLoaded = false;              // see prepareFormatInterleave()
     bcr &= 0xFB;                              // DRWB = 0 for writing into RAM
   }
   else
@@ -241,6 +303,28 @@ void WD42C22::sramClearBuffer(WORD count)
   sramFinishBufferAccess();
 }
 
+void WD42C22::sramReadBuffer(BYTE* buffer, WORD startingOffset, WORD count)
+{
+  // block transfer from the buffer SRAM into MCU memory, with the register access inlined
+  sramBeginBufferAccess(false, startingOffset);
+  for (WORD index = 0; index < count; index++)
+  {
+    buffer[index] = adRead(0x36);
+  }
+  sramFinishBufferAccess();
+}
+
+void WD42C22::sramWriteBuffer(const BYTE* buffer, WORD startingOffset, WORD count)
+{
+  // ditto, MCU memory into the buffer SRAM
+  sramBeginBufferAccess(true, startingOffset);
+  for (WORD index = 0; index < count; index++)
+  {
+    adWrite(0x36, buffer[index]);
+  }
+  sramFinishBufferAccess();
+}
+
 bool WD42C22::testBoard()
 {
   // a simple test of both the WDC chip and its associated 2K buffer SRAM (6116)
@@ -280,6 +364,21 @@ void WD42C22::selectDrive(bool ds0 /* = true */)
 {
   // false: unselects
   // drive must be selected before any operation on it
+#if defined(DUAL_DRIVE) && (DUAL_DRIVE == 1)
+  if (m_activeDrive)
+  {
+    if (ds0)
+    {
+      PORTG |= 2;
+    }
+    else
+    {
+      PORTG &= 0xFD;
+    }
+    return;
+  }
+#endif
+
   if (ds0)
   {
     PORTL |= 1;
@@ -290,6 +389,38 @@ void WD42C22::selectDrive(bool ds0 /* = true */)
   }
 }
 
+void WD42C22::setActiveDrive(BYTE drive)
+{
+  // 0: DS0, 1: DS1 (with DUAL_DRIVE)
+  // each drive keeps its own parameters and head position, the step, direction and head select lines are shared
+  if (drive == m_activeDrive)
+  {
+    return;
+  }
+  
+  // let the heads of this drive arrive first
+  finishSeek();
+  selectDrive(false);
+  
+  const DiskDriveParams params = m_params;
+  m_params = m_otherParams;
+  m_otherParams = params;
+  
+  const WORD cylinder = m_physicalCylinder;
+  m_physicalCylinder = m_otherCylinder;
+  m_otherCylinder = cylinder;
+  
+  const BYTE head = m_physicalHead;
+  m_physicalHead = m_otherHead;
+  m_otherHead = head;
+  
+  // head select lines to where this drive was left
+  PORTC = (PORTC & 0xF0) | m_physicalHead;
+  
+  m_activeDrive = drive;
+  applyParams();
+}
+
 bool WD42C22::isDriveReady()
 {
   // query /READY of the disk drive directly, don't read WDC status bits
@@ -323,6 +454,9 @@ bool WD42C22::isWriteFault()
 // 1 slow seek step + wait for the head settle each singlestep
 bool WD42C22::recalibrate()
 { 
+  // a step pulse train may still be running
+  finishSeek();
+  
   // make sure the drive is selected
   selectDrive();
   
@@ -386,6 +520,18 @@ bool WD42C22::recalibrate()
 // seek to given cylinder and head, set reduced write current or write precompensation line
 bool WD42C22::seekDrive(WORD toCylinder, BYTE toHead)
 { 
+  beginSeek(toCylinder, toHead);
+  return finishSeek();
+}
+
+// start the step pulse train to given cylinder and select the head, without waiting for the heads to arrive;
+// buffer SRAM and host I/O can be done meanwhile, then poll isSeekDone() or wait in finishSeek()
+void WD42C22::beginSeek(WORD toCylinder, BYTE toHead)
+{
+  // one seek at a time
+  finishSeek();
+  m_seekResult = true;
+  
   // make sure the drive is selected
   selectDrive();
   
@@ -397,62 +543,138 @@ bool WD42C22::seekDrive(WORD toCylinder, BYTE toHead)
   }
   
   // set cylinder
-  if ((m_physicalCylinder != toCylinder) && (toCylinder < m_params.Cylinders))
+  if ((m_physicalCylinder == toCylinder) || (toCylinder >= m_params.Cylinders))
   {
-    const bool forwards = toCylinder > m_physicalCylinder;
-    WORD count = forwards ? (toCylinder - m_physicalCylinder) : (m_physicalCylinder - toCylinder);
-    
-    // direction change
-    if (m_seekForward != forwards)
+    updateCylinderLines();
+    return;
+  }
+  
+  const bool forwards = toCylinder > m_physicalCylinder;
+  const WORD count = forwards ? (toCylinder - m_physicalCylinder) : (m_physicalCylinder - toCylinder);
+  
+  // direction change
+  if (m_seekForward != forwards)
+  {
+    if (forwards)
     {
-      if (forwards)
-      {
-        PORTC |= 0x20;
-      }
-      else
-      {
-        PORTC &= 0xDF;
-      }
-      
-      DELAY_CYCLES(1);
-      m_seekForward = forwards;
+      PORTC |= 0x20;
     }
-    
-    // ST506 or buffered seek
-    const bool slowSeek = m_params.SlowSeek;
-    seekComplete = false;
-    while (count)
+    else
     {
-      PORTC ^= 0x10;
-      DELAY_US(SEEK_PULSE_US);
-      PORTC ^= 0x10;
-      
-      if (slowSeek)
-      {
-        DELAY_MS(SLOWSEEK_SRT_MS);  
-      }
-      else
-      {
-        DELAY_US(FASTSEEK_SRT_US);
-      }
-      
-      count--;
+      PORTC &= 0xDF;
     }
     
-    // wait until heads are settled after all seek pulses are done
-    DWORD wait = TIMEOUT_SETTLE;
-    while (!seekComplete)
+    DELAY_CYCLES(1);
+    m_seekForward = forwards;
+  }
+  
+  // step period: ST506 or buffered seek, or a step rate calibrated for this drive
+  DWORD periodUs = SEEK_PULSE_US;
+  if (m_params.StepRateUs)
+  {
+    periodUs += m_params.StepRateUs;
+  }
+  else if (m_params.SlowSeek)
+  {
+    periodUs += SLOWSEEK_SRT_MS * 1000UL;
+  }
+  else
+  {
+    periodUs += FASTSEEK_SRT_US;
+  }
+  
+  // the pulse must have ended, with interrupt latencies, before the next one begins
+  if (periodUs < (SEEK_PULSE_US * 4))
+  {
+    periodUs = SEEK_PULSE_US * 4;
+  }
+  
+  m_seekCylinder = toCylinder;
+  m_seeking = true;
+  seekComplete = false;
+  steppingDone = false;
+  stepsRemaining = count;
+  
+  // CTC mode, 0.5us ticks (prescaler 8), or 4us ticks (prescaler 64) for periods above 32ms
+  TCCR4A = 0;
+  TCCR4B = 0;
+  TCNT4 = 0;
+  TIFR4 = 0xFF;
+  if (periodUs <= 32768UL)
+  {
+    OCR4A = (WORD)(periodUs * 2 - 1);
+    stepPulseTicks = SEEK_PULSE_US * 2 + 1;
+    TIMSK4 = 2;
+    TCCR4B = 0x0A;
+  }
+  else
+  {
+    OCR4A = (WORD)(periodUs / 4 - 1);
+    stepPulseTicks = SEEK_PULSE_US / 4 + 2;
+    TIMSK4 = 2;
+    TCCR4B = 0x0B;
+  }
+}
+
+// true if there is no seek in progress, or the last beginSeek() has just completed or timed out
+bool WD42C22::isSeekDone()
+{
+  if (!m_seeking)
+  {
+    return true;
+  }
+  
+  // still stepping
+  if (!steppingDone)
+  {
+    return false;
+  }
+  
+  // wait until heads are settled after all seek pulses are done
+  if (!seekComplete)
+  {
+    if ((micros() - lastStepTime) < TIMEOUT_SETTLE_US)
     {
-      if (!--wait)
-      {
-        ui->fatalError(Progmem::uiFeSeek);
-        return false;
-      }    
+      return false;
     }
     
-    m_physicalCylinder = toCylinder;
+    // heads did not report arriving, keep the last known position
+    m_seeking = false;
+    m_seekResult = false;
+    m_settleTime = 0;
+    
+    // during step rate calibration, a too fast rate may be expected to fail
+    if (m_seekTimeoutFatal)
+    {
+      ui->fatalError(Progmem::uiFeSeek);
+    }
+    return true;
   }
   
+  // seek complete could be signalled before the last step with buffered seeks
+  DWORD completeTime;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    completeTime = seekCompleteTime;
+  }
+  const DWORD settled = completeTime - lastStepTime;
+  m_settleTime = (settled < TIMEOUT_SETTLE_US) ? settled : 0;
+  
+  m_physicalCylinder = m_seekCylinder;
+  m_seeking = false;
+  updateCylinderLines();
+  return true;
+}
+
+// wait for the seek in progress, false if it timed out
+bool WD42C22::finishSeek()
+{
+  while (!isSeekDone()) {}
+  return m_seekResult;
+}
+
+void WD42C22::updateCylinderLines()
+{
   // the MSB HDSEL is on some very old drives used as reduced write current signal
   if (m_params.UseReduceWriteCurrent && (m_params.Heads <= 8))
   {
@@ -478,8 +700,6 @@ bool WD42C22::seekDrive(WORD toCylinder, BYTE toHead)
       PORTE &= 0xF7; // WPCEN low
     }
   }
-  
-  return true;
 }
 
 bool WD42C22::applyParams()
@@ -702,11 +922,13 @@ void WD42C22::scanID(WORD& cylinderNo, BYTE& sectorNo, BYTE& sdh)
   }
 }
 
-DWORD* WD42C22::fillSectorsTable(WORD& tableCount)
+DWORD* WD42C22::fillSectorsTable(WORD& tableCount, WORD** intervals)
 {
   // similar to above, fill a table of sector IDs
   // always returns the table on success or error - no checking, needs to be quick
-  // deallocation handled by caller
+  // intervals: if not NULL, also gets a table of tableCount entries, with microseconds elapsed from the preceding ID
+  // to each one (timestamped in the MCINT interrupt; 0 for the first), or NULL if out of memory
+  // deallocation of both handled by caller
   const BYTE cancelSdh = (m_params.Heads > 8) ? 0x6F : 0x67;
   
   tableCount = 100; // should suffice
@@ -719,6 +941,18 @@ DWORD* WD42C22::fillSectorsTable(WORD& tableCount)
   }
   memset(table, 0xFF, tableCount*sizeof(DWORD)); // each 0xFFFFFFFF value means unfilled due to error
   
+  WORD* timings = NULL;
+  if (intervals)
+  {
+    timings = new WORD[tableCount];
+    if (timings)
+    {
+      memset(timings, 0, tableCount*sizeof(WORD));
+    }
+    *intervals = timings;
+  }
+  
+  DWORD lastTime = 0;
   WORD tableIndex = 0;  
   while (tableIndex < tableCount)
   {
@@ -737,6 +971,13 @@ DWORD* WD42C22::fillSectorsTable(WORD& tableCount)
     // AC (aborted command) == 0
     if ((adRead(0x21) & 4) == 0)
     {
+      if (timings)
+      {
+        const DWORD elapsed = tableIndex ? (mcintTime - lastTime) : 0;
+        timings[tableIndex] = (elapsed > 0xFFFFUL) ? 0xFFFF : (WORD)elapsed;
+        lastTime = mcintTime;
+      }
+      
       // each entry lo-WORD: cylinder number, hi-WORD: (MSB: SDH, LSB: sector number)
       table[tableIndex++] = (((((DWORD)adRead(0x26) & cancelSdh) << 24) | (DWORD)adRead(0x23) << 16)) | ((((WORD)adRead(0x25)) << 8) | adRead(0x24));
     }
@@ -749,13 +990,15 @@ DWORD* WD42C22::fillSectorsTable(WORD& tableCount)
   return table;
 }
 
-void WD42C22::readSector(BYTE sectorNo, WORD sectorSizeBytes, bool longMode, WORD* overrideCyl, BYTE* overrideHead)
+void WD42C22::readSector(BYTE sectorNo, WORD sectorSizeBytes, bool longMode, WORD* overrideCyl, BYTE* overrideHead, WORD bufferOffset)
 {
   // read sector of the current track and head into the buffer
   // sectorSizeBytes: 128, 256, 512, 1024 currently
   // longMode: do not check ECC/CRC; instead, append the 4 or 7 checksum bytes into the buffer
   // overrideCyl, overrideHead: logical sector information differs from the physical cylinder and head
+  // bufferOffset: where in the buffer to place the data, normally 0; keep clear of the last 16 bytes (ECC correction)
    
+  m_formatTableLoaded = false;
   BYTE bcr = adRead(0x37);
   BYTE icr = adRead(0x3B);
   
@@ -763,8 +1006,8 @@ void WD42C22::readSector(BYTE sectorNo, WORD sectorSizeBytes, bool longMode, WOR
   adWrite(0x3B, icr);      // make sure MAC = 0 before changing DRWB    
   bcr &= 0xFB;             // DRWB = 0
   adWrite(0x37, bcr);
-  adWrite(0x34, 0);        // starting address of data into the buffer
-  adWrite(0x35, 0);
+  adWrite(0x34, (BYTE)bufferOffset);        // starting address of data into the buffer
+  adWrite(0x35, (BYTE)(bufferOffset >> 8));
   adWrite(0x3F, 0x40);     // ECCM = 0, DDRQ = 1
   icr |= 8;
   adWrite(0x3B, icr);      // MAC = 1  
@@ -830,7 +1073,7 @@ void WD42C22::readSector(BYTE sectorNo, WORD sectorSizeBytes, bool longMode, WOR
     // correctable?
     if (getLastError() == WDC_CORRECTED)
     {
-      doCorrection();
+      doCorrection(bufferOffset);
     }
   }
 }
@@ -842,6 +1085,7 @@ void WD42C22::verifyTrack(BYTE sectorsPerTrack, WORD sectorSizeBytes, BYTE start
   // used for quick verify during mainmenu format:
   // if this fails, fall back to individual readSector to determine offending sectors
   
+  m_formatTableLoaded = false;
   BYTE bcr = adRead(0x37);
   BYTE icr = adRead(0x3B);
   
@@ -947,8 +1191,10 @@ void WD42C22::computeCorrection()
   }
 }
 
-void WD42C22::doCorrection()
+void WD42C22::doCorrection(WORD bufferOffset)
 {
+  // bufferOffset: where readSector placed the sector data, error location is relative to it
+  
   // max 7 syndrome bytes (unused here) + 2 byte offset + max 7 error pattern bytes
   BYTE data[16] = {0};
   
@@ -959,7 +1205,7 @@ void WD42C22::doCorrection()
     data[index] = sramReadByteSequential();
   }
   
-  const WORD errorLocation = ((WORD)(data[7]) << 8) | data[8]; // after syndrome bytes
+  const WORD errorLocation = (((WORD)(data[7]) << 8) | data[8]) + bufferOffset; // after syndrome bytes
   const BYTE eccSize = (m_params.DataVerifyMode == MODE_ECC_56BIT) ? 7 : 4;
   
   // 4 byte ECC: default correction span of 5 bits, XOR first two error pattern bytes
@@ -1025,7 +1271,20 @@ BYTE WD42C22::getSDHFromSectorSize(WORD sectorSizeBytes)
   return sdh;
 }
 
-bool WD42C22::prepareFormatInterleave(BYTE sectorsPerTrack, BYTE interleave, BYTE startSector, BYTE* badBlocksTable)
+BYTE WD42C22::getDefaultGapSize(WORD sectorSizeBytes)
+{
+  // see formatTrack()
+  return (BYTE)(sectorSizeBytes/16 + 8);
+}
+
+BYTE WD42C22::getFormatGapSize(WORD sectorSizeBytes)
+{
+  // GAP3 the drive was last formatted with (planned by the Format command), if not the default;
+  // only a fallback for marking bad sectors later, when the gap of the track could not be measured
+  return (m_params.FormatGapSize >= 4) ? m_params.FormatGapSize : getDefaultGapSize(sectorSizeBytes);
+}
+
+bool WD42C22::prepareFormatInterleave(BYTE sectorsPerTrack, BYTE interleave, BYTE startSector, BYTE* badBlocksTable, BYTE skew)
 {
   // writes a special interleave table for the WDC into its buffer
   // 2 bytes per each sector, structure:
@@ -1037,37 +1296,48 @@ bool WD42C22::prepareFormatInterleave(BYTE sectorsPerTrack, BYTE interleave, BYT
   // badBlocksTable: if not null, points to an array of bytes, sectorsPerTrack size
   // array index is physical sector index, not its interleaved value
   // e.g. badBlocksTable[0] nonzero, [1] zero: first sector on track is marked bad, second is good
+  // skew: physical sector index where the first logical sector starts, the interleave table is rotated by that
   
-  BYTE* interleaveTable = NULL; // fallback to sequential on invalid values
-  if ((interleave > 1) && (interleave < sectorsPerTrack))
+  // the same table is normally used for a whole format run: the sector order is computed only when
+  // the SPT or interleave change, and the buffer is rewritten only if anything else changed or it was overwritten
+  if (!sectorsPerTrack || (sectorsPerTrack > sizeof(m_formatOrder)))
   {
-    interleaveTable = new BYTE[sectorsPerTrack + 1];
-    if (!interleaveTable)
-    {
-      ui->fatalError(Progmem::uiFeMemory);
-      return false;
-    }
+    return false;
   }
-
-  if (interleaveTable) // not allocated on sequential sectors
+  if ((interleave <= 1) || (interleave >= sectorsPerTrack))
+  {
+    interleave = 1; // fallback to sequential on invalid values
+  }
+  skew %= sectorsPerTrack;
+  
+  const bool sameOrder = (m_formatSpt == sectorsPerTrack) && (m_formatInterleave == interleave);
+  if (sameOrder && !badBlocksTable && m_formatTableLoaded && (m_formatStartSector == startSector) && (m_formatSkew == skew))
   {
-    memset(interleaveTable, 0, sectorsPerTrack+1);
+    return true;
+  }
+  
+  if (!sameOrder)
+  {
+    memset(m_formatOrder, 0, sectorsPerTrack);
     
-    BYTE pos = 1;
+    BYTE pos = 0;
     BYTE currentSector = 1;
     while (currentSector <= sectorsPerTrack)
     {
-      interleaveTable[pos] = currentSector++;
+      m_formatOrder[pos] = currentSector++;
       pos += interleave;
-      if (pos > sectorsPerTrack)
+      if (pos >= sectorsPerTrack)
       {
         pos = pos % sectorsPerTrack;
-        while ((pos <= sectorsPerTrack) && (interleaveTable[pos]))
+        while ((pos < sectorsPerTrack) && (m_formatOrder[pos]))
         {
           pos++;
         }
       }
     }
+    
+    m_formatSpt = sectorsPerTrack;
+    m_formatInterleave = interleave;
   }
   
   sramBeginBufferAccess(true, 0);
@@ -1082,8 +1352,8 @@ bool WD42C22::prepareFormatInterleave(BYTE sectorsPerTrack, BYTE interleave, BYT
       sramWriteByteSequential(0); // mark good block
     }
     
-    // set logical sector number from prepared interleave table
-    BYTE sectorNumber = interleaveTable ? interleaveTable[sector+1] : sector+1;
+    // set logical sector number from the computed interleave order
+    BYTE sectorNumber = m_formatOrder[(sector + sectorsPerTrack - skew) % sectorsPerTrack];
     
     // if startSector is not 1-based, adjust this value
     if (startSector == 0)
@@ -1098,18 +1368,18 @@ bool WD42C22::prepareFormatInterleave(BYTE sectorsPerTrack, BYTE interleave, BYT
   }  
   sramFinishBufferAccess();
   
-  if (interleaveTable)
-  {
-    delete[] interleaveTable;
-  }
-  
+  // bad block marks are specific to one track
+  m_formatStartSector = startSector;
+  m_formatSkew = skew;
+  m_formatTableLoaded = !badBlocksTable;
   return true;
 }
 
-void WD42C22::formatTrack(BYTE sectorsPerTrack, WORD sectorSizeBytes, WORD* overrideCyl, BYTE* overrideHead)
+void WD42C22::formatTrack(BYTE sectorsPerTrack, WORD sectorSizeBytes, WORD* overrideCyl, BYTE* overrideHead, BYTE gapSize)
 {
   // expects the SRAM buffer already prepared with prepareFormatInterleave()  
   // overrideCyl, overrideHead: logical sector information differs from the physical cylinder and head
+  // gapSize: GAP3 length in bytes (at least 4), or 0 for the one the drive was last formatted with, or auto-detect
     
   // idPloLength: "length of the ID PLO sync field" - byte padding before the actual ID field starts,
   // for the Phase Locked Oscillator (in the data separator) to synchronize properly
@@ -1124,8 +1394,10 @@ void WD42C22::formatTrack(BYTE sectorsPerTrack, WORD sectorSizeBytes, WORD* over
   // where M is motor speed variation of disk, 0.03 for +- 3%;
   // S: sector length in bytes
   // K: extra padding if sector is going to be extended (originally 18, this was too high for certain formats)
-  BYTE gapSize = sectorSizeBytes/16;
-  gapSize += 8;
+  if (gapSize < 4)
+  {
+    gapSize = getFormatGapSize(sectorSizeBytes);
+  }
   
   BYTE bcr = adRead(0x37);
   BYTE icr = adRead(0x3B);
@@ -1190,7 +1462,7 @@ void WD42C22::formatTrack(BYTE sectorsPerTrack, WORD sectorSizeBytes, WORD* over
   processResult();  
 }
 
-void WD42C22::writeSector(BYTE sectorNo, WORD sectorSizeBytes, WORD* overrideCyl, BYTE* overrideHead)
+void WD42C22::writeSector(BYTE sectorNo, WORD sectorSizeBytes, WORD* overrideCyl, BYTE* overrideHead, WORD bufferOffset)
 {
   // analog to readSector, just without "long mode"  
   // dataPloLength: byte padding of the data field; default 12 bytes + dataPloLength
@@ -1203,8 +1475,8 @@ void WD42C22::writeSector(BYTE sectorNo, WORD sectorSizeBytes, WORD* overrideCyl
   adWrite(0x3B, icr);      // make sure MAC = 0 before changing DRWB    
   bcr |= 4;                // DRWB = 1
   adWrite(0x37, bcr);
-  adWrite(0x34, 0);        // starting address of data in buffer
-  adWrite(0x35, 0);
+  adWrite(0x34, (BYTE)bufferOffset);        // starting address of data in buffer
+  adWrite(0x35, (BYTE)(bufferOffset >> 8));
   adWrite(0x3F, 0x40);     // ECCM = 0, DDRQ = 1
   icr |= 8;
   adWrite(0x3B, icr);      // MAC = 1  
@@ -1258,7 +1530,8 @@ void WD42C22::writeSector(BYTE sectorNo, WORD sectorSizeBytes, WORD* overrideCyl
   processResult();
 }
 
-void WD42C22::setBadSector(BYTE sectorNo, WORD* overrideCyl, BYTE* overrideHead)
+// mark the given sectors of the current track bad, with a single sector ID scan
+void WD42C22::setBadSectors(const BYTE* sectors, BYTE count, WORD* overrideCyl, BYTE* overrideHead, BYTE gapSize)
 {    
   // This makes use of the WD42C22 "Write ID command" to mark a bad sector without having to reformat the whole track:
   // as when we read or write an image, the first comes the sector numbering table, only then the actual data, where we verify their good/bad flag.
@@ -1287,6 +1560,16 @@ void WD42C22::setBadSector(BYTE sectorNo, WORD* overrideCyl, BYTE* overrideHead)
   //                 use the hard sector FormatSingleSector with W=1 for the first sector, even though we're soft-sectored.
   // Anyone knows of a better solution, feel free to share...
   
+  // All of the sectors are located in one fillSectorsTable() scan, the first sector of the track is formatted first,
+  // then the parameter block with the WriteID offset is loaded once (the offset only changes with the sector size),
+  // all the WriteIDs are issued, and the parameter block is restored.
+  // sectors: logical sector numbers, count of them; gapSize: as used in formatTrack(), 0 to measure it on the track
+  
+  if (!sectors || !count)
+  {
+    return;
+  }
+  
   WORD currentCyl = m_physicalCylinder;
   BYTE currentHead = m_physicalHead;
   if (overrideCyl)
@@ -1299,246 +1582,355 @@ void WD42C22::setBadSector(BYTE sectorNo, WORD* overrideCyl, BYTE* overrideHead)
   }
   
   WORD tableCount = 0;
-  const DWORD* sectorsTable = wdc->fillSectorsTable(tableCount);
+  WORD* intervals = NULL;
+  const DWORD* sectorsTable = wdc->fillSectorsTable(tableCount, &intervals);
   if (!sectorsTable || !tableCount)
   {
+    if (intervals)
+    {
+      delete[] intervals;
+    }
     return;
   }
-
-  // analyze the sector map  
-  BYTE lowestSectorOnTrack = (BYTE)-1;
-  bool precedingSectorFound = false;
-  BYTE precedingSectorNo = 0;
-  WORD sectorSizeBytes = 0;  
   
-  for (WORD index = 1; index < tableCount; index++)
+  // the first sector after the index follows the longest ID interval of a revolution, as the index gap is wider
+  // than the gaps in between sectors; with head or cylinder skew, it is not the lowest logical sector number
+  BYTE firstSectorOnTrack = (BYTE)-1;
+  if (intervals)
   {
-    // entry unfilled or invalid
-    if (sectorsTable[index] == 0xFFFFFFFFUL)
+    WORD revolution = 0;
+    for (WORD index = 1; (index < tableCount) && (sectorsTable[index] != 0xFFFFFFFFUL); index++)
+    {
+      if (sectorsTable[index] == sectorsTable[0])
+      {
+        revolution = index;
+        break;
+      }
+    }
+    
+    WORD longest = 0;
+    WORD second = 0;
+    WORD longestIndex = 0;
+    DWORD total = 0;
+    bool sameSize = true;
+    for (WORD index = 1; index <= revolution; index++)
     {
-      continue;
+      total += intervals[index];
+      sameSize = sameSize && ((sectorsTable[index] >> 24) == (sectorsTable[0] >> 24));
+      if (intervals[index] > longest)
+      {
+        second = longest;
+        longest = intervals[index];
+        longestIndex = index;
+      }
+      else if (intervals[index] > second)
+      {
+        second = intervals[index];
+      }
     }
+    delete[] intervals;
     
-    // find the lowest logical sector number...
-    const BYTE thisSector = (sectorsTable[index-1] >> 16);
-    if (thisSector < lowestSectorOnTrack)
+    // only if it clearly stands out
+    if (longestIndex && ((longest - second) > (longest / 32)))
     {
-      lowestSectorOnTrack = thisSector;
+      firstSectorOnTrack = (BYTE)(sectorsTable[longestIndex] >> 16);
     }
     
-    // ... and the logical sector number preceding sectorNo 
-    if (!precedingSectorFound)
+    // GAP3 not given: the track may have been formatted with any, measure it from the average sector to sector interval
+    if ((gapSize < 4) && sameSize && (revolution > 1))
+    {
+      gapSize = getMeasuredGapSize(getSectorSizeFromSDH((BYTE)(sectorsTable[0] >> 24)), (total - longest) / (revolution - 1));
+    }
+  }
+  
+  // not determined: the lowest logical sector number, as formatted without skew
+  if (firstSectorOnTrack == (BYTE)-1)
+  {
+    for (WORD index = 1; index < tableCount; index++)
+    {
+      // entry unfilled or invalid
+      if (sectorsTable[index] == 0xFFFFFFFFUL)
+      {
+        continue;
+      }
+      
+      const BYTE thisSector = (sectorsTable[index-1] >> 16);
+      if (thisSector < firstSectorOnTrack)
+      {
+        firstSectorOnTrack = thisSector;
+      }
+    }
+  }
+  
+  // first pass: the first sector on track, formatted with the normal parameter block
+  // second pass: WriteID with F=1 for all the others
+  WORD loadedOffset = 0;
+  bool failed = false;
+  for (BYTE pass = 0; (pass < 2) && !failed; pass++)
+  {
+    for (BYTE idx = 0; idx < count; idx++)
     {
-      const DWORD search = (sectorsTable[index] & 0xFF00FFFFUL) | ((DWORD)sectorNo << 16);
-      if (sectorsTable[index] == search)
+      const BYTE sectorNo = sectors[idx];
+      const bool isFirstSectorOnTrack = (sectorNo == firstSectorOnTrack);
+      if (isFirstSectorOnTrack != (pass == 0))
+      {
+        continue;
+      }
+      
+      // the logical sector number preceding sectorNo, and its size
+      bool precedingSectorFound = false;
+      BYTE precedingSectorNo = 0;
+      WORD sectorSizeBytes = 0;
+      for (WORD index = 1; index < tableCount; index++)
       {
-        if (sectorsTable[index-1] == 0xFFFFFFFFUL)
+        const DWORD search = (sectorsTable[index] & 0xFF00FFFFUL) | ((DWORD)sectorNo << 16);
+        if ((sectorsTable[index] == 0xFFFFFFFFUL) || (sectorsTable[index] != search) || (sectorsTable[index-1] == 0xFFFFFFFFUL))
         {
-          continue; // invalid preceding entry
+          continue;
         }
         
         precedingSectorNo = (BYTE)(sectorsTable[index-1] >> 16);
         sectorSizeBytes = getSectorSizeFromSDH((BYTE)(sectorsTable[index-1] >> 24));
         precedingSectorFound = true;
+        break;
       }
-    }    
-  }
-  delete[] sectorsTable;
-  
-  const bool isFirstSectorOnTrack = (sectorNo == lowestSectorOnTrack);
-  if (!isFirstSectorOnTrack && !precedingSectorFound)
-  {
-    return; // nothing to do
-  }
-    
-  // do WriteID with F=1
-  if (!isFirstSectorOnTrack)
-  {
-    // prepare 5 bytes sector ident
-    sramBeginBufferAccess(true, 2043);
-    
-    // BYTE0: sector number to find (before the byte offset, so sector preceding)
-    sramWriteByteSequential(precedingSectorNo);
-    
-    // BYTE1: IDENT (bits 7-4: one, bit 3: ~cyl10, bit 2: 1, bit 1: ~cyl9, bit 0: cyl8)
-    const BYTE msb = (BYTE)(currentCyl >> 8);
-    BYTE byte = 0xF4;
-    if (!(msb & 4))
-    {
-      byte |= 8;
-    }
-    if (!(msb & 2))
-    {
-      byte |= 2;
-    }
-    if (msb & 1)
-    {
-      byte |= 1;
-    }  
-    sramWriteByteSequential(byte);
       
-    // BYTE2: CYL LOW
-    sramWriteByteSequential((BYTE)currentCyl);
-    
-    // BYTE3: HEAD (bit 7: bad block flag, 6-5: sector size like SDH, low 4 bits: head number)
-    byte = getSDHFromSectorSize(sectorSizeBytes);
-    byte |= currentHead | 0x80; // set BB=1
-    sramWriteByteSequential(byte);
-    
-    // BYTE4: SEC# - logical sector number to write
-    sramWriteByteSequential(sectorNo);   
-    sramFinishBufferAccess(); // we're done with the buffer
-    
-    // now compute the proper offset and load it
-
-    WORD offset = 3; // 2+1 bytes ID PAD, WRITE SPICE
-    offset += sectorSizeBytes; // +data field size
-    if (m_params.DataVerifyMode == MODE_CRC_16BIT)
-    {
-      offset += 2; // +2 bytes CRC
-    }
-    if (m_params.DataVerifyMode == MODE_ECC_32BIT)
-    {
-      offset += 4; // +4 bytes ECC
-    }
-    else if (m_params.DataVerifyMode == MODE_ECC_56BIT)
-    {
-      offset += 7; // +7 bytes ECC
-    }  
-    offset += 4; // +3 bytes DATA PAD, + 1 byte WS
-    
-    // +GAP, see formatTrack
-    offset += sectorSizeBytes/16;
-    offset += 8;
-    
-    // load offset to loadParameterBlock() -> use defaults from applyParams(), but set U=1 for writeID to work
-    loadParameterBlock(m_params.UseRLL ? 0x33 : 0x4E, 0, true, offset);
-    
-    BYTE bcr = adRead(0x37);
-    BYTE icr = adRead(0x3B);
-    
-    icr &= 0xF7;
-    adWrite(0x3B, icr);      // make sure MAC = 0 before changing DRWB    
-    bcr |= 4;                // DRWB = 1
-    adWrite(0x37, bcr);
-    adWrite(0x34, 0xFB);     // starting address of data in buffer - offset 2043
-    adWrite(0x35, 7);
-    adWrite(0x3F, 0x40);     // ECCM = 0, DDRQ = 1
-    icr |= 8;
-    adWrite(0x3B, icr);      // MAC = 1  
-    bcr |= 1;
-    adWrite(0x37, bcr);      // ADBP = 1  
-    icr &= 0xF7;
-    adWrite(0x3B, icr);      // MAC = 0
-    
-    // prepare task file registers  
-    adWrite(0x21, 1);                       // set PLO length to 1 as a zero would cause a 2048-byte PLO field here...
-    adWrite(0x22, 1);                       // sector count
-    adWrite(0x23, sectorNo);                // sector number
-    adWrite(0x24, (BYTE)currentCyl);        // cyl LSB
-    adWrite(0x25, (BYTE)(currentCyl >> 8)); // cyl MSB
-    
-    // prepare SDH register
-    BYTE sdh = getSDHFromSectorSize(sectorSizeBytes);
-
-    // ECC = 1 into SDH  
-    if (m_params.DataVerifyMode != MODE_CRC_16BIT)
-    {
-      sdh |= 0x80;
-    }
-    sdh |= currentHead; // low 3 or 4 bits
-    adWrite(0x26, sdh);
-    
-    m_result = WDC_OK;
-    DWORD wait = TIMEOUT_IO;
-    mcintFired = false;
-    adWrite(0x27, 0xB8); // write ID
-    
-    while (!mcintFired)
-    {
-      if (!--wait)
+      if (isFirstSectorOnTrack)
+      {
+        formatBadFirstSector(sectorNo, sectorSizeBytes, currentCyl, currentHead, gapSize);
+      }
+      else if (precedingSectorFound)
       {
-        m_result = WDC_TIMEOUT;
+        // load the offset to loadParameterBlock(), unless the same one is already there
+        const WORD offset = getWriteIDOffset(sectorSizeBytes, gapSize);
+        if (offset != loadedOffset)
+        {
+          loadParameterBlock(m_params.UseRLL ? 0x33 : 0x4E, 0, true, offset);
+          loadedOffset = offset;
+        }
+        
+        writeBadSectorID(precedingSectorNo, sectorNo, sectorSizeBytes, currentCyl, currentHead);
+      }
+      
+      // WDC timeout, drive not ready or write fault: stop here
+      if (m_result && (m_result < 4))
+      {
+        failed = true;
         break;
       }
     }
-    
-    processResult();
-    
-    // set U back to 0 to disable non-standard sector sizes
+  }
+  delete[] sectorsTable;
+  
+  // set U back to 0 to disable non-standard sector sizes
+  if (loadedOffset)
+  {
     const BYTE saveResult = m_result;
-    const BYTE saveMessage = m_errorMessage;
+    const WORD saveMessage = m_errorMessage;
     
     loadParameterBlock(m_params.UseRLL ? 0x33 : 0x4E, 0);
     
     m_result = saveResult;
     m_errorMessage = saveMessage; 
   }
+}
+
+// GAP3 of a track from the interval of its sector IDs in microseconds, 0 if it does not fit the sector size
+BYTE WD42C22::getMeasuredGapSize(WORD sectorSizeBytes, DWORD intervalUs)
+{
+  // into bytes: 1.6us each with MFM at 5Mbit/s, 16/15us with RLL at 7.5Mbit/s (written by this controller's clock)
+  const DWORD bytes = m_params.UseRLL ? (intervalUs*15 + 8)/16 : (intervalUs*5 + 4)/8;
   
-  // do format single sector after INDEX with W=1
-  else
+  // less the rest of the sector: 11 bytes ID PLO, 7 bytes ID field, 3 bytes ID pad and splice, 12 bytes DATA PLO,
+  // 2 bytes data address mark, the data field and its CRC/ECC, 4 bytes data pad and splice
+  const DWORD sectorBytes = 39 + sectorSizeBytes + ((m_params.DataVerifyMode == MODE_ECC_56BIT) ? 7 :
+                                                    (m_params.DataVerifyMode == MODE_ECC_32BIT) ? 4 : 2);
+  if ((bytes < sectorBytes + 4) || (bytes > sectorBytes + 255))
   {
-    // see formatTrack
-    const BYTE idPloLength = 2;
-    BYTE gapSize = sectorSizeBytes/16;
-    gapSize += 8;
+    return 0;
+  }
   
-    // ditto, just for one sector
-    sramBeginBufferAccess(true, 0);
-    sramWriteByteSequential(0x80);
-    sramWriteByteSequential(sectorNo);
-    sramFinishBufferAccess();
-    
-    BYTE bcr = adRead(0x37);
-    BYTE icr = adRead(0x3B);
-    
-    icr &= 0xF7;
-    adWrite(0x3B, icr);      // make sure MAC = 0 before changing DRWB    
-    bcr |= 4;                // DRWB = 1
-    adWrite(0x37, bcr);
-    adWrite(0x34, 0);        // starting address of interleave table
-    adWrite(0x35, 0);
-    adWrite(0x3F, 0x40);     // ECCM = 0, DDRQ = 1
-    icr |= 8;
-    adWrite(0x3B, icr);      // MAC = 1  
-    bcr |= 1;
-    adWrite(0x37, bcr);      // ADBP = 1  
-    icr &= 0xF7;
-    adWrite(0x3B, icr);      // MAC = 0    
-       
-    // prepare task file registers
-    adWrite(0x21, idPloLength);             // PLO length
-    adWrite(0x22, 1);                       // one sector
-    adWrite(0x23, gapSize-3);               // WD: Gap length written on disk is 3 bytes longer than gap value specified in sector number register
-    adWrite(0x24, (BYTE)currentCyl);        // LSB
-    adWrite(0x25, (BYTE)(currentCyl >> 8)); // MSB
+  return (BYTE)(bytes - sectorBytes);
+}
+
+// byte offset from the preceding sector ID, where WriteID with F=1 writes the ID of the next sector
+WORD WD42C22::getWriteIDOffset(WORD sectorSizeBytes, BYTE gapSize)
+{
+  WORD offset = 3; // 2+1 bytes ID PAD, WRITE SPICE
+  offset += sectorSizeBytes; // +data field size
+  if (m_params.DataVerifyMode == MODE_CRC_16BIT)
+  {
+    offset += 2; // +2 bytes CRC
+  }
+  if (m_params.DataVerifyMode == MODE_ECC_32BIT)
+  {
+    offset += 4; // +4 bytes ECC
+  }
+  else if (m_params.DataVerifyMode == MODE_ECC_56BIT)
+  {
+    offset += 7; // +7 bytes ECC
+  }  
+  offset += 4; // +3 bytes DATA PAD, + 1 byte WS
+  
+  // +GAP, see formatTrack
+  offset += (gapSize < 4) ? getFormatGapSize(sectorSizeBytes) : gapSize;
+  return offset;
+}
+
+// WriteID with F=1 (the parameter block with the offset needs to be loaded)
+void WD42C22::writeBadSectorID(BYTE precedingSectorNo, BYTE sectorNo, WORD sectorSizeBytes, WORD currentCyl, BYTE currentHead)
+{
+  // prepare 5 bytes sector ident
+  sramBeginBufferAccess(true, 2043);
+  
+  // BYTE0: sector number to find (before the byte offset, so sector preceding)
+  sramWriteByteSequential(precedingSectorNo);
+  
+  // BYTE1: IDENT (bits 7-4: one, bit 3: ~cyl10, bit 2: 1, bit 1: ~cyl9, bit 0: cyl8)
+  const BYTE msb = (BYTE)(currentCyl >> 8);
+  BYTE byte = 0xF4;
+  if (!(msb & 4))
+  {
+    byte |= 8;
+  }
+  if (!(msb & 2))
+  {
+    byte |= 2;
+  }
+  if (msb & 1)
+  {
+    byte |= 1;
+  }  
+  sramWriteByteSequential(byte);
     
-    // prepare SDH register
-    BYTE sdh = getSDHFromSectorSize(sectorSizeBytes);
+  // BYTE2: CYL LOW
+  sramWriteByteSequential((BYTE)currentCyl);
+  
+  // BYTE3: HEAD (bit 7: bad block flag, 6-5: sector size like SDH, low 4 bits: head number)
+  byte = getSDHFromSectorSize(sectorSizeBytes);
+  byte |= currentHead | 0x80; // set BB=1
+  sramWriteByteSequential(byte);
+  
+  // BYTE4: SEC# - logical sector number to write
+  sramWriteByteSequential(sectorNo);   
+  sramFinishBufferAccess(); // we're done with the buffer
+  
+  BYTE bcr = adRead(0x37);
+  BYTE icr = adRead(0x3B);
+  
+  icr &= 0xF7;
+  adWrite(0x3B, icr);      // make sure MAC = 0 before changing DRWB    
+  bcr |= 4;                // DRWB = 1
+  adWrite(0x37, bcr);
+  adWrite(0x34, 0xFB);     // starting address of data in buffer - offset 2043
+  adWrite(0x35, 7);
+  adWrite(0x3F, 0x40);     // ECCM = 0, DDRQ = 1
+  icr |= 8;
+  adWrite(0x3B, icr);      // MAC = 1  
+  bcr |= 1;
+  adWrite(0x37, bcr);      // ADBP = 1  
+  icr &= 0xF7;
+  adWrite(0x3B, icr);      // MAC = 0
+  
+  // prepare task file registers  
+  adWrite(0x21, 1);                       // set PLO length to 1 as a zero would cause a 2048-byte PLO field here...
+  adWrite(0x22, 1);                       // sector count
+  adWrite(0x23, sectorNo);                // sector number
+  adWrite(0x24, (BYTE)currentCyl);        // cyl LSB
+  adWrite(0x25, (BYTE)(currentCyl >> 8)); // cyl MSB
+  
+  // prepare SDH register
+  BYTE sdh = getSDHFromSectorSize(sectorSizeBytes);
 
-    // ECC = 1 into SDH  
-    if (m_params.DataVerifyMode != MODE_CRC_16BIT)
+  // ECC = 1 into SDH  
+  if (m_params.DataVerifyMode != MODE_CRC_16BIT)
+  {
+    sdh |= 0x80;
+  }
+  sdh |= currentHead; // low 3 or 4 bits
+  adWrite(0x26, sdh);
+  
+  m_result = WDC_OK;
+  DWORD wait = TIMEOUT_IO;
+  mcintFired = false;
+  adWrite(0x27, 0xB8); // write ID
+  
+  while (!mcintFired)
+  {
+    if (!--wait)
     {
-      sdh |= 0x80;
+      m_result = WDC_TIMEOUT;
+      break;
     }
-    sdh |= currentHead; // low 3 or 4 bits
-    adWrite(0x26, sdh);
-    
-    m_result = WDC_OK;
-    DWORD wait = TIMEOUT_IO;
-    mcintFired = false;
-    adWrite(0x27, 0xD3); // format single sector, W=1
-    
-    while (!mcintFired)
+  }
+  
+  processResult();
+}
+
+// format single sector after INDEX with W=1
+void WD42C22::formatBadFirstSector(BYTE sectorNo, WORD sectorSizeBytes, WORD currentCyl, BYTE currentHead, BYTE gapSize)
+{
+  // see formatTrack
+  const BYTE idPloLength = 2;
+  if (gapSize < 4)
+  {
+    gapSize = getFormatGapSize(sectorSizeBytes);
+  }
+  
+  // ditto, just for one sector
+  sramBeginBufferAccess(true, 0);
+  sramWriteByteSequential(0x80);
+  sramWriteByteSequential(sectorNo);
+  sramFinishBufferAccess();
+  
+  BYTE bcr = adRead(0x37);
+  BYTE icr = adRead(0x3B);
+  
+  icr &= 0xF7;
+  adWrite(0x3B, icr);      // make sure MAC = 0 before changing DRWB    
+  bcr |= 4;                // DRWB = 1
+  adWrite(0x37, bcr);
+  adWrite(0x34, 0);        // starting address of interleave table
+  adWrite(0x35, 0);
+  adWrite(0x3F, 0x40);     // ECCM = 0, DDRQ = 1
+  icr |= 8;
+  adWrite(0x3B, icr);      // MAC = 1  
+  bcr |= 1;
+  adWrite(0x37, bcr);      // ADBP = 1  
+  icr &= 0xF7;
+  adWrite(0x3B, icr);      // MAC = 0    
+     
+  // prepare task file registers
+  adWrite(0x21, idPloLength);             // PLO length
+  adWrite(0x22, 1);                       // one sector
+  adWrite(0x23, gapSize-3);               // WD: Gap length written on disk is 3 bytes longer than gap value specified in sector number register
+  adWrite(0x24, (BYTE)currentCyl);        // LSB
+  adWrite(0x25, (BYTE)(currentCyl >> 8)); // MSB
+  
+  // prepare SDH register
+  BYTE sdh = getSDHFromSectorSize(sectorSizeBytes);
+
+  // ECC = 1 into SDH  
+  if (m_params.DataVerifyMode != MODE_CRC_16BIT)
+  {
+    sdh |= 0x80;
+  }
+  sdh |= currentHead; // low 3 or 4 bits
+  adWrite(0x26, sdh);
+  
+  m_result = WDC_OK;
+  DWORD wait = TIMEOUT_IO;
+  mcintFired = false;
+  adWrite(0x27, 0xD3); // format single sector, W=1
+  
+  while (!mcintFired)
+  {
+    if (!--wait)
     {
-      if (!--wait)
-      {
-        m_result = WDC_TIMEOUT;
-        break;
-      }
+      m_result = WDC_TIMEOUT;
+      break;
     }
-    
-    processResult();
   }
   
+  processResult();
 }
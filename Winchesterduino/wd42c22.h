@@ -34,7 +34,7 @@ public:
     return &wdc;
   }
   
-  // 20 bytes, needs to be POD
+  // 23 bytes, needs to be POD
   struct DiskDriveParams
   {
     bool UseRLL;
@@ -51,6 +51,8 @@ public:
     bool PartialImage;
     WORD PartialImageStartCyl;
     WORD PartialImageEndCyl;
+    WORD StepRateUs;              // 0: SLOWSEEK_SRT_MS or FASTSEEK_SRT_US, otherwise calibrated
+    BYTE FormatGapSize;           // GAP3 of the last format, 0: getDefaultGapSize()
   };
   
   // functions for buffer SRAM access  
@@ -59,19 +61,29 @@ public:
   void sramWriteByteSequential(BYTE);
   void sramFinishBufferAccess();
   void sramClearBuffer(WORD count = 2048);
+  void sramReadBuffer(BYTE*, WORD, WORD);
+  void sramWriteBuffer(const BYTE*, WORD, WORD);
   
   DiskDriveParams* getParams() { return &m_params; }
   
   bool testBoard();
   void selectDrive(bool ds0 = true);
+  void setActiveDrive(BYTE);
+  BYTE getActiveDrive() { return m_activeDrive; }
   bool isDriveReady();
   bool isWriteFault();
   bool isAtCylinder0();
   bool recalibrate();
   bool seekDrive(WORD, BYTE);  
+  void beginSeek(WORD, BYTE);
+  bool isSeekDone();
+  bool finishSeek();
   bool applyParams();
   void setWindowShift(bool, bool);
   
+  DWORD getLastSettleTime() { return m_settleTime; } // microseconds from the last step pulse to seek complete
+  void setSeekTimeoutFatal(bool fatal) { m_seekTimeoutFatal = fatal; }
+  
   WORD getPhysicalCylinder() { return m_physicalCylinder; }
   BYTE getPhysicalHead() { return m_physicalHead; }
   
@@ -79,16 +91,19 @@ public:
   BYTE getSDHFromSectorSize(WORD);
   
   BYTE getLastError() { return m_result; }
-  BYTE getLastErrorMessage() { return m_errorMessage; } // Progmem index
+  WORD getLastErrorMessage() { return m_errorMessage; } // Progmem index
   
   void scanID(WORD&, BYTE&, BYTE&);
-  void readSector(BYTE, WORD, bool longMode = false, WORD* overrideCyl = NULL, BYTE* overrideHead = NULL);
+  void readSector(BYTE, WORD, bool longMode = false, WORD* overrideCyl = NULL, BYTE* overrideHead = NULL, WORD bufferOffset = 0);
   void verifyTrack(BYTE, WORD, BYTE startSector = 1, WORD* overrideCyl = NULL, BYTE* overrideHead = NULL);
-  DWORD* fillSectorsTable(WORD&);
-  bool prepareFormatInterleave(BYTE, BYTE, BYTE startSector = 1, BYTE* badBlocksTable = NULL);
-  void formatTrack(BYTE, WORD, WORD* overrideCyl = NULL, BYTE* overrideHead = NULL);
-  void writeSector(BYTE, WORD, WORD* overrideCyl = NULL, BYTE* overrideHead = NULL);
-  void setBadSector(BYTE, WORD* overrideCyl = NULL, BYTE* overrideHead = NULL);
+  DWORD* fillSectorsTable(WORD&, WORD** intervals = NULL);
+  bool prepareFormatInterleave(BYTE, BYTE, BYTE startSector = 1, BYTE* badBlocksTable = NULL, BYTE skew = 0);
+  void formatTrack(BYTE, WORD, WORD* overrideCyl = NULL, BYTE* overrideHead = NULL, BYTE gapSize = 0);
+  BYTE getDefaultGapSize(WORD);
+  BYTE getFormatGapSize(WORD);
+  void writeSector(BYTE, WORD, WORD* overrideCyl = NULL, BYTE* overrideHead = NULL, WORD bufferOffset = 0);
+  void setBadSectors(const BYTE*, BYTE, WORD* overrideCyl = NULL, BYTE* overrideHead = NULL, BYTE gapSize = 0);
+  void setBadSector(BYTE sectorNo, WORD* overrideCyl = NULL, BYTE* overrideHead = NULL, BYTE gapSize = 0) { setBadSectors(&sectorNo, 1, overrideCyl, overrideHead, gapSize); }
   
 private:  
   WD42C22();
@@ -102,13 +117,37 @@ private:
   void setParameter();
   void processResult();
   void computeCorrection();
-  void doCorrection();
+  void doCorrection(WORD);
+  void updateCylinderLines();
+  BYTE getMeasuredGapSize(WORD, DWORD);
+  WORD getWriteIDOffset(WORD, BYTE);
+  void writeBadSectorID(BYTE, BYTE, WORD, WORD, BYTE);
+  void formatBadFirstSector(BYTE, WORD, WORD, BYTE, BYTE);
   
   bool m_seekForward;
+  bool m_seekTimeoutFatal;
+  bool m_seeking;
+  bool m_seekResult;
+  WORD m_seekCylinder;
+  DWORD m_settleTime;
   WORD m_physicalCylinder;
   BYTE m_physicalHead;
   BYTE m_result;
-  BYTE m_errorMessage;
+  WORD m_errorMessage;
   
   DiskDriveParams m_params = {};
+  
+  // last format interleave table: logical sector numbers in physical order, and what was written into the buffer
+  BYTE m_formatOrder[63];
+  BYTE m_formatSpt;
+  BYTE m_formatInterleave;
+  BYTE m_formatStartSector;
+  BYTE m_formatSkew;
+  bool m_formatTableLoaded;
+  
+  // the other drive, while not active
+  BYTE m_activeDrive;
+  DiskDriveParams m_otherParams = {};
+  WORD m_otherCylinder;
+  BYTE m_otherHead;
 };
\ No newline at end of file